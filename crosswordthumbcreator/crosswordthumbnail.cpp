@@ -19,11 +19,20 @@
 
 #include "crosswordthumbnail.h"
 #include "krossword.h"
+#include "io/krosswordxmlreader.h"
 
 #include <QUrl>
 
 bool CrosswordThumbCreator::create(const QString& path, int width, int height, QImage& img)
 {
+    // Use the thumbnail embedded into the file, if any
+    img = KrossWordXmlReader::readThumbnail(path, QSize(width, height));
+    if (!img.isNull()) {
+        if (img.width() > width || img.height() > height)
+            img = img.scaled(width, height, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        return true;
+    }
+
     KrossWord krossWord;
     QString errorString;
     if (!krossWord.read(QUrl::fromLocalFile(path), &errorString)) {
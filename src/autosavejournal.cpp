@@ -0,0 +1,245 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "autosavejournal.h"
+#include "commands.h"
+#include "krossword.h"
+#include "cells/lettercell.h"
+
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QTimer>
+#include <QDebug>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <io.h>
+#endif
+
+static const char JOURNAL_MAGIC[] = "KWJOURNAL";
+
+AutoSaveJournal::AutoSaveJournal(UndoStackExt *undoStack, QObject *parent)
+    : QObject(parent), m_undoStack(undoStack), m_stream(0), m_recordCount(0)
+{
+    m_flushTimer = new QTimer(this);
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(FLUSH_INTERVAL);
+    connect(m_flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+
+    connect(m_undoStack, SIGNAL(commandPushed(QByteArray)),
+            this, SLOT(commandPushed(QByteArray)));
+    connect(m_undoStack, SIGNAL(indexChanged(int)),
+            this, SLOT(undoIndexChanged(int)));
+}
+
+AutoSaveJournal::~AutoSaveJournal()
+{
+    close();
+}
+
+QString AutoSaveJournal::journalFileName(const QString &autoSaveFileName)
+{
+    return autoSaveFileName + ".journal";
+}
+
+QByteArray AutoSaveJournal::snapshotChecksum(const QString &autoSaveFileName)
+{
+    QFile file(autoSaveFileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    if (!hash.addData(&file))
+        return QByteArray();
+    return hash.result();
+}
+
+bool AutoSaveJournal::open(const QString &autoSaveFileName)
+{
+    close();
+
+    const QByteArray checksum = snapshotChecksum(autoSaveFileName);
+    if (checksum.isEmpty()) {
+        qDebug() << "Couldn't read the automatically saved file" << autoSaveFileName;
+        return false;
+    }
+
+    m_file.setFileName(journalFileName(autoSaveFileName));
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Couldn't open the autosave journal" << m_file.fileName()
+                 << m_file.errorString();
+        return false;
+    }
+
+    m_stream = new QDataStream(&m_file);
+    m_stream->writeRawData(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC) - 1);
+    *m_stream << VERSION << checksum;
+    m_recordCount = 0;
+    flush();
+    return true;
+}
+
+void AutoSaveJournal::close()
+{
+    if (!m_file.isOpen())
+        return;
+
+    flush();
+    delete m_stream;
+    m_stream = 0;
+    m_file.close();
+}
+
+void AutoSaveJournal::remove(const QString &autoSaveFileName)
+{
+    QFile::remove(journalFileName(autoSaveFileName));
+}
+
+void AutoSaveJournal::flush()
+{
+    m_flushTimer->stop();
+    if (!m_file.isOpen())
+        return;
+
+    if (!m_file.flush())
+        qDebug() << "Couldn't write the autosave journal" << m_file.errorString();
+    // Also flush the cache of the operating system, so that the records
+    // survive a crash of the system
+#ifdef Q_OS_UNIX
+    ::fsync(m_file.handle());
+#elif defined(Q_OS_WIN)
+    ::_commit(m_file.handle());
+#endif
+}
+
+void AutoSaveJournal::appendLetter(const Coord &coord, const QChar &letter)
+{
+    if (!m_stream)
+        return;
+
+    *m_stream << static_cast<quint8>(LetterRecord)
+              << static_cast<qint16>(coord.first) << static_cast<qint16>(coord.second)
+              << letter;
+    recordAppended();
+}
+
+void AutoSaveJournal::commandPushed(const QByteArray &commandData)
+{
+    if (!m_stream)
+        return;
+
+    *m_stream << static_cast<quint8>(UndoCommandRecord) << commandData;
+    recordAppended();
+}
+
+void AutoSaveJournal::undoIndexChanged(int index)
+{
+    if (!m_stream)
+        return;
+
+    *m_stream << static_cast<quint8>(UndoIndexRecord) << static_cast<qint32>(index);
+    recordAppended();
+}
+
+void AutoSaveJournal::recordAppended()
+{
+    ++m_recordCount;
+    if (!m_flushTimer->isActive())
+        m_flushTimer->start();
+}
+
+bool AutoSaveJournal::replay(const QString &autoSaveFileName,
+                             KrossWord *krossWord, UndoStackExt *undoStack)
+{
+    QFile file(journalFileName(autoSaveFileName));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    QByteArray magic(sizeof(JOURNAL_MAGIC) - 1, '\0');
+    quint16 version;
+    if (stream.readRawData(magic.data(), magic.size()) != magic.size()
+            || magic != JOURNAL_MAGIC) {
+        qDebug() << "Not an autosave journal" << file.fileName();
+        return false;
+    }
+    stream >> version;
+    if (version != VERSION) {
+        qDebug() << "Unsupported autosave journal version" << version;
+        return false;
+    }
+
+    // The journal may have been started for a previous automatically saved
+    // file, it's records are already contained in the current one then
+    QByteArray checksum;
+    stream >> checksum;
+    if (stream.status() != QDataStream::Ok
+            || checksum != snapshotChecksum(autoSaveFileName)) {
+        qDebug() << "The autosave journal doesn't belong to" << autoSaveFileName;
+        return false;
+    }
+
+    int replayedCount = 0;
+    while (!stream.atEnd()) {
+        quint8 type;
+        stream >> type;
+
+        if (type == UndoCommandRecord) {
+            QByteArray commandData;
+            stream >> commandData;
+            if (stream.status() != QDataStream::Ok)
+                break; // Torn last record
+
+            QDataStream commandStream(commandData);
+            UndoCommandExt *command = UndoCommandExt::fromData(krossWord, &commandStream);
+            QString errorMessage;
+            if (!command || !undoStack->tryPush(command, &errorMessage)) {
+                qDebug() << "Couldn't replay undo command from the autosave journal"
+                         << errorMessage;
+                delete command;
+                break;
+            }
+        } else if (type == UndoIndexRecord) {
+            qint32 index;
+            stream >> index;
+            if (stream.status() != QDataStream::Ok)
+                break;
+
+            undoStack->setIndex(index);
+        } else if (type == LetterRecord) {
+            qint16 x, y;
+            QChar letter;
+            stream >> x >> y >> letter;
+            if (stream.status() != QDataStream::Ok)
+                break;
+
+            KrossWordCell *cell = krossWord->at(Coord(x, y));
+            if (cell && cell->isLetterCell())
+                static_cast<LetterCell*>(cell)->setCurrentLetter(letter);
+        } else {
+            qDebug() << "Unknown record type in the autosave journal" << type;
+            break;
+        }
+        ++replayedCount;
+    }
+
+    qDebug() << "Replayed" << replayedCount << "records from the autosave journal";
+    return true;
+}
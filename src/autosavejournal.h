@@ -0,0 +1,127 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef AUTOSAVEJOURNAL_H
+#define AUTOSAVEJOURNAL_H
+
+#include "kgrid2d.h"
+
+#include <QObject>
+#include <QFile>
+
+class QTimer;
+class QDataStream;
+class UndoStackExt;
+namespace Crossword
+{
+class KrossWord;
+}
+using namespace Crossword;
+
+/** An append-only log of the changes made after the last automatically saved
+* crossword file, used to restore changes after a crash.
+*
+* Instead of writing the whole crossword for each change, pushed undo
+* commands, undo index changes and letters typed while solving get appended
+* to a journal file next to the automatically saved file. Records are
+* flushed to disk in batches, at most @ref FLUSH_INTERVAL milliseconds after
+* they were appended. A torn last record is ignored when replaying. The
+* journal gets compacted by writing the whole crossword again and reopening
+* the journal, which truncates it.
+*
+* The journal file starts with "KWJOURNAL", a quint16 version and a checksum
+* of the automatically saved file it was started for, followed by records,
+* each starting with a quint8 @ref RecordType. A journal whose checksum
+* doesn't match the automatically saved file isn't replayed, eg. if the
+* application crashed after a new file was written but before it's journal
+* was started. */
+class AutoSaveJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** Records get flushed to disk after at most this many milliseconds. */
+    static const int FLUSH_INTERVAL = 1000;
+
+    enum RecordType {
+        UndoCommandRecord = 1, /**< The data of a pushed undo command, see UndoStackExt::commandPushed(). */
+        UndoIndexRecord = 2, /**< A new index of the undo stack. */
+        LetterRecord = 3 /**< A current letter typed while solving. */
+    };
+
+    AutoSaveJournal(UndoStackExt *undoStack, QObject *parent = 0);
+    virtual ~AutoSaveJournal();
+
+    /** Gets the name of the journal of the automatically saved file
+    * @p autoSaveFileName. */
+    static QString journalFileName(const QString &autoSaveFileName);
+
+    /** Starts a new, empty journal for @p autoSaveFileName, which should
+    * have just been written. */
+    bool open(const QString &autoSaveFileName);
+    /** Flushes and closes the journal, without removing it. */
+    void close();
+    bool isOpen() const {
+        return m_file.isOpen();
+    };
+
+    /** Removes the journal of @p autoSaveFileName, eg. after the
+    * automatically saved file was removed. */
+    static void remove(const QString &autoSaveFileName);
+
+    /** The number of records appended since @ref open() was called. */
+    int recordCount() const {
+        return m_recordCount;
+    };
+
+    void appendLetter(const Coord &coord, const QChar &letter);
+
+    /** Applies the changes recorded in the journal of @p autoSaveFileName to
+    * @p krossWord, which should have been read from @p autoSaveFileName,
+    * and @p undoStack, which should contain it's edit history.
+    * @returns false if there is no valid journal. */
+    static bool replay(const QString &autoSaveFileName, KrossWord *krossWord,
+                       UndoStackExt *undoStack);
+
+public slots:
+    /** Writes appended records to disk. */
+    void flush();
+
+private slots:
+    void commandPushed(const QByteArray &commandData);
+    void undoIndexChanged(int index);
+
+private:
+    static const quint16 VERSION = 2;
+
+    /** Gets a checksum of the contents of @p autoSaveFileName, or an empty
+    * QByteArray if it can't be read. */
+    static QByteArray snapshotChecksum(const QString &autoSaveFileName);
+
+    /** Counts the record written to @ref m_stream and schedules a flush. */
+    void recordAppended();
+
+    UndoStackExt *m_undoStack;
+    QFile m_file;
+    QDataStream *m_stream;
+    QTimer *m_flushTimer;
+    int m_recordCount;
+};
+
+#endif // AUTOSAVEJOURNAL_H
@@ -0,0 +1,254 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "batchprocessor.h"
+#include "cells/cluecell.h"
+#include "cells/lettercell.h"
+#include "io/krosswordpuzreader.h"
+#include "io/krosswordxmlreader.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QUrl>
+#include <QDebug>
+
+/** Maximal number of structural problems listed per file. */
+#define MAX_LISTED_PROBLEMS 10
+
+BatchProcessor::BatchProcessor(BatchProcessor::Operations operations)
+    : m_operations(operations), m_targetFormat(KrossWord::DetermineByFileName),
+      m_failedCount(0)
+{
+}
+
+KrossWord::FileFormat BatchProcessor::fileFormatFromExtension(const QString& extension)
+{
+    const QString lowerExtension = extension.toLower();
+    if (lowerExtension == "kwp" || lowerExtension == "xml")
+        return KrossWord::KrossWordPuzzleXmlFile;
+    else if (lowerExtension == "kwpz")
+        return KrossWord::KrossWordPuzzleCompressedXmlFile;
+    else if (lowerExtension == "kwpb")
+        return KrossWord::KrossWordPuzzleBinaryFile;
+    else if (lowerExtension == "puz")
+        return KrossWord::AcrossLitePuzFile;
+    else
+        return KrossWord::DetermineByFileName;
+}
+
+QStringList BatchProcessor::crosswordFiles(const QStringList& paths)
+{
+    const QStringList nameFilters = QStringList() << "*.kwp" << "*.kwpz"
+                                    << "*.kwpb" << "*.puz";
+    QStringList fileNames;
+    foreach(const QString & path, paths) {
+        if (QFileInfo(path).isDir()) {
+            QStringList dirFileNames;
+            QDirIterator it(path, nameFilters, QDir::Files,
+                            QDirIterator::Subdirectories);
+            while (it.hasNext())
+                dirFileNames << it.next();
+            dirFileNames.sort();
+            fileNames << dirFileNames;
+        } else
+            fileNames << path; // Errors get reported when reading the file
+    }
+
+    return fileNames;
+}
+
+int BatchProcessor::process(const QStringList& paths)
+{
+    if (m_operations.testFlag(Convert)
+            && m_targetFormat == KrossWord::DetermineByFileName) {
+        qWarning() << "No file format to convert to";
+        return -1;
+    }
+
+    if (!m_outputDirectory.isEmpty())
+        QDir().mkpath(m_outputDirectory);
+
+    m_failedCount = 0;
+    const QStringList fileNames = crosswordFiles(paths);
+
+    foreach(const QString & fileName, fileNames)
+    fileProcessed(processFile(fileName));
+
+    return m_failedCount;
+}
+
+BatchProcessor::Result BatchProcessor::processFile(const QString& fileName) const
+{
+    Result result(fileName);
+    const KrossWord::FileFormat sourceFormat =
+        fileFormatFromExtension(QFileInfo(fileName).suffix());
+
+    if (m_operations.testFlag(VerifyChecksums)
+            && sourceFormat == KrossWord::AcrossLitePuzFile) {
+        QFile file(fileName);
+        KrossWordPuzStream puzReader;
+        QStringList mismatches;
+        if (puzReader.verifyChecksums(&file, &mismatches))
+            result.messages << "checksums ok";
+        else {
+            result.ok = false;
+            result.messages << (mismatches.isEmpty() ? QString("checksums not readable")
+                                : "wrong checksums: " + mismatches.join(","));
+        }
+    }
+
+    KrossWord krossWord;
+    krossWord.setAnimationEnabled(false);
+    QString errorString;
+    QByteArray undoData;
+    if (!krossWord.read(QUrl::fromLocalFile(fileName), &errorString, NULL,
+                        KrossWord::DetermineByFileName, &undoData)) {
+        result.ok = false;
+        result.messages << "read error: " + errorString;
+        return result;
+    }
+
+    if (m_operations.testFlag(Validate)) {
+        const QStringList problems = validate(&krossWord);
+        if (problems.isEmpty())
+            result.messages << "valid";
+        else {
+            result.ok = false;
+            result.messages << "invalid: " + problems.join("; ");
+        }
+    }
+
+    if (m_operations.testFlag(CheckSolution)) {
+        result.messages << (krossWord.check() ? QString("solved")
+                            : QString("not solved (%1% filled)")
+                            .arg(qRound(krossWord.solutionProgress() * 100)));
+    }
+
+    if (m_operations.testFlag(DumpStatistics))
+        result.messages << statisticsString(&krossWord);
+
+    if (m_operations.testFlag(Convert)) {
+        // Undo data of compressed files is stored in an entry of it's own
+        if (undoData.isEmpty() && sourceFormat == KrossWord::KrossWordPuzzleCompressedXmlFile)
+            KrossWordXmlReader::readUndoData(fileName, &undoData);
+        if (m_targetFormat == KrossWord::AcrossLitePuzFile)
+            undoData.clear();
+
+        const QString targetFileName = outputFileName(fileName);
+        if (QFileInfo(targetFileName) == QFileInfo(fileName)) {
+            result.messages << "not converted, it's already in the target format";
+        } else if (!krossWord.write(targetFileName, &errorString, KrossWord::Normal,
+                                    m_targetFormat, undoData)) {
+            result.ok = false;
+            result.messages << "write error: " + errorString;
+        } else
+            result.messages << "converted to " + targetFileName;
+    }
+
+    return result;
+}
+
+void BatchProcessor::fileProcessed(const BatchProcessor::Result& result)
+{
+    if (!result.ok)
+        ++m_failedCount;
+
+    QTextStream out(stdout);
+    out << result.fileName << '\t' << (result.ok ? "OK" : "FAILED");
+    foreach(const QString & message, result.messages)
+    out << '\t' << message;
+    out << endl;
+}
+
+QString BatchProcessor::outputFileName(const QString& fileName) const
+{
+    QString extension;
+    switch (m_targetFormat) {
+    case KrossWord::KrossWordPuzzleXmlFile:
+        extension = "kwp";
+        break;
+    case KrossWord::KrossWordPuzzleCompressedXmlFile:
+        extension = "kwpz";
+        break;
+    case KrossWord::KrossWordPuzzleBinaryFile:
+        extension = "kwpb";
+        break;
+    case KrossWord::AcrossLitePuzFile:
+        extension = "puz";
+        break;
+    default:
+        break;
+    }
+
+    const QFileInfo fileInfo(fileName);
+    const QDir dir(m_outputDirectory.isEmpty()
+                   ? fileInfo.absolutePath() : m_outputDirectory);
+    return dir.filePath(fileInfo.completeBaseName() + '.' + extension);
+}
+
+QStringList BatchProcessor::validate(KrossWord* krossWord) const
+{
+    QStringList problems;
+    if (krossWord->width() == 0 || krossWord->height() == 0)
+        problems << "empty grid";
+
+    const CrosswordTypeInfo typeInfo = krossWord->crosswordTypeInfo();
+    foreach(ClueCell * clue, krossWord->clues()) {
+        if (clue->answerLength() < typeInfo.minAnswerLength) {
+            problems << QString("answer of the clue at %1,%2 is too short")
+                     .arg(clue->coord().first).arg(clue->coord().second);
+        }
+    }
+    foreach(LetterCell * letter, krossWord->letters()) {
+        if (!letter->clueHorizontal() && !letter->clueVertical()) {
+            problems << QString("letter at %1,%2 has no clue")
+                     .arg(letter->coord().first).arg(letter->coord().second);
+        } else if (!letter->correctLetter().isSpace()
+                   && !typeInfo.isCharacterLegal(letter->correctLetter())) {
+            problems << QString("illegal letter '%1' at %2,%3")
+                     .arg(letter->correctLetter())
+                     .arg(letter->coord().first).arg(letter->coord().second);
+        }
+    }
+
+    if (problems.count() > MAX_LISTED_PROBLEMS) {
+        const int moreCount = problems.count() - MAX_LISTED_PROBLEMS;
+        problems = problems.mid(0, MAX_LISTED_PROBLEMS);
+        problems << QString("%1 more problems").arg(moreCount);
+    }
+    return problems;
+}
+
+QString BatchProcessor::statisticsString(KrossWord* krossWord) const
+{
+    const KrossWord::Statistics stats = krossWord->statistics();
+    return QString("cells=%1 emptyCells=%2 letters=%3 filledLetters=%4 "
+                   "crossedLetters=%5 uncrossedLetters=%6 clues=%7 "
+                   "horizontalClues=%8 verticalClues=%9 minAnswerLength=%10 "
+                   "maxAnswerLength=%11 avgAnswerLength=%12")
+           .arg(stats.cellCount).arg(stats.emptyCellCount)
+           .arg(stats.letterCellCount).arg(stats.filledLetterCells)
+           .arg(stats.crossedLetterCells)
+           .arg(stats.uncrossedLetterCells).arg(stats.clueCount)
+           .arg(stats.horizontalClues).arg(stats.verticalClues)
+           .arg(stats.minAnswerLength).arg(stats.maxAnswerLength)
+           .arg(stats.avgAnswerLength, 0, 'f', 2);
+}
@@ -0,0 +1,115 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef BATCHPROCESSOR_H
+#define BATCHPROCESSOR_H
+
+#include "krossword.h"
+
+#include <QStringList>
+
+/** Converts and checks crossword files without a main window, used by the
+* command line options of krossword (eg. "krossword --validate --check
+* <directory>").
+*
+* Files get processed one after another in the GUI thread, each with a
+* KrossWord of it's own, because KrossWord is a QGraphicsObject that can't
+* be created in other threads. One line gets written to stdout for each file, with
+* the file name, "OK" or "FAILED" and the results of the operations, separated
+* by tabs. */
+class BatchProcessor
+{
+public:
+    enum Operation {
+        NoOperation = 0x00,
+
+        Convert = 0x01, /**< Write the crossword in @ref targetFormat(). */
+        Validate = 0x02, /**< Check the structure of the crossword. */
+        VerifyChecksums = 0x04, /**< Verify the checksums of .puz files. */
+        CheckSolution = 0x08, /**< Check if the current letters are correct, see KrossWord::check(). */
+        DumpStatistics = 0x10 /**< Write KrossWord::statistics(). */
+    };
+    Q_DECLARE_FLAGS(Operations, Operation)
+
+    struct Result {
+        QString fileName;
+        bool ok;
+        QStringList messages;
+
+        Result(const QString &fileName = QString()) {
+            this->fileName = fileName;
+            this->ok = true;
+        };
+    };
+
+    BatchProcessor(Operations operations);
+
+    Operations operations() const {
+        return m_operations;
+    };
+
+    KrossWord::FileFormat targetFormat() const {
+        return m_targetFormat;
+    };
+    /** Sets the format to convert to, needed for the Convert operation. */
+    void setTargetFormat(KrossWord::FileFormat targetFormat) {
+        m_targetFormat = targetFormat;
+    };
+
+    QString outputDirectory() const {
+        return m_outputDirectory;
+    };
+    /** Converted files get written to @p outputDirectory. If it is empty,
+    * they get written next to the source files. */
+    void setOutputDirectory(const QString &outputDirectory) {
+        m_outputDirectory = outputDirectory;
+    };
+
+    /** Gets the file format for the file extension @p extension, eg. "kwpz".
+    * @returns KrossWord::DetermineByFileName, if @p extension is unknown. */
+    static KrossWord::FileFormat fileFormatFromExtension(const QString &extension);
+
+    /** Gets all crossword files in @p paths. Directories are searched
+    * recursively. */
+    static QStringList crosswordFiles(const QStringList &paths);
+
+    /** Processes all crossword files in @p paths and waits until all files
+    * are processed.
+    * @returns The number of files that failed. */
+    int process(const QStringList &paths);
+
+    /** Processes a single file. */
+    Result processFile(const QString &fileName) const;
+
+    /** Writes @p result to stdout. */
+    void fileProcessed(const Result &result);
+
+private:
+    QString outputFileName(const QString &fileName) const;
+    QStringList validate(KrossWord *krossWord) const;
+    QString statisticsString(KrossWord *krossWord) const;
+
+    Operations m_operations;
+    KrossWord::FileFormat m_targetFormat;
+    QString m_outputDirectory;
+    int m_failedCount;
+};
+Q_DECLARE_OPERATORS_FOR_FLAGS(BatchProcessor::Operations)
+
+#endif // BATCHPROCESSOR_H
@@ -236,6 +236,7 @@ ClueCell::ClueCell(KrossWord* krossWord, Coord coord,
     m_clue = clue;
     wrapClueText();
     m_clueNumber = -1;
+    m_candidateCount = -1;
     m_correctAnswer = answer.toUpper();
     m_textLayoutRect.setRect(0, 0, 0, 0);
     m_transitionHeightFactor = 1;
@@ -269,6 +270,18 @@ void ClueCell::drawBackground(QPainter *p, const QStyleOptionGraphicsItem *optio
         KrosswordRenderer::self()->renderElement(p, "question_cell_highlight", option->rect);
     else
         KrosswordRenderer::self()->renderElement(p, "question_cell", option->rect);
+
+    drawCandidateCountTint(p, option->rect, m_candidateCount);
+}
+
+void ClueCell::drawCandidateCountTint(QPainter *p, const QRect &rect, int candidateCount)
+{
+    if (candidateCount < 0)
+        return;
+
+    // Red for answers without any fitting word, orange for only a few
+    p->fillRect(rect, candidateCount == 0
+                ? QColor(255, 0, 0, 70) : QColor(255, 165, 0, 70));
 }
 
 void ClueCell::drawBackgroundForPrinting(QPainter *p, const QStyleOptionGraphicsItem *option)
@@ -438,6 +451,7 @@ void ClueCell::setProperties(Qt::Orientation newOrientation, AnswerOffset newAns
 
     if (newOrientation != m_orientation) {
         m_orientation = newOrientation;
+        krossWord()->clueOrientationChanged(this);
 
         changed = true;
         emit orientationChanged(this, newOrientation);
@@ -758,6 +772,7 @@ int ClueCell::addLetters(int count)
     } // while
 
     if (actualCount != 0) {
+        krossWord()->clueAnswerLengthChanged(this, m_correctAnswer.length() - actualCount);
         emit answerLengthChanged(this, m_correctAnswer.length());
 
         // Update rendering of end bars
@@ -1276,9 +1291,31 @@ void ClueCell::setCorrectAnswer(const QString& correctAnswer)
     emit correctAnswerChanged(this, m_correctAnswer);
 }
 
+void ClueCell::setCandidateCount(int candidateCount)
+{
+    if (m_candidateCount == candidateCount)
+        return;
+
+    m_candidateCount = candidateCount;
+    clearCache(Animator::Instant);
+    update();
+
+    // Letter cells get tinted depending on the candidate counts of their clues
+    LetterCellList list = letters();
+    foreach(LetterCell * cell, list) {
+        cell->clearCache(Animator::Instant);
+        cell->update();
+    }
+}
+
 void ClueCell::setClueNumber(int clueNumber)
 {
+    if (m_clueNumber == clueNumber)
+        return;
+
+    const int previousClueNumber = m_clueNumber;
     m_clueNumber = clueNumber;
+    krossWord()->clueNumberChanged(this, previousClueNumber);
     if (answerOffset() == OnClueCell)
         firstLetter()->clearCache();
 }
@@ -218,6 +218,14 @@ public:
     /** Sets the correct answer to this clue cell. */
     void setCorrectAnswer(const QString &correctAnswer);
 
+    /** The number of dictionary words that fit into the answer, if it's
+    * small enough for the answer cells to get flagged, otherwise -1.
+    * Set by @ref DeadSlotChecker while editing. */
+    int candidateCount() const {
+        return m_candidateCount;
+    };
+    void setCandidateCount(int candidateCount);
+
     qreal transitionHeightFactor() const {
         return m_transitionHeightFactor;
     };
@@ -252,6 +260,9 @@ protected:
     virtual void drawBackground(QPainter* p, const QStyleOptionGraphicsItem* option);
     virtual void drawForeground(QPainter *p, const QStyleOptionGraphicsItem* option);
     virtual void drawClueNumber(QPainter *p, const QStyleOptionGraphicsItem *option);
+    /** Tints @p rect, if @p candidateCount is not -1. Also used by letter cells.
+    * @see candidateCount() */
+    static void drawCandidateCountTint(QPainter *p, const QRect &rect, int candidateCount);
 
     virtual void drawBackgroundForPrinting(QPainter* , const QStyleOptionGraphicsItem*);
     virtual void drawForegroundForPrinting(QPainter* , const QStyleOptionGraphicsItem*);
@@ -279,6 +290,7 @@ private:
     AnswerOffset m_answerOffset;
     QString m_clue, m_wrappedClue, m_correctAnswer;
     int m_clueNumber;
+    int m_candidateCount;
 
     QTextLayout m_textLayout;
     QRect m_textLayoutRect;
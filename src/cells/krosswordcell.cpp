@@ -174,38 +174,40 @@ void KrossWordCell::synchronizeWith(KrossWordCell* cell,
                                     SyncCategory syncCategory)
 {
     Q_ASSERT(cell);
-    if (cell == this) {
+    if (cell == this || syncMethods == SyncNothing) {
         return; // Don't sync cell to itself
     }
 
-    bool syncContent = syncMethods.testFlag(SyncContent);
-    bool syncSelection = syncMethods.testFlag(SyncSelection);
-    bool contentSynced = isSynchronizedWith(cell, SyncContent);
-    bool selectionSynced = isSynchronizedWith(cell, SyncSelection);
-    if ((contentSynced || !syncContent) && (selectionSynced || !syncSelection)) {
+    SyncGroup *group = m_syncGroups.value(syncCategory);
+    SyncGroup *otherGroup = cell->m_syncGroups.value(syncCategory);
+    if (!group && otherGroup) {
+        cell->synchronizeWith(this, syncMethods, syncCategory);
         return;
     }
 
 //     qDebug() << "Synchronize" << coord() << "with" << cell->coord()
 //  << "syncMethods =" << syncMethods << "syncCategory =" << syncCategory;
-    if (syncContent && !contentSynced) {
-        connect(cell, SIGNAL(currentLetterChanged(LetterCell*, QChar)), this, SLOT(setCurrentLetterSlot(LetterCell*, QChar)));
-        connect(this, SIGNAL(currentLetterChanged(LetterCell*, QChar)), cell, SLOT(setCurrentLetterSlot(LetterCell*, QChar)));
+    if (!group) {
+        group = new SyncGroup;
+        m_syncGroups.insert(syncCategory, group);
     }
 
-    if (syncSelection && !selectionSynced) {
-        connect(cell, SIGNAL(gotFocus(KrossWordCell*)), this, SLOT(setFocusSlot(KrossWordCell*)));
-        connect(this, SIGNAL(gotFocus(KrossWordCell*)), cell, SLOT(setFocusSlot(KrossWordCell*)));
+    if (!otherGroup) {
+        cell->m_syncGroups.insert(syncCategory, group);
+    } else if (otherGroup != group) {
+        // Move the cells of the smaller group into the bigger group
+        if (otherGroup->count() > group->count()) {
+            qSwap(group, otherGroup);
+        }
+        foreach(KrossWordCell * otherCell, otherGroup->m_cells.keys()) {
+            otherCell->m_syncGroups[ syncCategory ] = group;
+        }
+        group->m_cells.unite(otherGroup->m_cells);
+        delete otherGroup;
     }
 
-    if (m_synchronizedCells[syncCategory].contains(cell)) {
-        Q_ASSERT(cell->m_synchronizedCells[syncCategory].contains(this));
-        cell->m_synchronizedCells[syncCategory][this] |= syncMethods;
-        this->m_synchronizedCells[syncCategory][cell] |= syncMethods;
-    } else {
-        cell->m_synchronizedCells[syncCategory].insert(this, syncMethods);
-        this->m_synchronizedCells[syncCategory].insert(cell, syncMethods);
-    }
+    group->m_cells[ this ] |= syncMethods;
+    group->m_cells[ cell ] |= syncMethods;
 }
 
 bool KrossWordCell::isSynchronizedWith(KrossWordCell* cell,
@@ -213,8 +215,9 @@ bool KrossWordCell::isSynchronizedWith(KrossWordCell* cell,
                                        SyncMethods syncMethods)
 {
     // Return true, if at least one of syncMethods is synced in syncCategory
-    return m_synchronizedCells.value(syncCategory).contains(cell)
-           && (m_synchronizedCells.value(syncCategory).value(cell) & syncMethods) != 0;
+    SyncGroup *group = m_syncGroups.value(syncCategory);
+    return group && group == cell->m_syncGroups.value(syncCategory)
+           && (group->syncMethods(this) & group->syncMethods(cell) & syncMethods) != 0;
 }
 
 bool KrossWordCell::isSynchronizedWith(KrossWordCell* cell,
@@ -246,45 +249,83 @@ bool KrossWordCell::removeSynchronizationWith(KrossWordCell* cell,
     Q_ASSERT(cell->isSynchronizedWith(this));
 
     QList< SyncCategory > cats = allSynchronizationCategories();
-    bool stillSyncedContent = false, stillSyncedSelection = false;
     foreach(const SyncCategory & cat, cats) {
-        if (syncCategories.testFlag(cat)) {
-            cell->m_synchronizedCells[ cat ][this] &= ~syncMethods;
-            this->m_synchronizedCells[ cat ][cell] &= ~syncMethods;
-
-            if (this->m_synchronizedCells[ cat ][cell] == SyncNothing) {
-                cell->m_synchronizedCells[ cat ].remove(this);
-                this->m_synchronizedCells[ cat ].remove(cell);
-            }
-        } else if (!stillSyncedContent && m_synchronizedCells[cat].contains(cell)
-                   && m_synchronizedCells[cat][cell].testFlag(SyncContent)) {
-            stillSyncedContent = true;
-        } else if (!stillSyncedSelection && m_synchronizedCells[cat].contains(cell)
-                   && m_synchronizedCells[cat][cell].testFlag(SyncSelection)) {
-            stillSyncedSelection = true;
+        if (syncCategories.testFlag(cat) && isSynchronizedWith(cell, cat)) {
+            removeSynchronizationMethods(cat, syncMethods);
         }
     }
 
-    if (!stillSyncedContent && syncMethods.testFlag(SyncContent)
-            && isLetterCell() && cell->isLetterCell()) {
-        disconnect(cell, SIGNAL(currentLetterChanged(LetterCell*, QChar)), this, SLOT(setCurrentLetterSlot(LetterCell*, QChar)));
-        disconnect(this, SIGNAL(currentLetterChanged(LetterCell*, QChar)), cell, SLOT(setCurrentLetterSlot(LetterCell*, QChar)));
+    return true;
+}
+
+void KrossWordCell::removeSynchronizationMethods(SyncCategory syncCategory,
+        SyncMethods syncMethods)
+{
+    SyncGroup *group = m_syncGroups.value(syncCategory);
+    if (!group) {
+        return;
     }
 
-    if (!stillSyncedSelection && syncMethods.testFlag(SyncSelection)) {
-        disconnect(cell, SIGNAL(gotFocus(KrossWordCell*)), this, SLOT(setFocusSlot(KrossWordCell*)));
-        disconnect(this, SIGNAL(gotFocus(KrossWordCell*)), cell, SLOT(setFocusSlot(KrossWordCell*)));
+    // Only this cell loses the methods, the other cells stay synchronized
+    const SyncMethods remainingMethods = group->m_cells.value(this) & ~syncMethods;
+    if (remainingMethods != SyncNothing) {
+        group->m_cells[ this ] = remainingMethods;
+        return;
     }
 
-    return true;
+    group->m_cells.remove(this);
+    m_syncGroups.remove(syncCategory);
+    if (group->count() < 2) {
+        // Don't keep groups with only one cell
+        foreach(KrossWordCell * cell, group->m_cells.keys()) {
+            cell->m_syncGroups.remove(syncCategory);
+        }
+        delete group;
+    }
+}
+
+void KrossWordCell::broadcastSynchronization(SyncMethod syncMethod)
+{
+    foreach(SyncGroup * group, m_syncGroups) {
+        if (group->m_broadcasting || !group->syncMethods(this).testFlag(syncMethod)) {
+            continue;
+        }
+
+        // Changes of the other cells don't get broadcasted again to this group
+        group->m_broadcasting = true;
+        const QHash< KrossWordCell*, SyncMethods > cells = group->m_cells;
+        for (QHash< KrossWordCell*, SyncMethods >::const_iterator it = cells.constBegin();
+                it != cells.constEnd(); ++it) {
+            KrossWordCell *cell = it.key();
+            if (cell == this || !it.value().testFlag(syncMethod)) {
+                continue;
+            }
+
+            if (syncMethod == SyncContent) {
+                cell->synchronizeContentFrom(this);
+            } else if (syncMethod == SyncSelection) {
+                cell->setFocus();
+            }
+        }
+        group->m_broadcasting = false;
+    }
 }
 
 QString KrossWordCell::syncInfoString() const
 {
+    // Number of other cells synchronized with this cell in each category
+    QList< int > counts;
+    QList< SyncCategory > cats = QList< SyncCategory >()
+                                 << SolutionLetterSynchronization
+                                 << SameCharacterLetterSynchronization
+                                 << OtherSynchronization;
+    foreach(const SyncCategory & cat, cats) {
+        SyncGroup *group = m_syncGroups.value(cat);
+        counts << (group ? group->count() - 1 : 0);
+    }
+
     QString info = QString("%1,%2,%3")
-                   .arg(m_synchronizedCells[SolutionLetterSynchronization].count())
-                   .arg(m_synchronizedCells[SameCharacterLetterSynchronization].count())
-                   .arg(m_synchronizedCells[OtherSynchronization].count());
+                   .arg(counts[0]).arg(counts[1]).arg(counts[2]);
 
     return info;
 }
@@ -294,24 +335,12 @@ void KrossWordCell::removeSynchronization(SyncMethods syncMethods,
 {
     QList< SyncCategory > cats = allSynchronizationCategories();
     foreach(const SyncCategory & cat, cats) {
-        if (!syncCategories.testFlag(cat)) {
-            continue;
-        }
-
-        for (int i = m_synchronizedCells[cat].count() - 1; i >= 0; --i) {
-            KrossWordCell *cell = m_synchronizedCells[cat].keys()[ i ];
-            removeSynchronizationWith(cell, syncMethods, cat);
+        if (syncCategories.testFlag(cat)) {
+            removeSynchronizationMethods(cat, syncMethods);
         }
     }
 }
 
-void KrossWordCell::setFocusSlot(KrossWordCell* cell)
-{
-    Q_UNUSED(cell);   // TODO: remove cell parameter?
-
-    setFocus(); // TEST
-}
-
 void KrossWordCell::deleteAndRemoveFromSceneLater()
 {
     if (scene()) {
@@ -374,6 +403,7 @@ void KrossWordCell::focusInEvent(QFocusEvent* event)
 
     krossWord()->setCurrentCell(this);
     emit gotFocus(this);   // Used for focus synchronization with letter cells in a separate solution word KrossWord.
+    broadcastSynchronization(SyncSelection);
 
     clearCache();
 
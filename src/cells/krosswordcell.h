@@ -23,6 +23,7 @@
 #include <QGraphicsObject>
 #include <QGraphicsEffect>
 #include <QString>
+#include <QHash>
 #include <QDebug>
 
 #include "global.h"
@@ -54,6 +55,37 @@ protected:
     virtual void draw(QPainter* painter);
 };
 
+/** A group of cells, that are synchronized with each other in one
+  * SyncCategory. Each cell is in at most one group per category, groups get
+  * merged when cells of different groups are synchronized. Each cell has it's
+  * own synchronized methods, two cells are synchronized by the methods they
+  * both have. A change of one cell is broadcasted once to all other cells of
+  * it's groups.
+  * @see KrossWordCell::synchronizeWith() */
+class SyncGroup
+{
+    friend class KrossWordCell;
+
+public:
+    SyncGroup() : m_broadcasting(false) {}
+
+    /** The synchronized methods of @p cell in this group. */
+    SyncMethods syncMethods(KrossWordCell *cell) const {
+        return m_cells.value(cell);
+    }
+    /** All cells in this group. */
+    QList< KrossWordCell* > cells() const {
+        return m_cells.keys();
+    }
+    int count() const {
+        return m_cells.count();
+    }
+
+private:
+    QHash< KrossWordCell*, SyncMethods > m_cells;
+    bool m_broadcasting; // To not broadcast again to this group while broadcasting
+};
+
 /** Base class for all crossword cells.
   * @see EmptyCell
   * @see LetterCell
@@ -119,9 +151,10 @@ public:
                << SameCharacterLetterSynchronization;
     }
 
-    const QHash< SyncCategory, QHash< KrossWordCell*, SyncMethods > >&
-    synchronizationByCategory() const {
-        return m_synchronizedCells;
+    /** Returns the group of cells synchronized with this cell in
+    * @p syncCategory or NULL, if this cell isn't synchronized in that category. */
+    SyncGroup *synchronizationGroup(SyncCategory syncCategory) const {
+        return m_syncGroups.value(syncCategory);
     }
 
     QString syncInfoString() const;
@@ -145,12 +178,18 @@ public:
     bool isSynchronizedWith(KrossWordCell *cell, SyncCategory syncCategory,
                             SyncMethods syncMethods = SyncAll);
 
+    /** Synchronizes this cell with @p cell by merging their groups in
+    * @p syncCategory. The synchronization is transitive, ie. all cells of both
+    * groups get synchronized with each other by @p syncMethods. */
     void synchronizeWith(KrossWordCell *cell,
                          SyncMethods syncMethods = SyncAll,
                          SyncCategory syncCategory = OtherSynchronization);
     void synchronizeWith(const KrossWordCellList &cellList,
                          SyncMethods syncMethods = SyncAll,
                          SyncCategory syncCategory = OtherSynchronization);
+    /** Removes @p syncMethods from the entry of this cell in the groups, that
+    * it shares with @p cell in @p syncCategories. The other cells of the groups
+    * keep their methods. If no methods remain, this cell leaves the group. */
     bool removeSynchronizationWith(KrossWordCell *cell,
                                    SyncMethods syncMethods = SyncAll,
                                    SyncCategories syncCategories = AllSyncCategories);
@@ -176,7 +215,6 @@ signals:
     void appearanceAboutToChange();
 
 public slots:
-    void setFocusSlot(KrossWordCell *cell);
     void deleteAndRemoveFromSceneLater();
 
 public slots:
@@ -192,6 +230,14 @@ protected slots:
 
 protected:
     virtual bool setPositionFromCoordinates(bool animate = true);
+    /** Broadcasts a change of @p syncMethod to all cells of the groups of this
+    * cell, that synchronize @p syncMethod. */
+    void broadcastSynchronization(SyncMethod syncMethod);
+    /** Called for all synchronized cells, when the content of @p cell has
+    * changed. */
+    virtual void synchronizeContentFrom(KrossWordCell *cell) {
+        Q_UNUSED(cell);
+    }
     void setCoord(Coord coord, bool updateInCrosswordGrid = true);
 
     // Overloaded methods
@@ -213,8 +259,10 @@ protected:
     bool m_blockCacheClearing;
 
 private:
+    void removeSynchronizationMethods(SyncCategory syncCategory, SyncMethods syncMethods);
+
     Coord m_coord;
-    QHash< SyncCategory, QHash< KrossWordCell*, SyncMethods > > m_synchronizedCells;
+    QHash< SyncCategory, SyncGroup* > m_syncGroups;
     CellType m_cellType;
     bool m_highlight;
     QPixmap *m_cache;
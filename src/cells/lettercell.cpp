@@ -639,8 +639,10 @@ void LetterCell::setCurrentLetter(const QChar& currentLetter,
     if (m_currentLetter == newCurrentLetter)
         return;
 
+    const QChar previousLetter = m_currentLetter;
     m_currentLetter = newCurrentLetter;
     m_confidence = confidence;
+    krossWord()->letterCurrentLetterChanged(this, previousLetter);
 
     if (krossWord()->isAnimationEnabled()) {
         if (m_changeAnim) {
@@ -670,12 +672,13 @@ void LetterCell::setCurrentLetter(const QChar& currentLetter,
     }
 
     emit currentLetterChanged(this, m_currentLetter);
+    broadcastSynchronization(SyncContent);
 }
 
-void LetterCell::setCurrentLetterSlot(LetterCell* letter, const QChar& newLetter)
+void LetterCell::synchronizeContentFrom(KrossWordCell* cell)
 {
-    Q_UNUSED(letter);
-    setCurrentLetter(newLetter);
+    if (cell->isLetterCell())
+        setCurrentLetter(((LetterCell*)cell)->currentLetter());
 }
 
 ClueCell* LetterCell::getOrthogonalClueTo(ClueCell* question) const
@@ -734,6 +737,16 @@ void LetterCell::drawBackground(QPainter* p, const QStyleOptionGraphicsItem* opt
     } else {
         KrosswordRenderer::self()->renderElement(p, "letter_cell", option->rect);
     }
+
+    // Flag answers with no or only a few fitting dictionary words,
+    // using the lower count of both clues
+    int candidateCount = -1;
+    foreach(ClueCell * clue, clues()) {
+        if (clue->candidateCount() != -1
+                && (candidateCount == -1 || clue->candidateCount() < candidateCount))
+            candidateCount = clue->candidateCount();
+    }
+    ClueCell::drawCandidateCountTint(p, option->rect, candidateCount);
 }
 
 void LetterCell::drawBackgroundForPrinting(QPainter* p, const QStyleOptionGraphicsItem* option)
@@ -1025,6 +1038,7 @@ void LetterCell::orientationChanged(ClueCell* clueCell,
         m_clueVertical = NULL;
         m_clueHorizontal = clueCell;
     }
+    krossWord()->updateRunLengthsAt(coord());
 }
 
 void LetterCell::correctAnswerChanged(ClueCell* clue,
@@ -1033,7 +1047,10 @@ void LetterCell::correctAnswerChanged(ClueCell* clue,
     Q_UNUSED(clue);
     Q_UNUSED(correctAnswer);
 
+    const QChar previousLetter = m_correctLetter;
     m_correctLetter = correctLetterFromClue();
+    if (m_correctLetter != previousLetter)
+        krossWord()->letterCorrectLetterChanged(this, previousLetter);
     clearCache();
     update();
 }
@@ -1050,7 +1067,10 @@ void LetterCell::setClueHorizontal(ClueCell* clue)
         m_clueHorizontal->letterRemoved(this);
     }
 
+    const bool wasCrossed = isCrossed();
     m_clueHorizontal = clue;
+    krossWord()->letterCluesChanged(this, wasCrossed);
+    krossWord()->updateRunLengthsAt(coord());
 
     if (clue) {
         connect(this, SIGNAL(currentLetterChanged(LetterCell*, const QChar&)),
@@ -1075,7 +1095,10 @@ void LetterCell::setClueVertical(ClueCell* clue)
         m_clueVertical->letterRemoved(this);
     }
 
+    const bool wasCrossed = isCrossed();
     m_clueVertical = clue;
+    krossWord()->letterCluesChanged(this, wasCrossed);
+    krossWord()->updateRunLengthsAt(coord());
 
     if (clue) {
         connect(this, SIGNAL(currentLetterChanged(LetterCell*, const QChar&)),
@@ -155,10 +155,6 @@ signals:
     /** Emitted when the current letter of this letter cell has changed. */
     void currentLetterChanged(LetterCell *letter, const QChar &currentLetter);
 
-public slots:
-    /** Sets the current letter to @p newLetter. */
-    void setCurrentLetterSlot(LetterCell *letter, const QChar &newLetter);
-
 protected slots:
     void orientationChanged(ClueCell *clue, Qt::Orientation orientation);
     void correctAnswerChanged(ClueCell *clue, const QString &correctAnswer);
@@ -178,6 +174,8 @@ protected:
     virtual void keyPressEvent(QKeyEvent* event);
     virtual void focusInEvent(QFocusEvent* event);
     virtual void focusOutEvent(QFocusEvent* event);
+    /** Sets the current letter to the one of the synchronized letter @p cell. */
+    virtual void synchronizeContentFrom(KrossWordCell *cell);
 
     /** Gets the clue of this letter cell that is orthogonal to the given
     * @p clue, or NULL if this letter cell has no other clue.
@@ -81,6 +81,7 @@ void ClueModel::clear()
 {
     m_itemHorizontal->removeRows(0, m_itemHorizontal->rowCount());
     m_itemVertical->removeRows(0, m_itemVertical->rowCount());
+    m_clueItems.clear();
 }
 
 void ClueModel::addClue(ClueCell* clueCell)
@@ -92,6 +93,7 @@ void ClueModel::addClue(ClueCell* clueCell)
             this, SLOT(changeClueTextRequested(ClueCell*, QString)));
 
     item->appendRow(QList<QStandardItem*>() << clueItem);
+    m_clueItems.insert(clueCell, clueItem);
 
     connect(clueCell, SIGNAL(orientationChanged(ClueCell*, Qt::Orientation)),
             this, SLOT(updateClueOrientation(ClueCell*, Qt::Orientation)));
@@ -109,6 +111,7 @@ void ClueModel::updateClueOrientation(ClueCell* clue, Qt::Orientation newOrienta
             || (item->parent() == m_itemVertical && clue->isVertical()))
         return;
 
+    m_clueItems.remove(clue);
     removeRow(item->row(), item->parent()->index());
     addClue(clue);
 }
@@ -127,32 +130,16 @@ void ClueModel::removeClue(ClueCell* clueCell)
     if (!clue)
         return;
 
+    m_clueItems.remove(clueCell);
     removeRow(clue->row(), clue->parent()->index());
 }
 
 ClueItem* ClueModel::clueItem(ClueCell* clueCell) const
 {
-    QStandardItem *item = clueCell->isHorizontal()
-                          ? m_itemHorizontal : m_itemVertical;
-
-    for (int row = 0; row < item->rowCount(); ++row) {
-        ClueItem *curClueItem = static_cast< ClueItem* >(item->child(row));
-        if (curClueItem->clueCell() == clueCell)
-            return curClueItem;
-    }
-
-    // Not found in list of the clues current orientation, now search the list
-    // of clues in the other direction
-    QStandardItem *otherItem = clueCell->isHorizontal()
-                               ? m_itemVertical : m_itemHorizontal;
-    for (int row = 0; row < otherItem->rowCount(); ++row) {
-        ClueItem *curClueItem = static_cast< ClueItem* >(otherItem->child(row));
-        if (curClueItem->clueCell() == clueCell)
-            return curClueItem;
-    }
-
-    qDebug() << "Clue not found in model" << clueCell;
-    return NULL; // Item for clueCell not found
+    ClueItem *item = m_clueItems.value(clueCell);
+    if (!item)
+        qDebug() << "Clue not found in model" << clueCell;
+    return item;
 }
 
 ClueItem* ClueModel::clueItemFromIndex(const QModelIndex& index) const
@@ -21,6 +21,7 @@
 #define CLUEMODEL_H
 
 #include <QStandardItemModel>
+#include <QHash>
 
 namespace Crossword
 {
@@ -66,6 +67,7 @@ public:
         return m_itemVertical;
     };
 
+    /** Gets the item for @p clueCell from a hash of all clue items. */
     ClueItem *clueItem(ClueCell *clueCell) const;
     ClueItem *clueItemFromIndex(const QModelIndex &index) const;
 
@@ -87,6 +89,7 @@ protected slots:
 private:
     QStandardItem *m_itemHorizontal;
     QStandardItem *m_itemVertical;
+    QHash<ClueCell*, ClueItem*> m_clueItems;
 };
 
 #endif // CLUEMODEL_H
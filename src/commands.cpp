@@ -19,10 +19,17 @@
 
 #include "commands.h"
 #include "krossword.h"
+#include "animator.h"
 #include "cells/imagecell.h"
 
+#include <QDir>
+#include <QSet>
+#include <QTemporaryFile>
+
 UndoStackExt::UndoStackExt(QObject* parent)
-    : QUndoStack(parent)
+    : QUndoStack(parent), m_krossWord(0), m_mergeBarrierIndex(-1),
+      m_memoryLimit(0), m_spillFile(0),
+      m_cachedSegment(-1), m_segmentsDataCached(true)
 {
     m_executingRedo = true;
 //   m_lastCommand = NULL;
@@ -37,70 +44,50 @@ UndoStackExt::UndoStackExt(QObject* parent)
             this, SLOT(indexChanged(int)));
 }
 
+UndoStackExt::~UndoStackExt()
+{
+    delete m_spillFile;
+}
+
+QByteArray UndoStackExt::recordData(const UndoCommandExt* command)
+{
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream << static_cast<qint8>(command->type());
+    command->appendToData(&stream);
+    stream.device()->close();
+    return record;
+}
+
 bool UndoStackExt::tryPush(UndoCommandExt* command,
                            QString *errorMessage)
 {
     if (command->checkRedo(errorMessage)) {
         command->setUndoStack(this);
 
-//     qDebug() << command->type();
-//     m_data.open( QIODevice::Append );
-        if (index() < m_dataIndexPos.count()) {
-            QDataStream stream(&m_data, QIODevice::WriteOnly);
-
-//       qDebug() << "UndoStackExt::tryPush() | seeked to"
-//         << m_dataIndexPos[index()] << "for type" << command->type();
-//       qDebug() << "TEST TYPE" << static_cast<qint8>( command->type() );
-
-//       UndoCommandExt *mergedCommand = NULL;
-//       if ( command->id() != -1 && m_lastCommand
-//      && command->id() == m_lastCommand->id()
-//      && index() - 1 >= 0
-//      && (mergedCommand = m_lastCommand->mergedWith(command)) ) {
-//  stream.device()->seek( m_dataIndexPos[index() - 1] );
-//  stream << static_cast<qint8>( mergedCommand->type() );
-//  mergedCommand->appendToData( &stream );
-//
-//  if ( m_deleteLastCommand )
-//    delete m_lastCommand;
-//  m_lastCommand = mergedCommand;
-//       } else {
-            stream.device()->seek(m_dataIndexPos[index()]);
-            stream << static_cast<qint8>(command->type());
-            command->appendToData(&stream);
-
-//  if ( m_deleteLastCommand )
-//    delete m_lastCommand;
-//  m_lastCommand = command;
-//       }
-            stream.device()->close();
-        } else {
-            qDebug() << "Wrong index" << index() << "size =" << m_dataIndexPos.size()
-                     << "Clearing stored undo stack";
-//       QDataStream stream( &m_data, QIODevice::Append );
-//       stream << static_cast<qint8>( command->type() );
-//       command->appendToData( &stream );
-//       stream.device()->close();
-            m_dataIndexPos.clear();
-            m_dataIndexPos << sizeof(qint16);
-
-            QDataStream stream(&m_data, QIODevice::WriteOnly);
-            m_storedStartIndex = index();
-            stream << (qint16)0; // Write initial index
-
-            stream << static_cast<qint8>(command->type());
-            command->appendToData(&stream);
-            stream.device()->close();
-        }
-
-        m_dataIndexPos = m_dataIndexPos.mid(0, index() + 1 - m_storedStartIndex);
-        m_dataIndexPos << m_data.size();
-//     qDebug() << " new data ending at:" << m_data.size()
-//       << "| data:" << m_data.toBase64();
-//     m_data << (QString::number(command->type()) + "|" + command->data());
-
+        // Check if push() will merge the command into the previous one, using
+        // the same conditions as QUndoStack::push(). canMergeWith() also
+        // checks the merge barrier. The merged command then replaces the data
+        // of the previous command.
+        UndoCommandExt *previous = index() > 0
+                                   ? (UndoCommandExt*)this->command(index() - 1) : NULL;
+        const bool merge = previous && command->id() != -1
+                           && previous->id() == command->id()
+                           && index() != cleanIndex()
+                           && previous->canMergeWith(command);
+        const int storedIndex = merge ? index() - 1 : index();
+
+        // Listeners get the data of the pushed command only, pushing it again
+        // merges it the same way
 //     qDebug() << "PUSH COMMAND" << command->type();
-        push(command);
+        emit commandPushed(recordData(command));
+        push(new StoredUndoCommand(this, index(), command));
+
+        // Stored after pushing, to include the merged command and data
+        // gathered while executing the command (eg. by GridDiffCommand)
+        storeRecord(storedIndex, recordData(
+                        static_cast<const UndoCommandExt*>(this->command(storedIndex))));
+        limitMemoryUsage();
         return true;
     } else {
         qDebug() << "Error:" << *errorMessage;
@@ -108,6 +95,39 @@ bool UndoStackExt::tryPush(UndoCommandExt* command,
     }
 }
 
+void UndoStackExt::storeRecord(int index, const QByteArray& record)
+{
+    if (index < m_storedStartIndex)
+        restoreSegmentsFrom(index);
+
+    if (index >= m_storedStartIndex
+            && index - m_storedStartIndex < m_dataIndexPos.count()) {
+//       qDebug() << "UndoStackExt::storeRecord() | replacing data from"
+//         << m_dataIndexPos[index - m_storedStartIndex];
+        m_data.truncate(m_dataIndexPos[index - m_storedStartIndex]);
+        m_data.append(record);
+    } else {
+        qDebug() << "Wrong index" << index << "size =" << m_dataIndexPos.size()
+                 << "Clearing stored undo stack";
+        clearSegments();
+        m_dataIndexPos.clear();
+        m_dataIndexPos << sizeof(qint16);
+
+        m_data.clear();
+        QDataStream stream(&m_data, QIODevice::WriteOnly);
+        m_storedStartIndex = index;
+        stream << (qint16)this->index(); // Write current index
+        stream.device()->close();
+        m_data.append(record);
+    }
+
+    // Drop data of commands after the new one, that got deleted by push()
+    m_dataIndexPos = m_dataIndexPos.mid(0, index + 1 - m_storedStartIndex);
+    m_dataIndexPos << m_data.size();
+//     qDebug() << " new data ending at:" << m_data.size()
+//       << "| data:" << m_data.toBase64();
+}
+
 void UndoStackExt::indexChanged(int idx)
 {
     QDataStream stream(&m_data, QIODevice::WriteOnly);
@@ -115,13 +135,249 @@ void UndoStackExt::indexChanged(int idx)
     stream.device()->close();
 }
 
-const QByteArray &UndoStackExt::data() const
+QByteArray UndoStackExt::data() const
 {
-    return m_data;
+    if (m_segments.isEmpty())
+        return m_data;
+
+    QByteArray segmentsData = m_segmentsData;
+    if (!m_segmentsDataCached) {
+        for (int i = 0; i < m_segments.count(); ++i)
+            segmentsData.append(segmentData(i));
+
+        // Keep it for the next automatic save, if it fits into the memory limit
+        if (m_memoryLimit <= 0 || memoryUsage() + segmentsData.size() <= m_memoryLimit) {
+            m_segmentsData = segmentsData;
+            m_segmentsDataCached = true;
+        }
+    }
+
+    QByteArray data = m_data.left(sizeof(qint16));
+    data.append(segmentsData);
+    data.append(m_data.mid(sizeof(qint16)));
+    return data;
+}
+
+QByteArray UndoStackExt::commandData(int index) const
+{
+    if (index >= m_storedStartIndex) {
+        const int i = index - m_storedStartIndex;
+        if (i + 1 >= m_dataIndexPos.count())
+            return QByteArray();
+        return m_data.mid(m_dataIndexPos[i], m_dataIndexPos[i + 1] - m_dataIndexPos[i]);
+    }
+
+    for (int segment = m_segments.count() - 1; segment >= 0; --segment) {
+        const DataSegment &dataSegment = m_segments[segment];
+        if (index < dataSegment.firstIndex)
+            continue;
+
+        const int i = index - dataSegment.firstIndex;
+        return segmentData(segment).mid(dataSegment.recordPos[i],
+                                        dataSegment.recordPos[i + 1] - dataSegment.recordPos[i]);
+    }
+    return QByteArray();
+}
+
+void UndoStackExt::clear()
+{
+    QUndoStack::clear();
+    m_mergeBarrierIndex = -1;
+    clearSegments();
+    m_data.clear();
+    QDataStream stream(&m_data, QIODevice::WriteOnly);
+    m_storedStartIndex = 0;
+    stream << (qint16)0; // Write initial index
+    stream.device()->close();
+    m_dataIndexPos.clear();
+    m_dataIndexPos << sizeof(qint16);
+}
+
+void UndoStackExt::clearSegments()
+{
+    m_segments.clear();
+    m_cachedSegment = -1;
+    m_cachedSegmentData.clear();
+    m_segmentsData.clear();
+    m_segmentsDataCached = true;
+    delete m_spillFile;
+    m_spillFile = NULL;
+}
+
+QByteArray UndoStackExt::segmentData(int segment) const
+{
+    if (m_cachedSegment == segment)
+        return m_cachedSegmentData;
+
+    const DataSegment &dataSegment = m_segments[segment];
+    QByteArray compressedData = dataSegment.compressedData;
+    if (dataSegment.filePos != -1) {
+        if (!m_spillFile->seek(dataSegment.filePos)) {
+            qDebug() << "Couldn't read undo data from" << m_spillFile->fileName();
+            return QByteArray();
+        }
+        compressedData = m_spillFile->read(dataSegment.fileSize);
+    }
+
+    // Segments mostly get read in a row, eg. when undoing many commands
+    m_cachedSegment = segment;
+    m_cachedSegmentData = qUncompress(compressedData);
+    return m_cachedSegmentData;
+}
+
+void UndoStackExt::compressRecords(int count)
+{
+    DataSegment dataSegment;
+    dataSegment.firstIndex = m_storedStartIndex;
+    dataSegment.count = count;
+    for (int i = 0; i <= count; ++i)
+        dataSegment.recordPos << m_dataIndexPos[i] - m_dataIndexPos[0];
+    dataSegment.compressedData = qCompress(
+                                     m_data.mid(m_dataIndexPos[0], m_dataIndexPos[count] - m_dataIndexPos[0]));
+    dataSegment.filePos = -1;
+    dataSegment.fileSize = 0;
+    m_segments << dataSegment;
+
+    const qint64 removedSize = m_dataIndexPos[count] - m_dataIndexPos[0];
+    if (m_segmentsDataCached)
+        m_segmentsData.append(m_data.mid(m_dataIndexPos[0], removedSize));
+    m_data.remove(m_dataIndexPos[0], removedSize);
+    m_dataIndexPos = m_dataIndexPos.mid(count);
+    for (int i = 0; i < m_dataIndexPos.count(); ++i)
+        m_dataIndexPos[i] -= removedSize;
+    m_storedStartIndex += count;
+}
+
+void UndoStackExt::restoreSegmentsFrom(int index)
+{
+    while (!m_segments.isEmpty() && index < m_storedStartIndex) {
+        const int segment = m_segments.count() - 1;
+        const int size = m_segments[segment].recordPos.last();
+        const QByteArray data = m_segmentsDataCached
+                                ? m_segmentsData.right(size) : segmentData(segment);
+        if (m_segmentsDataCached)
+            m_segmentsData.chop(size);
+        const DataSegment dataSegment = m_segments.takeLast();
+        m_cachedSegment = -1;
+        m_cachedSegmentData.clear();
+        if (dataSegment.filePos != -1)
+            m_spillFile->resize(dataSegment.filePos);
+
+        QList<qint64> dataIndexPos;
+        for (int i = 0; i < dataSegment.count; ++i)
+            dataIndexPos << sizeof(qint16) + dataSegment.recordPos[i];
+        foreach(qint64 pos, m_dataIndexPos)
+        dataIndexPos << pos + data.size();
+
+        m_data.insert(sizeof(qint16), data);
+        m_dataIndexPos = dataIndexPos;
+        m_storedStartIndex -= dataSegment.count;
+    }
+}
+
+void UndoStackExt::spillSegments(qint64 maxCompressedSize)
+{
+    qint64 compressedSize = 0;
+    foreach(const DataSegment & dataSegment, m_segments)
+    compressedSize += dataSegment.compressedData.size();
+
+    // Write the oldest segments, they are least likely to be needed again
+    for (int i = 0; i < m_segments.count() && compressedSize > maxCompressedSize; ++i) {
+        DataSegment &dataSegment = m_segments[i];
+        if (dataSegment.filePos != -1)
+            continue;
+
+        if (!m_spillFile) {
+            m_spillFile = new QTemporaryFile(QDir::tempPath() + "/krossword_undo_XXXXXX");
+            if (!m_spillFile->open()) {
+                qDebug() << "Couldn't open a temporary file for the edit history";
+                delete m_spillFile;
+                m_spillFile = NULL;
+                return;
+            }
+        }
+
+        const qint64 filePos = m_spillFile->size();
+        if (!m_spillFile->seek(filePos)
+                || m_spillFile->write(dataSegment.compressedData) != dataSegment.compressedData.size()) {
+            qDebug() << "Couldn't write the edit history to" << m_spillFile->fileName();
+            m_spillFile->resize(filePos);
+            return;
+        }
+
+        compressedSize -= dataSegment.compressedData.size();
+        dataSegment.filePos = filePos;
+        dataSegment.fileSize = dataSegment.compressedData.size();
+        dataSegment.compressedData.clear();
+    }
+}
+
+void UndoStackExt::releaseCommandObjects(int segment)
+{
+    const DataSegment &dataSegment = m_segments[segment];
+    for (int i = dataSegment.firstIndex; i < dataSegment.firstIndex + dataSegment.count; ++i) {
+        // Commands get pushed as StoredUndoCommands by tryPush() and createFromData()
+        StoredUndoCommand *command = dynamic_cast<StoredUndoCommand*>(
+                                         (QUndoCommand*)this->command(i));   // cast away const
+        if (command)
+            command->releaseCommand();
+    }
+}
+
+void UndoStackExt::setMemoryLimit(qint64 memoryLimit)
+{
+    m_memoryLimit = memoryLimit;
+    limitMemoryUsage();
+}
+
+qint64 UndoStackExt::memoryUsage() const
+{
+    qint64 memoryUsage = m_data.size() + m_segmentsData.size();
+    foreach(const DataSegment & dataSegment, m_segments)
+    memoryUsage += dataSegment.compressedData.size();
+    return memoryUsage;
+}
+
+void UndoStackExt::limitMemoryUsage()
+{
+    // Commands without data (see storeRecord()) can't be recreated
+    const int firstStoredIndex = m_segments.isEmpty()
+                                 ? m_storedStartIndex : m_segments.first().firstIndex;
+    if (m_memoryLimit <= 0 || !m_krossWord || firstStoredIndex != 0
+            || m_dataIndexPos.count() - 1 != count() - m_storedStartIndex)
+        return;
+
+    if (m_data.size() > m_memoryLimit / 2) {
+        // Compress the older records until a quarter of the limit is used,
+        // the last command stays as it is to be merged with following ones
+        const int recordCount = m_dataIndexPos.count() - 1;
+        int compressCount = 0;
+        while (compressCount < recordCount - 1
+                && m_data.size() - (m_dataIndexPos[compressCount] - m_dataIndexPos[0])
+                > m_memoryLimit / 4) {
+            ++compressCount;
+        }
+
+        if (compressCount > 0) {
+            compressRecords(compressCount);
+            releaseCommandObjects(m_segments.count() - 1);
+        }
+    }
+
+    if (memoryUsage() > m_memoryLimit && m_segmentsDataCached && !m_segments.isEmpty()) {
+        // Gets decompressed again when needed by data()
+        m_segmentsData.clear();
+        m_segmentsDataCached = false;
+    }
+    if (memoryUsage() > m_memoryLimit)
+        spillSegments(m_memoryLimit / 4);
 }
 
 void UndoStackExt::createFromData(KrossWord *krossWord, const QByteArray& data)
 {
+    m_krossWord = krossWord;
+    clearSegments();
+    m_storedStartIndex = this->index();
     m_data = data;
     QDataStream stream(&m_data, QIODevice::ReadOnly);
     qint16 index;
@@ -131,9 +387,13 @@ void UndoStackExt::createFromData(KrossWord *krossWord, const QByteArray& data)
     m_dataIndexPos << sizeof(qint16);
 
     // TODO Error with : MoveCellsCommand, 2,0; RemoveClueCommand
+    // The commands only get rebuilt, the crossword is already in the stored
+    // state, so they aren't executed (see isExecuting()). Signals are blocked
+    // while rebuilding, otherwise each push would update the stored index and
+    // views of the stack, and get emitted once afterwards.
     UndoCommandExt *cmd;
     m_executingRedo = false;
-    qint16 curIndex = 0;
+    bool wasBlocking = blockSignals(true);
 //   foreach ( QString cmdData, m_data ) {
 //     cmd = UndoCommandExt::fromData( cmdData, krossWord );
     while (!stream.atEnd()) {
@@ -145,21 +405,32 @@ void UndoStackExt::createFromData(KrossWord *krossWord, const QByteArray& data)
 //       qDebug() << "UndoStackExt::createFromData() | new data start pos ="
 //         << stream.device()->pos();
 
-            push(cmd);
-            ++curIndex;
+            setMergeBarrier(); // Stored commands are already merged
+            push(new StoredUndoCommand(this, this->index(), cmd));
         } else {
             qDebug() << "UndoStackExt::createFromData  No undo command created! Stopping now.";
             m_executingRedo = true;
+            blockSignals(wasBlocking);
             clear();
             return;
         }
 //     qDebug() << "END create UndoCommandExt fromData";
     }
 
-    while (curIndex-- > index)
-        undo();
-
+    // Go back to the stored index, only moves the index without executing
+    setIndex(qMin<int>(index, count()));
+    setMergeBarrier(); // Don't merge new commands into stored ones
     m_executingRedo = true;
+    blockSignals(wasBlocking);
+
+    emit indexChanged(this->index());
+    emit cleanChanged(isClean());
+    emit canUndoChanged(canUndo());
+    emit canRedoChanged(canRedo());
+    emit undoTextChanged(undoText());
+    emit redoTextChanged(redoText());
+
+    limitMemoryUsage();
 }
 
 QDebug& operator<<(QDebug debug, UndoCommandExt::Command command)
@@ -207,6 +478,8 @@ QDebug& operator<<(QDebug debug, UndoCommandExt::Command command)
         return debug << "CommandMoveCells";
     case UndoCommandExt::CommandAddLettersToClue:
         return debug << "CommandAddLettersToClue";
+    case UndoCommandExt::CommandLetterEditRun:
+        return debug << "CommandLetterEditRun";
 
     default:
         return debug << "Command unknown!" << static_cast< int >(command);
@@ -266,6 +539,8 @@ UndoCommandExt* UndoCommandExt::fromData(KrossWord* krossWord,
         return MoveCellsCommand::fromData(krossWord, stream, parent);
     case CommandAddLettersToClue:
         return AddLettersToClueCommand::fromData(krossWord, stream, parent);
+    case CommandLetterEditRun:
+        return LetterEditCommand::runFromData(krossWord, stream, parent);
     }
 
     qDebug() << "Undo command type" << command
@@ -291,6 +566,120 @@ void UndoCommandExt::setUndoStack(UndoStackExt* undoStack)
     }
 }
 
+StoredUndoCommand::StoredUndoCommand(UndoStackExt* undoStack, int index,
+                                     UndoCommandExt* command)
+    : UndoCommandExt(), m_command(command), m_index(index),
+      m_type(command->type()), m_id(command->id())
+{
+    m_undoStack = undoStack;
+    m_command->setUndoStack(undoStack);
+    setText(command->text());
+}
+
+StoredUndoCommand::~StoredUndoCommand()
+{
+    delete m_command;
+}
+
+void StoredUndoCommand::releaseCommand()
+{
+    if (!m_command)
+        return;
+
+    m_type = m_command->type();
+    delete m_command;
+    m_command = 0;
+}
+
+const QUndoCommand* StoredUndoCommand::heldCommand(const QUndoCommand* other)
+{
+    const StoredUndoCommand *stored = dynamic_cast<const StoredUndoCommand*>(other);
+    return stored && stored->m_command ? stored->m_command : other;
+}
+
+UndoCommandExt* StoredUndoCommand::createCommand() const
+{
+    QDataStream stream(m_undoStack->commandData(m_index));
+    UndoCommandExt *command = UndoCommandExt::fromData(m_undoStack->krossWord(), &stream);
+    if (command)
+        command->setUndoStack(m_undoStack);
+    else
+        qDebug() << "Couldn't recreate the stored undo command" << m_index << m_type;
+    return command;
+}
+
+bool StoredUndoCommand::canMergeWith(const QUndoCommand* other) const
+{
+    if (m_command)
+        return m_command->canMergeWith(heldCommand(other));
+
+    UndoCommandExt *command = createCommand();
+    const bool canMerge = command && command->canMergeWith(heldCommand(other));
+    delete command;
+    return canMerge;
+}
+
+bool StoredUndoCommand::mergeWith(const QUndoCommand* other)
+{
+    if (m_command) {
+        if (!m_command->mergeWith(heldCommand(other)))
+            return false;
+        setText(m_command->text());
+        return true;
+    }
+
+    // Only the data gets kept, UndoStackExt::tryPush() stores it after merging
+    UndoCommandExt *command = createCommand();
+    const bool merged = command && command->mergeWith(heldCommand(other));
+    if (merged) {
+        m_type = command->type();
+        m_mergedData = UndoStackExt::recordData(command).mid(sizeof(qint8));
+        setText(command->text());
+    }
+    delete command;
+    return merged;
+}
+
+void StoredUndoCommand::redoMaybe()
+{
+    if (m_command) {
+        m_command->redoMaybe();
+        setText(m_command->text()); // Might get set while executing
+        return;
+    }
+
+    UndoCommandExt *command = createCommand();
+    if (command)
+        command->redoMaybe();
+    delete command;
+}
+
+void StoredUndoCommand::undoMaybe()
+{
+    if (m_command) {
+        m_command->undoMaybe();
+        return;
+    }
+
+    UndoCommandExt *command = createCommand();
+    if (command)
+        command->undoMaybe();
+    delete command;
+}
+
+void StoredUndoCommand::appendToData(QDataStream* stream) const
+{
+    if (m_command) {
+        m_command->appendToData(stream);
+        return;
+    }
+
+    // Without the type, it gets written by UndoStackExt
+    const QByteArray data = m_mergedData.isEmpty()
+                            ? m_undoStack->commandData(m_index).mid(sizeof(qint8)) : m_mergedData;
+    stream->writeRawData(data.constData(), data.size());
+}
+
 
 RemoveClueCommand::RemoveClueCommand(KrossWord *krossWord,
                                      ClueCell *clue, UndoCommandExt* parent)
@@ -757,17 +1146,6 @@ AddLettersToClueCommand::AddLettersToClueCommand(KrossWord* krossWord,
     setupText();
 }
 
-AddLettersToClueCommand::AddLettersToClueCommand(AddLettersToClueCommand* other)
-    : UndoCommandExt(other), m_krossWord(other->m_krossWord)
-{
-    m_coord = other->m_coord;
-    m_orientation = other->m_orientation;
-    m_answerOffset = other->m_answerOffset;
-    m_lettersToAdd = other->m_lettersToAdd;
-    m_origCorrectAnswer = other->m_origCorrectAnswer;
-    m_origCurrentAnswer = other->m_origCurrentAnswer;
-}
-
 void AddLettersToClueCommand::setupText()
 {
     if (m_lettersToAdd > 0)
@@ -778,17 +1156,22 @@ void AddLettersToClueCommand::setupText()
         setText(i18nc("This string shouldn't happen to be used", "Remove no letters"));
 }
 
-bool AddLettersToClueCommand::mergeWith(const QUndoCommand* other)
+bool AddLettersToClueCommand::canMergeWith(const QUndoCommand* other) const
 {
     const AddLettersToClueCommand *cmd =
         dynamic_cast<const AddLettersToClueCommand*>(other);
-    if (!cmd)
-        return false;
+    return cmd && isMergeAllowed() && cmd->m_coord == m_coord && cmd->m_answerOffset == m_answerOffset
+           && cmd->m_orientation == m_orientation;
+}
 
-    if (cmd->m_coord != m_coord || cmd->m_answerOffset != m_answerOffset
-            || cmd->m_orientation != m_orientation)
+bool AddLettersToClueCommand::mergeWith(const QUndoCommand* other)
+{
+    if (!canMergeWith(other))
         return false;
 
+    const AddLettersToClueCommand *cmd =
+        static_cast<const AddLettersToClueCommand*>(other);
+
     if (cmd->m_origCorrectAnswer.length() > m_origCorrectAnswer.length()) {
         m_origCorrectAnswer = cmd->m_origCorrectAnswer;
         m_origCurrentAnswer = cmd->m_origCurrentAnswer;
@@ -799,13 +1182,6 @@ bool AddLettersToClueCommand::mergeWith(const QUndoCommand* other)
     return true;
 }
 
-UndoCommandExt* AddLettersToClueCommand::mergedWith(const QUndoCommand* other)
-{
-    AddLettersToClueCommand *merged = new AddLettersToClueCommand(this);
-    merged->mergeWith(other);
-    return merged;
-}
-
 bool AddLettersToClueCommand::checkRedo(QString* errorMessage) const
 {
     if (!m_krossWord->findClueCell(m_coord, m_orientation, m_answerOffset)) {
@@ -923,11 +1299,25 @@ void ChangeClueCommand::init(KrossWord* krossWord, ClueCell* clueCell,
     setupText();
 }
 
-bool ChangeClueCommand::mergeWith(const QUndoCommand* other)
+bool ChangeClueCommand::canMergeWith(const QUndoCommand* other) const
 {
     const ChangeClueCommand *cmd = dynamic_cast<const ChangeClueCommand*>(other);
-    if (!cmd)
+    return cmd && isMergeAllowed()
+           && m_newCoord == cmd->m_oldCoord
+           && m_newAnswerOffset == cmd->m_oldAnswerOffset
+           && m_newOrientation == cmd->m_oldOrientation
+           && m_newClueText == cmd->m_oldClueText
+           && m_newCorrectAnswer == cmd->m_oldCorrectAnswer
+           && m_newCurrentAnswer == cmd->m_oldCurrentAnswer
+           && m_oldCorrectAnswer == m_newCorrectAnswer // Don't merge with cmds, that change the correct answer
+           && cmd->m_oldCorrectAnswer == cmd->m_newCorrectAnswer;
+}
+
+bool ChangeClueCommand::mergeWith(const QUndoCommand* other)
+{
+    if (!canMergeWith(other))
         return false;
+    const ChangeClueCommand *cmd = static_cast<const ChangeClueCommand*>(other);
 
 //   qDebug() << "  > Merge" << m_oldCoord << "=>" << m_newCoord
 //     << m_oldClueText << "=>" << m_newClueText
@@ -942,17 +1332,6 @@ bool ChangeClueCommand::mergeWith(const QUndoCommand* other)
 //     << cmd->m_oldCorrectAnswer << "=>" << cmd->m_newCorrectAnswer
 //     << cmd->m_oldCurrentAnswer << "=>" << cmd->m_newCurrentAnswer;
 
-    if (m_newCoord != cmd->m_oldCoord
-            || m_newAnswerOffset != cmd->m_oldAnswerOffset
-            || m_newOrientation != cmd->m_oldOrientation
-            || m_newClueText != cmd->m_oldClueText
-            || m_newCorrectAnswer != cmd->m_oldCorrectAnswer
-            || m_newCurrentAnswer != cmd->m_oldCurrentAnswer
-            || m_oldCorrectAnswer != m_newCorrectAnswer // Don't merge with cmds, that change the correct answer
-            || cmd->m_oldCorrectAnswer != cmd->m_newCorrectAnswer) {
-        return false;
-    }
-
     m_newCoord = cmd->m_newCoord;
     m_newOrientation = cmd->m_newOrientation;
     m_newAnswerOffset = cmd->m_newAnswerOffset;
@@ -1128,64 +1507,140 @@ LetterEditCommand::LetterEditCommand(KrossWord *krossWord,
 {
     m_krossWord = krossWord;
     m_editCorrectLetter = editCorrectLetter;
-    m_coord = coord;
-    m_currentLetter = currentLetter;
-    m_newLetter = newLetter;
 
-//   qDebug() << "at" << m_coord << "edit correct?" << m_editCorrectLetter
-//     << "from" << m_currentLetter << "to" << m_newLetter;
+    LetterEdit edit;
+    edit.coord = coord;
+    edit.currentLetter = currentLetter;
+    edit.newLetter = newLetter;
+    m_edits << edit;
+
+//   qDebug() << "at" << coord << "edit correct?" << m_editCorrectLetter
+//     << "from" << currentLetter << "to" << newLetter;
     setupText();
 }
 
 void LetterEditCommand::setupText()
 {
+    if (m_edits.isEmpty())
+        return;
+
+    if (m_edits.count() > 1) {
+        const Coord &coord = m_edits.first().coord;
+        QString newLetters;
+        foreach(const LetterEdit & edit, m_edits)
+        newLetters += edit.newLetter;
+
+        if (m_editCorrectLetter)
+            setText(i18n("Edit %1 Correct Letters at (%2, %3) to %4",
+                         m_edits.count(), coord.first + 1, coord.second + 1,
+                         newLetters));
+        else
+            setText(i18n("Edit %1 Letters at (%2, %3) to %4",
+                         m_edits.count(), coord.first + 1, coord.second + 1,
+                         newLetters));
+        return;
+    }
+
+    const Coord &coord = m_edits.first().coord;
+    const QChar &currentLetter = m_edits.first().currentLetter;
+    const QChar &newLetter = m_edits.first().newLetter;
     if (m_editCorrectLetter) {
-        if (m_newLetter == ' ')
+        if (newLetter == ' ')
             setText(i18n("Clear Correct Letter at (%1, %2), was %3",
-                         m_coord.first + 1, m_coord.second + 1, m_currentLetter));
-        else if (m_currentLetter == ' ')
+                         coord.first + 1, coord.second + 1, currentLetter));
+        else if (currentLetter == ' ')
             setText(i18n("Set Correct Letter at (%1, %2) to %3",
-                         m_coord.first + 1, m_coord.second + 1, m_newLetter));
+                         coord.first + 1, coord.second + 1, newLetter));
         else
             setText(i18n("Edit Correct Letter at (%1, %2) From %3 to %4",
-                         m_coord.first + 1, m_coord.second + 1, m_currentLetter, m_newLetter));
+                         coord.first + 1, coord.second + 1, currentLetter, newLetter));
     } else {
-        if (m_newLetter == ' ')
+        if (newLetter == ' ')
             setText(i18n("Clear Letter at (%1, %2), was %3",
-                         m_coord.first + 1, m_coord.second + 1, m_currentLetter));
-        else if (m_currentLetter == ' ')
+                         coord.first + 1, coord.second + 1, currentLetter));
+        else if (currentLetter == ' ')
             setText(i18n("Set Letter at (%1, %2) to %3",
-                         m_coord.first + 1, m_coord.second + 1, m_newLetter));
+                         coord.first + 1, coord.second + 1, newLetter));
         else
             setText(i18n("Edit Letter at (%1, %2) From %3 to %4",
-                         m_coord.first + 1, m_coord.second + 1, m_currentLetter, m_newLetter));
+                         coord.first + 1, coord.second + 1, currentLetter, newLetter));
     }
 }
 
-bool LetterEditCommand::checkRedo(QString* errorMessage) const
+bool LetterEditCommand::canMergeWith(const QUndoCommand* other) const
 {
-    KrossWordCell *cell = m_krossWord->at(m_coord);
-    if (cell && cell->isLetterCell())
-        return true;
-    else {
-        if (errorMessage)
-            *errorMessage = i18n("Letter cell not found at the given coordinates (%1, %2)",
-                                 m_coord.first + 1, m_coord.second + 1);
+    const LetterEditCommand *cmd = dynamic_cast<const LetterEditCommand*>(other);
+    if (!cmd || !isMergeAllowed() || cmd->m_edits.count() != 1
+            || cmd->m_editCorrectLetter != m_editCorrectLetter)
         return false;
-    }
+
+    const Coord &lastCoord = m_edits.last().coord;
+    const Coord &coord = cmd->m_edits.first().coord;
+    if (coord == lastCoord)
+        return true; // Overwriting the last edited letter
+
+    const int dx = coord.first - lastCoord.first;
+    const int dy = coord.second - lastCoord.second;
+    if (qAbs(dx) + qAbs(dy) != 1)
+        return false;
+
+    // Both letters need to be part of the same answer in the direction of the edits
+    LetterCell *lastLetter = qgraphicsitem_cast<LetterCell*>(m_krossWord->at(lastCoord));
+    LetterCell *letter = qgraphicsitem_cast<LetterCell*>(m_krossWord->at(coord));
+    if (!lastLetter || !letter)
+        return false;
+    if (dx != 0)
+        return lastLetter->clueHorizontal() && lastLetter->clueHorizontal() == letter->clueHorizontal();
+    else
+        return lastLetter->clueVertical() && lastLetter->clueVertical() == letter->clueVertical();
 }
 
-void LetterEditCommand::redoMaybe()
+bool LetterEditCommand::mergeWith(const QUndoCommand* other)
 {
-    KrossWordCell *cell = m_krossWord->at(m_coord);
+    if (!canMergeWith(other))
+        return false;
+
+    const LetterEdit &edit = static_cast<const LetterEditCommand*>(other)->m_edits.first();
+    if (edit.coord == m_edits.last().coord)
+        m_edits.last().newLetter = edit.newLetter;
+    else
+        m_edits << edit;
+    setupText();
+
+    return true;
+}
+
+void LetterEditCommand::setLetter(const Coord& coord, const QChar& letter)
+{
+    KrossWordCell *cell = m_krossWord->at(coord);
     if (cell && cell->isLetterCell()) {
-        LetterCell *letter = (LetterCell*)cell;
+        LetterCell *letterCell = (LetterCell*)cell;
         if (m_editCorrectLetter)
-            letter->setCorrectLetter(m_newLetter);
+            letterCell->setCorrectLetter(letter);
         else
-            letter->setCurrentLetter(m_newLetter);
+            letterCell->setCurrentLetter(letter);
     } else
-        qDebug() << "Can't redo, because the LetterCell couldn't be found";
+        qDebug() << "Can't redo/undo, because the LetterCell couldn't be found";
+}
+
+bool LetterEditCommand::checkRedo(QString* errorMessage) const
+{
+    foreach(const LetterEdit & edit, m_edits) {
+        KrossWordCell *cell = m_krossWord->at(edit.coord);
+        if (!cell || !cell->isLetterCell()) {
+            if (errorMessage)
+                *errorMessage = i18n("Letter cell not found at the given coordinates (%1, %2)",
+                                     edit.coord.first + 1, edit.coord.second + 1);
+            return false;
+        }
+    }
+    return true;
+}
+
+void LetterEditCommand::redoMaybe()
+{
+    foreach(const LetterEdit & edit, m_edits)
+    setLetter(edit.coord, edit.newLetter);
 }
 
 bool LetterEditCommand::checkUndo(QString* errorMessage) const
@@ -1196,25 +1651,16 @@ bool LetterEditCommand::checkUndo(QString* errorMessage) const
 
 void LetterEditCommand::undoMaybe()
 {
-    KrossWordCell *cell = m_krossWord->at(m_coord);
-    if (cell && cell->isLetterCell()) {
-        LetterCell *letter = (LetterCell*)cell;
-        if (m_editCorrectLetter)
-            letter->setCorrectLetter(m_currentLetter);
-        else
-            letter->setCurrentLetter(m_currentLetter);
-    } else
-        qDebug() << "Can't undo, because the LetterCell couldn't be found";
+    // Undo in reverse order
+    for (int i = m_edits.count() - 1; i >= 0; --i)
+        setLetter(m_edits[i].coord, m_edits[i].currentLetter);
 }
 
 ClearCrosswordCommand::ClearCrosswordCommand(KrossWord* krossWord,
         UndoCommandExt* parent)
-    : CrosswordCompoundUndoCommand(krossWord, parent)
+    : GridDiffCommand(krossWord, parent)
 {
-    foreach(ClueCell * clue, krossWord->clues())
-    new RemoveClueCommand(krossWord, clue, this);
-    foreach(ImageCell * image, krossWord->images())
-    new RemoveImageCommand(krossWord, image, this);
+    setupText();
 }
 
 void ClearCrosswordCommand::setupText()
@@ -1222,11 +1668,19 @@ void ClearCrosswordCommand::setupText()
     setText(i18n("Clear Crossword"));
 }
 
-void ClearCrosswordCommand::redoMaybe()
+void ClearCrosswordCommand::applyChange()
 {
     m_krossWord->removeAllCells();
 }
 
+void ClearCrosswordCommand::redoMaybe()
+{
+    if (hasGridState())
+        GridDiffCommand::redoMaybe();
+    else
+        m_krossWord->removeAllCells(); // Child commands are only used for undo
+}
+
 ChangeCrosswordPropertiesCommand::ChangeCrosswordPropertiesCommand(
     KrossWord* krossWord, const QString& newTitle, const QString& newAuthors,
     const QString& newCopyright, const QString& newNotes,
@@ -1696,77 +2150,344 @@ void CrosswordCompoundUndoCommand::undoMaybe()
     UndoCommandExt::undoMaybe();
 }
 
+/** Gets the records of @p before that are missing in @p after in @p removed
+* and the records of @p after that are missing in @p before in @p added.
+* The coordinates of @p after are moved by @p offset. */
+template <typename Record>
+static void diffRecords(const QList<Record> &before, const QList<Record> &after,
+                        const Offset &offset,
+                        QList<Record> *removed, QList<Record> *added)
+{
+    QMultiHash<Coord, int> afterIndices;
+    for (int i = 0; i < after.count(); ++i)
+        afterIndices.insert(after[i].coord, i);
+
+    QVector<bool> kept(after.count(), false);
+    foreach(const Record & record, before) {
+        Record movedRecord = record;
+        movedRecord.coord = record.coord + offset;
+
+        bool found = false;
+        foreach(int i, afterIndices.values(movedRecord.coord)) {
+            if (!kept[i] && after[i] == movedRecord) {
+                kept[i] = found = true;
+                break;
+            }
+        }
+        if (!found)
+            *removed << record;
+    }
 
-ConvertCrosswordCommand::ConvertCrosswordCommand(KrossWord* krossWord,
-        CrosswordTypeInfo newTypeInfo, UndoCommandExt* parent)
-    : CrosswordCompoundUndoCommand(krossWord, parent)
+    for (int i = 0; i < after.count(); ++i) {
+        if (!kept[i])
+            *added << after[i];
+    }
+}
+
+/** Combines the changed records @p removed and @p added of a change moving
+* the cells by @p offset with the ones of the following change, @p nextRemoved,
+* @p nextAdded and @p nextOffset. */
+template <typename Record>
+static void mergeRecords(QList<Record> *removed, QList<Record> *added,
+                         const Offset &offset,
+                         const QList<Record> &nextRemoved,
+                         const QList<Record> &nextAdded,
+                         const Offset &nextOffset)
+{
+    // Records added by the first change and removed by the next one cancel out
+    QMultiHash<Coord, int> nextRemovedIndices;
+    for (int i = 0; i < nextRemoved.count(); ++i)
+        nextRemovedIndices.insert(nextRemoved[i].coord, i);
+
+    QVector<bool> cancelled(nextRemoved.count(), false);
+    QList<Record> stillAdded = nextAdded;
+    foreach(const Record & record, *added) {
+        bool found = false;
+        foreach(int i, nextRemovedIndices.values(record.coord)) {
+            if (!cancelled[i] && nextRemoved[i] == record) {
+                cancelled[i] = found = true;
+                break;
+            }
+        }
+        if (!found) {
+            Record movedRecord = record;
+            movedRecord.coord = record.coord + nextOffset;
+            stillAdded << movedRecord;
+        }
+    }
+    for (int i = 0; i < nextRemoved.count(); ++i) {
+        if (!cancelled[i]) {
+            Record movedRecord = nextRemoved[i];
+            movedRecord.coord = nextRemoved[i].coord - offset;
+            *removed << movedRecord;
+        }
+    }
+    *added = stillAdded;
+}
+
+GridDiffCommand::GridDiffCommand(KrossWord* krossWord, UndoCommandExt* parent)
+    : CrosswordCompoundUndoCommand(krossWord, parent),
+      m_hasGridState(true), m_changeStored(false), m_offset(0, 0)
 {
-    m_oldTypeInfo = krossWord->crosswordTypeInfo();
-    m_newTypeInfo = newTypeInfo;
-    KrossWord::ConversionInfo conversionInfo =
-        krossWord->generateConversionInfo(newTypeInfo);
+    m_objectsBefore = currentObjects();
+    m_sizeBefore = QSize(krossWord->width(), krossWord->height());
+    m_typeInfoBefore = krossWord->crosswordTypeInfo();
+    m_codedPuzzleMappingBefore = krossWord->letterContentToClueNumberMapping();
+}
+
+GridDiffCommand::GridObjects GridDiffCommand::currentObjects() const
+{
+    GridObjects objects;
+    foreach(ClueCell * clue, m_krossWord->clues()) {
+        ClueRecord record;
+        record.coord = clue->coord();
+        record.orientation = clue->orientation();
+        record.answerOffset = clue->answerOffset();
+        record.text = clue->clue();
+        record.answer = clue->correctAnswer();
+        record.highlighted = clue->isHighlighted();
+        objects.clues << record;
+    }
+
+    foreach(ImageCell * image, m_krossWord->images()) {
+        ImageRecord record;
+        record.coord = image->coord();
+        record.horizontalCellSpan = image->horizontalCellSpan();
+        record.verticalCellSpan = image->verticalCellSpan();
+        record.url = image->url();
+        objects.images << record;
+    }
+
+    foreach(LetterCell * letter, m_krossWord->letters()) {
+        const SolutionLetterCell *solutionLetter =
+            qgraphicsitem_cast<SolutionLetterCell*>(letter);
+        LetterRecord record;
+        record.coord = letter->coord();
+        record.currentLetter = letter->currentLetter();
+        record.confidence = letter->confidence();
+        record.solutionWordIndex = solutionLetter
+                                   ? solutionLetter->solutionWordIndex() : -1;
+        objects.letters << record;
+    }
+
+    return objects;
+}
+
+void GridDiffCommand::storeChanges(const GridObjects& objectsAfter)
+{
+    m_sizeAfter = QSize(m_krossWord->width(), m_krossWord->height());
+    m_offset = changeOffset();
+    m_typeInfoAfter = m_krossWord->crosswordTypeInfo();
+    m_codedPuzzleMappingAfter = m_krossWord->letterContentToClueNumberMapping();
+
+    diffRecords(m_objectsBefore.clues, objectsAfter.clues, m_offset,
+                &m_removedObjects.clues, &m_addedObjects.clues);
+    diffRecords(m_objectsBefore.images, objectsAfter.images, m_offset,
+                &m_removedObjects.images, &m_addedObjects.images);
+
+    // Letters of changed clues get removed and reinserted with the clues,
+    // so their states are always stored
+    QSet<Coord> changedLettersBefore, changedLettersAfter;
+    foreach(const ClueRecord & clue, m_removedObjects.clues) {
+        foreach(const Coord & coord, ClueCell::answerCoordList(
+                    clue.coord, clue.answerOffset, clue.orientation,
+                    clue.answer.length()))
+        changedLettersBefore << coord;
+    }
+    foreach(const ClueRecord & clue, m_addedObjects.clues) {
+        foreach(const Coord & coord, ClueCell::answerCoordList(
+                    clue.coord, clue.answerOffset, clue.orientation,
+                    clue.answer.length()))
+        changedLettersAfter << coord;
+    }
+
+    QList<LetterRecord> lettersBefore, lettersAfter;
+    foreach(const LetterRecord & letter, m_objectsBefore.letters) {
+        if (changedLettersBefore.contains(letter.coord))
+            m_removedObjects.letters << letter;
+        else
+            lettersBefore << letter;
+    }
+    foreach(const LetterRecord & letter, objectsAfter.letters) {
+        if (changedLettersAfter.contains(letter.coord))
+            m_addedObjects.letters << letter;
+        else
+            lettersAfter << letter;
+    }
+    diffRecords(lettersBefore, lettersAfter, m_offset,
+                &m_removedObjects.letters, &m_addedObjects.letters);
+
+    m_objectsBefore = GridObjects();
+    m_changeStored = true;
+}
+
+void GridDiffCommand::changeGrid(const GridObjects& objects,
+                                 const GridObjects& newObjects,
+                                 const QSize& size, const QSize& newSize,
+                                 const Offset& offset,
+                                 const CrosswordTypeInfo& newTypeInfo,
+                                 const QString& newCodedPuzzleMapping)
+{
+    const bool animationEnabled = m_krossWord->animator()->isEnabled();
+    m_krossWord->animator()->setEnabled(false);
+
+    // Convert solution letters back before their letter cells get removed
+    foreach(const LetterRecord & record, objects.letters) {
+        if (record.solutionWordIndex == -1)
+            continue;
+
+        SolutionLetterCell *solutionLetter =
+            qgraphicsitem_cast<SolutionLetterCell*>(m_krossWord->at(record.coord));
+        if (solutionLetter)
+            solutionLetter->toLetter();
+    }
+
+    foreach(const ImageRecord & record, objects.images) {
+        ImageCell *image = qgraphicsitem_cast<ImageCell*>(m_krossWord->at(record.coord));
+        if (image)
+            m_krossWord->removeImage(image);
+        else
+            qDebug() << "Image not found" << record.url << record.coord;
+    }
+
+    foreach(const ClueRecord & record, objects.clues) {
+        ClueCell *clue = m_krossWord->findClueCell(record.coord,
+                         record.orientation, record.answerOffset);
+        if (clue)
+            m_krossWord->removeClue(clue);
+        else
+            qDebug() << "Clue not found" << record.text << record.coord
+                     << record.orientation;
+    }
 
-    // Setup child commands
-    foreach(ClueCell * clue, conversionInfo.cluesToRemove) {
-        qDebug() << "Remove command for" << clue->clue();
-        addRemoveClueCommand(clue);
+    // All removed objects are gone, so only empty cells get dropped here
+    if (size != newSize || offset != Offset(0, 0)) {
+        m_krossWord->resizeGrid(qMax(size.width(), newSize.width()),
+                                qMax(size.height(), newSize.height()),
+                                KrossWord::AnchorTopLeft);
+        if (offset != Offset(0, 0))
+            m_krossWord->moveCells(offset.first, offset.second);
+        m_krossWord->resizeGrid(newSize.width(), newSize.height(),
+                                KrossWord::AnchorTopLeft);
     }
+    m_krossWord->setCrosswordTypeInfo(newTypeInfo);
+    m_krossWord->setLetterContentToClueNumberMapping(newCodedPuzzleMapping, false);
 
-    foreach(KrossWordCell * cell, conversionInfo.cellsToRemove) {
+    foreach(const ClueRecord & record, newObjects.clues) {
         ClueCell *clue;
+        ErrorType errorType = m_krossWord->insertClue(
+                                  record.coord, record.orientation,
+                                  record.answerOffset, record.text, record.answer,
+                                  LetterCellType, DontIgnoreErrors, true, &clue);
+        if (errorType == ErrorNone) {
+            if (record.highlighted)
+                clue->setHighlight();
+        } else
+            qDebug() << "Couldn't insert clue, insertClue returns"
+                     << KrossWord::errorMessageFromErrorType(errorType);
+    }
+
+    foreach(const ImageRecord & record, newObjects.images) {
         ImageCell *image;
-        SolutionLetterCell *solutionLetter;
-        if ((clue = qgraphicsitem_cast<ClueCell*>(cell))) {
-            addSetClueHiddenCommand(clue);
-            //    new SetClueHiddenCommand( krossWord, clue, this );
-        } else if ((image = qgraphicsitem_cast<ImageCell*>(cell)))
-            addRemoveImageCommand(image);
-        else if ((solutionLetter = qgraphicsitem_cast<SolutionLetterCell*>(cell)))
-            addConvertToLetterCommand(solutionLetter);
+        ErrorType errorType = m_krossWord->insertImage(
+                                  record.coord, record.horizontalCellSpan,
+                                  record.verticalCellSpan, record.url,
+                                  DontIgnoreErrors, &image);
+        if (errorType != ErrorNone)
+            qDebug() << "Couldn't insert image, insertImage returns"
+                     << KrossWord::errorMessageFromErrorType(errorType);
+    }
+
+    // Set current letters before letters get converted to solution letters
+    foreach(const LetterRecord & record, newObjects.letters) {
+        KrossWordCell *cell = m_krossWord->at(record.coord);
+        if (cell && cell->isLetterCell())
+            static_cast<LetterCell*>(cell)->setCurrentLetter(record.currentLetter);
+    }
+    foreach(const LetterRecord & record, newObjects.letters) {
+        if (record.solutionWordIndex == -1)
+            continue;
+
+        LetterCell *letter = qgraphicsitem_cast<LetterCell*>(m_krossWord->at(record.coord));
+        if (letter)
+            letter->toSolutionLetter(record.solutionWordIndex);
         else
-            qDebug() << "TODO?: RemoveCellCommand for"
-                     << stringFromCellType(cell->getCellType());
-        //       new RemoveCellCommand( krossWord, cell, this );
-        //       removeCell( cell );
+            qDebug() << "No letter cell to convert to a solution letter at"
+                     << record.coord;
     }
 
-    for (QHash<ClueCell*, AnswerOffset>::const_iterator it =
-                conversionInfo.cluesToMakeVisible.constBegin();
-            it != conversionInfo.cluesToMakeVisible.constEnd(); ++it) {
-        addMakeClueCellVisibleCommand(it.key(), it.value());
+    m_krossWord->assignClueNumbers();
+    if (newTypeInfo.clueType == NumberClues1To26
+            && newTypeInfo.clueMapping == CluesReferToCells
+            && newTypeInfo.letterCellContent == Crossword::Characters)
+        m_krossWord->setupSameLetterSynchronization();
+    else
+        m_krossWord->removeSameLetterSynchronization();
+
+    foreach(const LetterRecord & record, newObjects.letters) {
+        KrossWordCell *cell = m_krossWord->at(record.coord);
+        if (cell && cell->isLetterCell())
+            static_cast<LetterCell*>(cell)->setConfidence(record.confidence);
     }
 
-//   emit cluesAboutToBeRemoved( conversionInfo.cluesToRemove );
-    // Don't emit cluesAboutToBeRemoved() in removeClue(), it has just been
-    // emitted for all clues to be removed
-//   bool wasBlocked = blockSignals( true );
-//   foreach ( ClueCell *clue, conversionInfo.cluesToRemove )
-//     removeClue( clue );
-//   blockSignals( wasBlocked );
+    m_krossWord->animator()->setEnabled(animationEnabled);
+}
 
-    QHash<LetterCell*, QChar>::const_iterator it;
-    for (it = conversionInfo.letterEditCurrent.constBegin();
-            it != conversionInfo.letterEditCurrent.constEnd(); ++it) {
-        addLetterEditCommand(false, it.key()->coord(), it.key()->currentLetter(), it.value());
+void GridDiffCommand::redoMaybe()
+{
+    if (!hasGridState()) {
+        CrosswordCompoundUndoCommand::redoMaybe();
+        return;
     }
-    for (it = conversionInfo.letterEditCorrect.constBegin();
-            it != conversionInfo.letterEditCorrect.constEnd(); ++it) {
-        addLetterEditCommand(true, it.key()->coord(), it.key()->correctLetter(), it.value());
+
+    if (!m_changeStored) {
+        applyChange();
+        storeChanges(currentObjects());
+    } else {
+        changeGrid(m_removedObjects, m_addedObjects, m_sizeBefore, m_sizeAfter,
+                   m_offset, m_typeInfoAfter, m_codedPuzzleMappingAfter);
     }
+}
+
+void GridDiffCommand::undoMaybe()
+{
+    if (hasGridState()) {
+        changeGrid(m_addedObjects, m_removedObjects, m_sizeAfter, m_sizeBefore,
+                   Offset(-m_offset.first, -m_offset.second),
+                   m_typeInfoBefore, m_codedPuzzleMappingBefore);
+    } else
+        CrosswordCompoundUndoCommand::undoMaybe();
+}
 
-    if (conversionInfo.conversionCommands.testFlag(KrossWord::SetDefaultCodedPuzzleMapping))
-        addSetDefaultCodedPuzzleMappingCommand();
-//     new SetDefaultCodedPuzzleMappingCommand( m_krossWord, this );
-//     qDebug() << "TODO: SetDefaultCodedPuzzleMappingCommand";
-//     m_codedPuzzleMapping = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+void GridDiffCommand::mergeGridState(const GridDiffCommand* other)
+{
+    // QUndoStack::push() merges commands after redoing them, so both
+    // changes are stored
+    Q_ASSERT(m_changeStored && other->m_changeStored);
 
-    if (conversionInfo.conversionCommands.testFlag(KrossWord::SetupSameLetterSynchronization))
-        addSetupSameLetterSynchronizationCommand();
-    else
-        addRemoveSameLetterSynchronizationCommand();
-//     new SetupSameLetterSynchronizationCommand( m_krossWord, this );
-//     qDebug() << "TODO: SetupSameLetterSynchronizationCommand";
-//     setupSameLetterSynchronization();
+    mergeRecords(&m_removedObjects.clues, &m_addedObjects.clues, m_offset,
+                 other->m_removedObjects.clues, other->m_addedObjects.clues,
+                 other->m_offset);
+    mergeRecords(&m_removedObjects.images, &m_addedObjects.images, m_offset,
+                 other->m_removedObjects.images, other->m_addedObjects.images,
+                 other->m_offset);
+    mergeRecords(&m_removedObjects.letters, &m_addedObjects.letters, m_offset,
+                 other->m_removedObjects.letters, other->m_addedObjects.letters,
+                 other->m_offset);
+
+    m_sizeAfter = other->m_sizeAfter;
+    m_offset = m_offset + other->m_offset;
+    m_typeInfoAfter = other->m_typeInfoAfter;
+    m_codedPuzzleMappingAfter = other->m_codedPuzzleMappingAfter;
+}
+
+
+ConvertCrosswordCommand::ConvertCrosswordCommand(KrossWord* krossWord,
+        CrosswordTypeInfo newTypeInfo, UndoCommandExt* parent)
+    : GridDiffCommand(krossWord, parent)
+{
+    m_oldTypeInfo = krossWord->crosswordTypeInfo();
+    m_newTypeInfo = newTypeInfo;
 
     setupText();
 }
@@ -1778,8 +2499,20 @@ void ConvertCrosswordCommand::setupText()
                  CrosswordTypeInfo::stringFromType(m_newTypeInfo.crosswordType)));
 }
 
+void ConvertCrosswordCommand::applyChange()
+{
+    m_krossWord->convertToType(m_newTypeInfo);
+    m_krossWord->setHighlightedClue(NULL);
+}
+
 void ConvertCrosswordCommand::redoMaybe()
 {
+    if (hasGridState()) {
+        GridDiffCommand::redoMaybe();
+        return;
+    }
+
+    // Stored by an older version with child commands
     m_krossWord->setCrosswordTypeInfo(m_newTypeInfo);
     m_krossWord->setHighlightedClue(NULL);
 
@@ -1817,6 +2550,11 @@ void ConvertCrosswordCommand::redoMaybe()
 
 void ConvertCrosswordCommand::undoMaybe()
 {
+    if (hasGridState()) {
+        GridDiffCommand::undoMaybe();
+        return;
+    }
+
     m_krossWord->setCrosswordTypeInfo(m_oldTypeInfo);
     m_krossWord->setHighlightedClue(NULL);
 
@@ -1856,7 +2594,7 @@ void ConvertCrosswordCommand::undoMaybe()
 ResizeCrosswordCommand::ResizeCrosswordCommand(KrossWord *krossWord,
         uint newWidth, uint newHeight, KrossWord::ResizeAnchor anchor,
         UndoCommandExt* parent)
-    : CrosswordCompoundUndoCommand(krossWord, parent)
+    : GridDiffCommand(krossWord, parent)
 {
     m_oldWidth = krossWord->width();
     m_newWidth = newWidth;
@@ -1866,26 +2604,7 @@ ResizeCrosswordCommand::ResizeCrosswordCommand(KrossWord *krossWord,
 
 //   qDebug() << "Resize Command | Anchor =" << anchor
 //       << "| New Size =" << newWidth << newHeight;
-    KrossWordCellList removedCells = krossWord->resizeGrid(
-                                         newWidth, newHeight, anchor, true);
-    foreach(KrossWordCell * cell, removedCells) {
-        ClueCell *clue;
-        ImageCell *image;
-        if ((clue = qgraphicsitem_cast<ClueCell*>(cell))) {
-//       qDebug() << "ResizeCrosswordCommand clue to remove"
-//    << clue->correctAnswer() << clue->clue();
-            addRemoveClueCommand(clue);
-        } else if ((image = qgraphicsitem_cast<ImageCell*>(cell))) {
-            addRemoveImageCommand(image);
-        } else if (!cell->isType(EmptyCellType)) {
-            qDebug() << "No undo command to remove cells of type"
-                     << stringFromCellType(cell->getCellType());
-        }
-    }
-
     setupText();
-    // TODO: Only remove cells id after resize grid
-//   new ClearCrosswordCommand( krossWord, this );
 }
 
 void ResizeCrosswordCommand::setupText()
@@ -1894,26 +2613,47 @@ void ResizeCrosswordCommand::setupText()
                  m_oldWidth, m_oldHeight, m_newWidth, m_newHeight));
 }
 
-bool ResizeCrosswordCommand::mergeWith(const QUndoCommand* other)
+bool ResizeCrosswordCommand::canMergeWith(const QUndoCommand* other) const
 {
     const ResizeCrosswordCommand *cmd = dynamic_cast<const ResizeCrosswordCommand*>(other);
-    if (!cmd)
-        return false;
+    return cmd && isMergeAllowed() && m_anchor == cmd->m_anchor
+           && m_newWidth == cmd->m_oldWidth && m_newHeight == cmd->m_oldHeight
+           && hasGridState() == cmd->hasGridState();
+}
 
-    if (m_anchor != cmd->m_anchor
-            || m_newWidth != cmd->m_oldWidth || m_newHeight != cmd->m_oldHeight)
+bool ResizeCrosswordCommand::mergeWith(const QUndoCommand* other)
+{
+    if (!canMergeWith(other))
         return false;
 
+    const ResizeCrosswordCommand *cmd = static_cast<const ResizeCrosswordCommand*>(other);
     m_newWidth = cmd->m_newWidth;
     m_newHeight = cmd->m_newHeight;
+    mergeGridState(cmd);
     setupText();
 
     return true;
 }
 
+void ResizeCrosswordCommand::applyChange()
+{
+    m_krossWord->resizeGrid(m_newWidth, m_newHeight, m_anchor);
+}
+
+Offset ResizeCrosswordCommand::changeOffset() const
+{
+    return KrossWord::resizeOffset(int(m_newWidth) - int(m_oldWidth),
+                                   int(m_newHeight) - int(m_oldHeight), m_anchor);
+}
+
 void ResizeCrosswordCommand::redoMaybe()
 {
-    UndoCommandExt::redoMaybe(); // remove cells for resizing
+    if (hasGridState()) {
+        GridDiffCommand::redoMaybe();
+        return;
+    }
+
+    CrosswordCompoundUndoCommand::redoMaybe(); // remove cells for resizing
     m_krossWord->resizeGrid(m_newWidth, m_newHeight, m_anchor);
 }
 
@@ -1930,8 +2670,13 @@ void ResizeCrosswordCommand::redoMaybe()
 
 void ResizeCrosswordCommand::undoMaybe()
 {
+    if (hasGridState()) {
+        GridDiffCommand::undoMaybe();
+        return;
+    }
+
     m_krossWord->resizeGrid(m_oldWidth, m_oldHeight, m_anchor);
-    UndoCommandExt::undoMaybe(); // reinsert cells that were removed by the resizing
+    CrosswordCompoundUndoCommand::undoMaybe(); // reinsert cells that were removed by the resizing
 
     // TODO: Re-add removed clues (by child commands of remove invalidated cells command)
 //   bool block = m_krossWord->blockSignals( true );
@@ -1945,24 +2690,11 @@ void ResizeCrosswordCommand::undoMaybe()
 
 MoveCellsCommand::MoveCellsCommand(KrossWord* krossWord, int dx, int dy,
                                    UndoCommandExt* parent)
-    : CrosswordCompoundUndoCommand(krossWord, parent)
+    : GridDiffCommand(krossWord, parent)
 {
     m_dx = dx;
     m_dy = dy;
 
-    KrossWordCellList cellsRemoved = krossWord->moveCells(dx, dy, true);
-    foreach(KrossWordCell * cell, cellsRemoved) {
-        ClueCell *clue;
-        ImageCell *image;
-        if ((clue = qgraphicsitem_cast<ClueCell*>(cell)))
-            addRemoveClueCommand(clue);
-        else if ((image = qgraphicsitem_cast<ImageCell*>(cell)))
-            addRemoveImageCommand(image);
-        else
-            qDebug() << "No undo command to remove cells of type"
-                     << stringFromCellType(cell->getCellType());
-    }
-
     setupText();
 }
 
@@ -1971,27 +2703,49 @@ void MoveCellsCommand::setupText()
     setText(i18n("Move All Cells By %1, %2", m_dx, m_dy));
 }
 
-bool MoveCellsCommand::mergeWith(const QUndoCommand* other)
+bool MoveCellsCommand::canMergeWith(const QUndoCommand* other) const
 {
     const MoveCellsCommand *cmd = dynamic_cast<const MoveCellsCommand*>(other);
-    if (!cmd)
+    return cmd && isMergeAllowed() && hasGridState() == cmd->hasGridState();
+}
+
+bool MoveCellsCommand::mergeWith(const QUndoCommand* other)
+{
+    if (!canMergeWith(other))
         return false;
 
+    const MoveCellsCommand *cmd = static_cast<const MoveCellsCommand*>(other);
     m_dx += cmd->m_dx;
     m_dy += cmd->m_dy;
+    mergeGridState(cmd);
     setupText();
 
     return true;
 }
 
+void MoveCellsCommand::applyChange()
+{
+    m_krossWord->moveCells(m_dx, m_dy);
+}
+
 void MoveCellsCommand::redoMaybe()
 {
+    if (hasGridState()) {
+        GridDiffCommand::redoMaybe();
+        return;
+    }
+
     CrosswordCompoundUndoCommand::redoMaybe(); // remove cells for moving
     m_krossWord->moveCells(m_dx, m_dy);
 }
 
 void MoveCellsCommand::undoMaybe()
 {
+    if (hasGridState()) {
+        GridDiffCommand::undoMaybe();
+        return;
+    }
+
     m_krossWord->moveCells(-m_dx, -m_dy);   // move cells in the opposite direction
     CrosswordCompoundUndoCommand::undoMaybe(); // reinsert deleted cells
 }
@@ -2029,6 +2783,113 @@ CrosswordCompoundUndoCommand::CrosswordCompoundUndoCommand(
     }
 }
 
+void GridDiffCommand::appendToData(QDataStream* stream) const
+{
+    if (!hasGridState()) {
+        CrosswordCompoundUndoCommand::appendToData(stream);
+        return;
+    }
+
+    // A child count of -1 marks stored grid changes
+    *stream << (qint16) -1;
+    *stream << m_sizeBefore << m_sizeAfter;
+    *stream << (qint16)m_offset.first << (qint16)m_offset.second;
+    *stream << m_typeInfoBefore << m_typeInfoAfter;
+    *stream << m_codedPuzzleMappingBefore << m_codedPuzzleMappingAfter;
+    appendObjects(stream, m_removedObjects);
+    appendObjects(stream, m_addedObjects);
+}
+
+GridDiffCommand::GridDiffCommand(KrossWord* krossWord, QDataStream* stream,
+                                 UndoCommandExt* parent)
+    : CrosswordCompoundUndoCommand(krossWord, parent),
+      m_hasGridState(false), m_changeStored(true), m_offset(0, 0)
+{
+    qint16 children;
+    *stream >> children;
+    if (children == -1) {
+        m_hasGridState = true;
+        qint16 dx, dy;
+        *stream >> m_sizeBefore >> m_sizeAfter;
+        *stream >> dx >> dy;
+        m_offset = Offset(dx, dy);
+        *stream >> m_typeInfoBefore >> m_typeInfoAfter;
+        *stream >> m_codedPuzzleMappingBefore >> m_codedPuzzleMappingAfter;
+        readObjects(stream, &m_removedObjects);
+        readObjects(stream, &m_addedObjects);
+        return;
+    }
+
+    // Stored by an older version
+    for (int i = 0; i < children; ++i)
+        UndoCommandExt::fromData(krossWord, stream, this);
+}
+
+void GridDiffCommand::appendObjects(QDataStream* stream, const GridObjects& objects)
+{
+    *stream << (qint32)objects.clues.count();
+    foreach(const ClueRecord & clue, objects.clues) {
+        *stream << (qint16)clue.coord.first << (qint16)clue.coord.second;
+        *stream << static_cast<qint8>(clue.orientation);
+        *stream << static_cast<qint8>(clue.answerOffset);
+        *stream << clue.text << clue.answer << clue.highlighted;
+    }
+
+    *stream << (qint32)objects.images.count();
+    foreach(const ImageRecord & image, objects.images) {
+        *stream << (qint16)image.coord.first << (qint16)image.coord.second;
+        *stream << (qint16)image.horizontalCellSpan << (qint16)image.verticalCellSpan;
+        *stream << image.url;
+    }
+
+    *stream << (qint32)objects.letters.count();
+    foreach(const LetterRecord & letter, objects.letters) {
+        *stream << (qint16)letter.coord.first << (qint16)letter.coord.second;
+        *stream << letter.currentLetter << static_cast<qint8>(letter.confidence);
+        *stream << (qint16)letter.solutionWordIndex;
+    }
+}
+
+void GridDiffCommand::readObjects(QDataStream* stream, GridObjects* objects)
+{
+    qint32 count;
+    qint16 x, y;
+    qint8 iOrientation, iAnswerOffset, iConfidence;
+
+    *stream >> count;
+    for (int i = 0; i < count; ++i) {
+        ClueRecord clue;
+        *stream >> x >> y >> iOrientation >> iAnswerOffset;
+        *stream >> clue.text >> clue.answer >> clue.highlighted;
+        clue.coord = Coord(x, y);
+        clue.orientation = static_cast< Qt::Orientation >(iOrientation);
+        clue.answerOffset = static_cast< AnswerOffset >(iAnswerOffset);
+        objects->clues << clue;
+    }
+
+    *stream >> count;
+    for (int i = 0; i < count; ++i) {
+        ImageRecord image;
+        qint16 horizontalCellSpan, verticalCellSpan;
+        *stream >> x >> y >> horizontalCellSpan >> verticalCellSpan >> image.url;
+        image.coord = Coord(x, y);
+        image.horizontalCellSpan = horizontalCellSpan;
+        image.verticalCellSpan = verticalCellSpan;
+        objects->images << image;
+    }
+
+    *stream >> count;
+    for (int i = 0; i < count; ++i) {
+        LetterRecord letter;
+        qint16 solutionWordIndex;
+        *stream >> x >> y >> letter.currentLetter >> iConfidence >> solutionWordIndex;
+        letter.coord = Coord(x, y);
+        letter.confidence = static_cast< Confidence >(iConfidence);
+        letter.solutionWordIndex = solutionWordIndex;
+        objects->letters << letter;
+    }
+}
+
 void RemoveClueCommand::appendToData(QDataStream *stream) const
 {
 //   int size = sizeof(int)*4 + sizeof(qint8) * 2 + sizeof(qint16) * 2 + sizeof(qint32) * 3
@@ -2200,7 +3061,7 @@ ChangeCrosswordPropertiesCommand::ChangeCrosswordPropertiesCommand(
 
 void ConvertCrosswordCommand::appendToData(QDataStream *stream) const
 {
-    CrosswordCompoundUndoCommand::appendToData(stream);
+    GridDiffCommand::appendToData(stream);
 
     *stream << m_oldTypeInfo;
     *stream << m_newTypeInfo;
@@ -2208,7 +3069,7 @@ void ConvertCrosswordCommand::appendToData(QDataStream *stream) const
 
 ConvertCrosswordCommand::ConvertCrosswordCommand(KrossWord* krossWord,
         QDataStream* stream, UndoCommandExt* parent)
-    : CrosswordCompoundUndoCommand(krossWord, stream, parent)
+    : GridDiffCommand(krossWord, stream, parent)
 {
     *stream >> m_oldTypeInfo;
     *stream >> m_newTypeInfo;
@@ -2240,22 +3101,48 @@ ConvertToLetterCommand::ConvertToLetterCommand(KrossWord* krossWord,
 
 void LetterEditCommand::appendToData(QDataStream *stream) const
 {
-    *stream << (qint16)m_coord.first << (qint16)m_coord.second;
-    *stream << m_editCorrectLetter;
-    *stream << m_currentLetter << m_newLetter;
+    if (m_edits.count() == 1) {
+        const LetterEdit &edit = m_edits.first();
+        *stream << (qint16)edit.coord.first << (qint16)edit.coord.second;
+        *stream << m_editCorrectLetter;
+        *stream << edit.currentLetter << edit.newLetter;
+    } else {
+        *stream << m_editCorrectLetter;
+        *stream << (qint16)m_edits.count();
+        foreach(const LetterEdit & edit, m_edits) {
+            *stream << (qint16)edit.coord.first << (qint16)edit.coord.second;
+            *stream << edit.currentLetter << edit.newLetter;
+        }
+    }
 }
 
 LetterEditCommand::LetterEditCommand(KrossWord* krossWord,
-                                     QDataStream* stream, UndoCommandExt* parent)
+                                     QDataStream* stream, UndoCommandExt* parent,
+                                     bool run)
     : UndoCommandExt(parent), m_krossWord(krossWord)
 {
     qint16 x, y;
-    *stream >> x >> y;
-    m_coord.first = x;
-    m_coord.second = y;
+    LetterEdit edit;
+    if (run) {
+        qint16 count;
+        *stream >> m_editCorrectLetter;
+        *stream >> count;
+        for (int i = 0; i < count; ++i) {
+            *stream >> x >> y;
+            edit.coord.first = x;
+            edit.coord.second = y;
+            *stream >> edit.currentLetter >> edit.newLetter;
+            m_edits << edit;
+        }
+    } else {
+        *stream >> x >> y;
+        edit.coord.first = x;
+        edit.coord.second = y;
 
-    *stream >> m_editCorrectLetter;
-    *stream >> m_currentLetter >> m_newLetter;
+        *stream >> m_editCorrectLetter;
+        *stream >> edit.currentLetter >> edit.newLetter;
+        m_edits << edit;
+    }
     setupText();
 }
 
@@ -2286,14 +3173,14 @@ MakeClueCellVisibleCommand::MakeClueCellVisibleCommand(KrossWord* krossWord,
 
 void MoveCellsCommand::appendToData(QDataStream *stream) const
 {
-    CrosswordCompoundUndoCommand::appendToData(stream);
+    GridDiffCommand::appendToData(stream);
     *stream << (qint16)m_dx << (qint16)m_dy;
 //   qDebug() << "MoveCellsCommand::appendToData" << m_dx << m_dy;
 }
 
 MoveCellsCommand::MoveCellsCommand(KrossWord* krossWord,
                                    QDataStream* stream, UndoCommandExt* parent)
-    : CrosswordCompoundUndoCommand(krossWord, stream, parent)
+    : GridDiffCommand(krossWord, stream, parent)
 {
     qint16 dx, dy;
     *stream >> dx >> dy;
@@ -2306,7 +3193,7 @@ MoveCellsCommand::MoveCellsCommand(KrossWord* krossWord,
 
 void ResizeCrosswordCommand::appendToData(QDataStream *stream) const
 {
-    CrosswordCompoundUndoCommand::appendToData(stream);
+    GridDiffCommand::appendToData(stream);
     *stream << (qint16)m_oldWidth << (qint16)m_oldHeight;
     *stream << (qint16)m_newWidth << (qint16)m_newHeight;
     *stream << static_cast<qint8>(m_anchor);
@@ -2314,7 +3201,7 @@ void ResizeCrosswordCommand::appendToData(QDataStream *stream) const
 
 ResizeCrosswordCommand::ResizeCrosswordCommand(KrossWord* krossWord,
         QDataStream* stream, UndoCommandExt* parent)
-    : CrosswordCompoundUndoCommand(krossWord, stream, parent)
+    : GridDiffCommand(krossWord, stream, parent)
 {
     qint16 oldWidth, oldHeight, newWidth, newHeight;
     *stream >> oldWidth >> oldHeight;
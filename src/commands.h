@@ -36,39 +36,129 @@ class KrossWord;
 }
 using namespace Crossword;
 class UndoCommandExt;
+class QTemporaryFile;
 
+/** An undo stack, that stores the data of it's commands, eg. to save the
+* edit history in crossword files.
+*
+* Pushed commands are held by @ref StoredUndoCommand "StoredUndoCommands".
+* The memory used for the edit history is limited by @ref memoryLimit().
+* When the data of recent commands grows beyond half of the limit, the data
+* of older commands gets compressed into a segment and their command objects
+* get deleted, the StoredUndoCommands then recreate them from the data when
+* needed. When the limit is still exceeded, the oldest segments get written to
+* a temporary file. */
 class UndoStackExt : public QUndoStack
 {
     Q_OBJECT
 
 public:
     UndoStackExt(QObject* parent = 0);
+    ~UndoStackExt();
 
     bool tryPush(UndoCommandExt *cmd, QString *errorMessage = 0);
 
-    const QByteArray &data() const;
+    /** Gets the current index followed by the data of all commands. The
+    * data of compressed segments gets cached, so that it only needs to be
+    * decompressed again after the cache was dropped to limit memory usage. */
+    QByteArray data() const;
+    /** Gets the data of the command at @p index, ie. it's type followed by
+    * the data written by UndoCommandExt::appendToData().
+    * @returns An empty QByteArray, if there is no data for @p index. */
+    QByteArray commandData(int index) const;
+    /** Gets the data of @p command like it gets stored, ie. it's type followed
+    * by the data written by UndoCommandExt::appendToData(). */
+    static QByteArray recordData(const UndoCommandExt *command);
+    /** Rebuilds the stack from @p data, eg. read from a crossword file.
+    * @p krossWord needs to be in the state it had when @p data was stored,
+    * the commands aren't executed. */
     void createFromData(KrossWord *krossWord, const QByteArray &data);
 
+    /** The crossword to recreate commands for, that were replaced by
+    * StoredUndoCommands. Commands only get replaced, if it is set. */
+    KrossWord *krossWord() const {
+        return m_krossWord;
+    }
+    void setKrossWord(KrossWord *krossWord) {
+        m_krossWord = krossWord;
+    }
+
+    /** The maximal number of bytes used for the data of the commands in
+    * memory. If it is 0, the memory usage isn't limited. */
+    qint64 memoryLimit() const {
+        return m_memoryLimit;
+    }
+    void setMemoryLimit(qint64 memoryLimit);
+    /** The number of bytes used for the data of the commands in memory,
+    * including the cached data of compressed segments. */
+    qint64 memoryUsage() const;
+
     bool isExecuting() const {
         return m_executingRedo;
     }
-    void clear() {
-        QUndoStack::clear();
-        m_data.clear();
-        m_dataIndexPos.clear();
-        m_dataIndexPos << sizeof(qint16);
+    void clear();
+
+    /** Prevents merging the next pushed command into the current one, eg.
+    * after the crossword was automatically saved. Unlike setClean(), this
+    * doesn't change the clean state shown to the user. */
+    void setMergeBarrier() {
+        m_mergeBarrierIndex = index();
+    }
+    /** Whether a command pushed now may get merged into the current one, see
+    * @ref setMergeBarrier(). */
+    bool isMergeAllowed() const {
+        return index() != m_mergeBarrierIndex;
     }
 
+signals:
+    /** Emitted by @ref tryPush() before a command gets pushed, with the data
+    * of the command, ie. it's type followed by the data written by
+    * UndoCommandExt::appendToData(). If the command gets merged into the
+    * previous one, @ref data() contains the merged command instead. */
+    void commandPushed(const QByteArray &commandData);
+
 public slots:
     void indexChanged(int idx);
 
 private:
+    /** Compressed data of consecutive commands older than the ones in
+    * m_data. */
+    struct DataSegment {
+        int firstIndex; // index of the first command
+        int count;
+        QList<int> recordPos; // positions in the uncompressed data, count + 1 values
+        QByteArray compressedData; // empty, if written to m_spillFile
+        qint64 filePos; // position in m_spillFile or -1
+        int fileSize;
+    };
+
+    void storeRecord(int index, const QByteArray &record);
+    void clearSegments();
+    QByteArray segmentData(int segment) const;
+    void compressRecords(int count);
+    void restoreSegmentsFrom(int index);
+    void spillSegments(qint64 maxCompressedSize);
+    /** Deletes the command objects of the commands in @p segment. */
+    void releaseCommandObjects(int segment);
+    void limitMemoryUsage();
+
     QList<qint64> m_dataIndexPos;
     QByteArray m_data;
 //     QStringList m_data;
     bool m_executingRedo;
     qint16 m_storedStartIndex;
 
+    KrossWord *m_krossWord;
+    int m_mergeBarrierIndex;
+    qint64 m_memoryLimit;
+    QList<DataSegment> m_segments;
+    QTemporaryFile *m_spillFile;
+    mutable int m_cachedSegment;
+    mutable QByteArray m_cachedSegmentData;
+    // Uncompressed data of all segments, valid if m_segmentsDataCached is true
+    mutable QByteArray m_segmentsData;
+    mutable bool m_segmentsDataCached;
+
 //     UndoCommandExt *m_lastCommand;
 //     bool m_deleteLastCommand;
 };
@@ -97,14 +187,21 @@ public:
         CommandConvertCrossword = 18,
         CommandResizeCrossword = 19,
         CommandMoveCells = 20,
-        CommandAddLettersToClue = 21
+        CommandAddLettersToClue = 21,
+        CommandLetterEditRun = 22 /**< A LetterEditCommand with merged edits. */
     };
 
     UndoCommandExt(UndoCommandExt* parent = 0);
 
-    virtual UndoCommandExt *mergedWith(const QUndoCommand* other) {
+    /** Checks if mergeWith() would merge @p other into this command, without
+    * changing anything. Commands with an id() need to implement this, so
+    * that UndoStackExt::tryPush() knows when QUndoStack::push() merges them
+    * and stores the merged command in place of this one. Implementations need
+    * to return false if @ref isMergeAllowed() returns false.
+    * The default implementation returns false. */
+    virtual bool canMergeWith(const QUndoCommand* other) const {
         Q_UNUSED(other);
-        return nullptr;
+        return false;
     }
 
     /** Checks if the redo action can be performed or would lead to an error.
@@ -172,9 +269,55 @@ public:
                                     UndoCommandExt *parent = NULL);
 
 protected:
+    /** Whether the undo stack allows merging other commands into this one,
+    * see UndoStackExt::setMergeBarrier(). */
+    bool isMergeAllowed() const {
+        return !m_undoStack || m_undoStack->isMergeAllowed();
+    }
+
     UndoStackExt *m_undoStack;
 };
 
+/** Holds a command of an UndoStackExt. To limit memory usage, the command
+* can be released after it's data was stored, only the data is kept then.
+* A released command gets recreated from the data to undo, redo or merge it. */
+class StoredUndoCommand : public UndoCommandExt
+{
+public:
+    /** Takes ownership of @p command, which is at @p index in @p undoStack. */
+    StoredUndoCommand(UndoStackExt *undoStack, int index, UndoCommandExt *command);
+    virtual ~StoredUndoCommand();
+
+    /** Deletes the command, it's data needs to be stored in the undo stack. */
+    void releaseCommand();
+
+    virtual int id() const {
+        return m_id;
+    }
+    virtual bool canMergeWith(const QUndoCommand* other) const;
+    virtual bool mergeWith(const QUndoCommand* other);
+
+    virtual void redoMaybe();
+    virtual void undoMaybe();
+
+    virtual Command type() const {
+        return m_command ? m_command->type() : m_type;
+    }
+    virtual void appendToData(QDataStream *stream) const;
+
+private:
+    /** Creates the command from it's data. The caller takes ownership. */
+    UndoCommandExt *createCommand() const;
+    /** Gets the command held by @p other, if it is a StoredUndoCommand. */
+    static const QUndoCommand *heldCommand(const QUndoCommand *other);
+
+    UndoCommandExt *m_command; // Owned, 0 if released
+    int m_index;
+    Command m_type;
+    int m_id;
+    QByteArray m_mergedData; // Data of the merged command, until it's stored
+};
+
 QDebug &operator <<(QDebug debug, UndoCommandExt::Command command);
 
 /*
@@ -268,6 +411,115 @@ protected:
     KrossWord *m_krossWord;
 };
 
+/** Base class for commands changing the whole grid, eg. clearing, resizing
+* or converting the crossword. Instead of using child commands for each
+* removed cell, only the clues, images and letters that differ before and
+* after the change get stored, together with the changed grid size, cell
+* offset, crossword type and letter to clue number mapping. Undoing and
+* redoing removes and inserts only these objects in place, all other cells
+* are kept (moved by the offset).
+*
+* Commands stored by older versions contain child commands instead, these
+* get handled by the derived classes like before (see hasGridState()). */
+class GridDiffCommand : public CrosswordCompoundUndoCommand
+{
+public:
+    explicit GridDiffCommand(KrossWord *krossWord, UndoCommandExt* parent = 0);
+
+    /** Applies the stored changes. The change gets applied using
+    * applyChange() on the first redo, which also stores the changes. */
+    virtual void redoMaybe();
+    /** Reverts the stored changes. */
+    virtual void undoMaybe();
+
+    /** False, if the command was stored by an older version and uses child
+    * commands. */
+    bool hasGridState() const {
+        return m_hasGridState;
+    }
+    virtual void appendToData(QDataStream *stream) const;
+
+protected:
+    GridDiffCommand(KrossWord *krossWord, QDataStream *stream,
+                    UndoCommandExt *parent = NULL);
+
+    /** Changes the crossword, called on the first redo. */
+    virtual void applyChange() = 0;
+    /** Gets the offset by which applyChange() moves the cells. */
+    virtual Offset changeOffset() const {
+        return Offset(0, 0);
+    }
+    /** Uses the state after the change of @p other, used when merging. */
+    void mergeGridState(const GridDiffCommand *other);
+
+private:
+    struct ClueRecord {
+        Coord coord;
+        Qt::Orientation orientation;
+        AnswerOffset answerOffset;
+        QString text;
+        QString answer;
+        bool highlighted; // Not compared
+
+        bool operator ==(const ClueRecord &other) const {
+            return coord == other.coord && orientation == other.orientation
+                   && answerOffset == other.answerOffset
+                   && text == other.text && answer == other.answer;
+        }
+    };
+    struct ImageRecord {
+        Coord coord;
+        int horizontalCellSpan, verticalCellSpan;
+        QUrl url;
+
+        bool operator ==(const ImageRecord &other) const {
+            return coord == other.coord && url == other.url
+                   && horizontalCellSpan == other.horizontalCellSpan
+                   && verticalCellSpan == other.verticalCellSpan;
+        }
+    };
+    struct LetterRecord {
+        Coord coord;
+        QChar currentLetter;
+        Confidence confidence;
+        int solutionWordIndex; // -1 for letters not in the solution word
+
+        bool operator ==(const LetterRecord &other) const {
+            return coord == other.coord && currentLetter == other.currentLetter
+                   && confidence == other.confidence
+                   && solutionWordIndex == other.solutionWordIndex;
+        }
+    };
+    struct GridObjects {
+        QList<ClueRecord> clues;
+        QList<ImageRecord> images;
+        QList<LetterRecord> letters;
+    };
+
+    GridObjects currentObjects() const;
+    void storeChanges(const GridObjects &objectsAfter);
+    /** Removes @p objects from the crossword and inserts @p newObjects after
+    * changing the grid from @p size to @p newSize, moving all cells by
+    * @p offset. */
+    void changeGrid(const GridObjects &objects, const GridObjects &newObjects,
+                    const QSize &size, const QSize &newSize, const Offset &offset,
+                    const CrosswordTypeInfo &newTypeInfo,
+                    const QString &newCodedPuzzleMapping);
+    static void appendObjects(QDataStream *stream, const GridObjects &objects);
+    static void readObjects(QDataStream *stream, GridObjects *objects);
+
+    bool m_hasGridState;
+    bool m_changeStored; // False before the first redo
+    GridObjects m_objectsBefore; // All objects, only until the first redo
+
+    GridObjects m_removedObjects; // Coordinates before the change
+    GridObjects m_addedObjects; // Coordinates after the change
+    QSize m_sizeBefore, m_sizeAfter;
+    Offset m_offset;
+    CrosswordTypeInfo m_typeInfoBefore, m_typeInfoAfter;
+    QString m_codedPuzzleMappingBefore, m_codedPuzzleMappingAfter;
+};
+
 class RemoveClueCommand : public CrosswordCompoundUndoCommand
 {
 public:
@@ -559,6 +811,7 @@ public:
     virtual int id() const {
         return static_cast<int>(CommandChangeClue);
     }
+    virtual bool canMergeWith(const QUndoCommand* other) const;
     virtual bool mergeWith(const QUndoCommand* other);
 
     virtual void redoMaybe();
@@ -612,8 +865,8 @@ public:
     virtual int id() const {
         return static_cast<int>(CommandAddLettersToClue);
     }
+    virtual bool canMergeWith(const QUndoCommand* other) const;
     virtual bool mergeWith(const QUndoCommand* other);
-    virtual UndoCommandExt *mergedWith(const QUndoCommand* other);
 
     virtual void redoMaybe();
     virtual void undoMaybe();
@@ -634,7 +887,6 @@ public:
 protected:
     AddLettersToClueCommand(KrossWord* krossWord, QDataStream *stream,
                             UndoCommandExt *parent = 0);
-    AddLettersToClueCommand(AddLettersToClueCommand *other);
 
 private:
     void setupText();
@@ -669,6 +921,9 @@ private:
 // };
 */
 
+/** Edits the correct or current letter of a letter cell. Consecutive edits
+* of neighbouring letters along one clue, eg. typing an answer, get merged
+* into a single command. */
 class LetterEditCommand : public UndoCommandExt
 {
 public:
@@ -677,33 +932,52 @@ public:
                       const QChar &currentLetter, const QChar &newLetter,
                       UndoCommandExt* parent = 0);
 
+    virtual int id() const {
+        return static_cast<int>(CommandLetterEdit);
+    }
+    /** Edits can be merged, if @p other edits the same kind of letter in the
+    * last edited cell or a neighbouring cell of the same clue. */
+    virtual bool canMergeWith(const QUndoCommand* other) const;
+    virtual bool mergeWith(const QUndoCommand* other);
+
     virtual void redoMaybe();
     virtual void undoMaybe();
 
     virtual bool checkRedo(QString* errorMessage = 0) const;
     virtual bool checkUndo(QString* errorMessage = 0) const;
 
+    /** Single edits are stored as CommandLetterEdit, merged edits as
+    * CommandLetterEditRun. */
     virtual Command type() const {
-        return CommandLetterEdit;
+        return m_edits.count() > 1 ? CommandLetterEditRun : CommandLetterEdit;
     }
     virtual void appendToData(QDataStream *stream) const;
     static LetterEditCommand *fromData(KrossWord *krossWord,
                                        QDataStream *stream, UndoCommandExt *parent = NULL) {
         return new LetterEditCommand(krossWord, stream, parent);
     }
+    static LetterEditCommand *runFromData(KrossWord *krossWord,
+                                          QDataStream *stream, UndoCommandExt *parent = NULL) {
+        return new LetterEditCommand(krossWord, stream, parent, true);
+    }
 
 protected:
     LetterEditCommand(KrossWord *krossWord, QDataStream *stream,
-                      UndoCommandExt *parent = NULL);
+                      UndoCommandExt *parent = NULL, bool run = false);
 
 private:
+    struct LetterEdit {
+        Coord coord;
+        QChar currentLetter;
+        QChar newLetter;
+    };
+
     void setupText();
+    void setLetter(const Coord &coord, const QChar &letter);
 
     KrossWord *m_krossWord;
     bool m_editCorrectLetter; // edit correct or current letter
-    Coord m_coord;
-    QChar m_currentLetter;
-    QChar m_newLetter;
+    QList<LetterEdit> m_edits; // in the order of editing
 };
 
 class ClearClueCommand : public UndoCommandExt
@@ -741,13 +1015,13 @@ private:
     QString m_answer;
 };
 
-class ClearCrosswordCommand : public CrosswordCompoundUndoCommand
+class ClearCrosswordCommand : public GridDiffCommand
 {
 public:
     explicit ClearCrosswordCommand(KrossWord *krossWord, UndoCommandExt* parent = 0);
 
     virtual void redoMaybe(); // Only call removeAllCells()
-    //  virtual void undoMaybe(); // QUndoCommand processes all children (RemoveClue/ImageCommand's)
+    //  virtual void undoMaybe(); // Restores the grid state or processes all children (RemoveClue/ImageCommand's)
 
 //  virtual bool checkRedo( QString* errorMessage = 0 ) const; // Just use default implementation (always true)
 //     virtual bool checkUndo( QString* errorMessage = 0 ) const;
@@ -764,10 +1038,12 @@ public:
 protected:
     ClearCrosswordCommand(KrossWord *krossWord, QDataStream *stream,
                           UndoCommandExt *parent = NULL)
-        : CrosswordCompoundUndoCommand(krossWord, stream, parent) {
+        : GridDiffCommand(krossWord, stream, parent) {
         setupText();
     }
 
+    virtual void applyChange();
+
 private:
     void setupText();
 };
@@ -974,7 +1250,7 @@ private:
 // typedef ReverseUndoCommand<SetupSameLetterSynchronizationCommand>
 //  RemoveSameLetterSynchronizationCommand;
 
-class ConvertCrosswordCommand : public CrosswordCompoundUndoCommand
+class ConvertCrosswordCommand : public GridDiffCommand
 {
 public:
     ConvertCrosswordCommand(KrossWord *krossWord,
@@ -1000,6 +1276,8 @@ protected:
     ConvertCrosswordCommand(KrossWord *krossWord,
                             QDataStream *stream, UndoCommandExt *parent = NULL);
 
+    virtual void applyChange();
+
 private:
     void setupText();
 
@@ -1007,13 +1285,14 @@ private:
     CrosswordTypeInfo m_newTypeInfo;
 };
 
-class ResizeCrosswordCommand : public CrosswordCompoundUndoCommand
+class ResizeCrosswordCommand : public GridDiffCommand
 {
 public:
     ResizeCrosswordCommand(KrossWord *krossWord, uint newWidth, uint newHeight,
                            KrossWord::ResizeAnchor anchor = KrossWord::AnchorCenter,
                            UndoCommandExt* parent = 0);
 
+    virtual bool canMergeWith(const QUndoCommand* other) const;
     virtual bool mergeWith(const QUndoCommand* other);
     virtual int id() const {
         return static_cast<int>(CommandResizeCrossword);
@@ -1039,6 +1318,9 @@ protected:
     ResizeCrosswordCommand(KrossWord *krossWord, QDataStream *stream,
                            UndoCommandExt *parent = NULL);
 
+    virtual void applyChange();
+    virtual Offset changeOffset() const;
+
 private:
     void setupText();
 
@@ -1047,12 +1329,13 @@ private:
     uint m_oldHeight, m_newHeight;
 };
 
-class MoveCellsCommand : public CrosswordCompoundUndoCommand
+class MoveCellsCommand : public GridDiffCommand
 {
 public:
     MoveCellsCommand(KrossWord *krossWord, int dx, int dy,
                      UndoCommandExt* parent = 0);
 
+    virtual bool canMergeWith(const QUndoCommand* other) const;
     virtual bool mergeWith(const QUndoCommand* other);
     virtual int id() const {
         return static_cast<int>(CommandMoveCells);
@@ -1074,6 +1357,11 @@ protected:
     MoveCellsCommand(KrossWord *krossWord, QDataStream *stream,
                      UndoCommandExt *parent = NULL);
 
+    virtual void applyChange();
+    virtual Offset changeOffset() const {
+        return Offset(m_dx, m_dy);
+    }
+
 private:
     void setupText();
 
@@ -25,6 +25,10 @@
 #include "cells/imagecell.h"
 #include "krosswordrenderer.h"
 #include "dictionary.h"
+#include "deadslotchecker.h"
+#include "autosavejournal.h"
+#include "io/krosswordxmlreader.h"
+#include "io/krosswordbackgroundwriter.h"
 #include "extendedsqltablemodel.h"
 #include "settings.h"
 #include "htmldelegate.h"
@@ -293,14 +297,17 @@ CrossWordXmlGuiWindow::CrossWordXmlGuiWindow(QWidget* parent) : KXmlGuiWindow(pa
       m_zoomWidget(nullptr),
       m_zoomController(nullptr),
       m_solutionProgress(nullptr),
+      m_symmetryLabel(nullptr),
       m_clueModel(nullptr),
       m_clueSelectionModel(nullptr),
       m_popupMenuCell(nullptr),
       m_dictionary(new KrosswordDictionary),
+      m_deadSlotChecker(nullptr),
       m_animation(nullptr)
 {
     m_lastSavedUndoIndex = -1;
     m_undoStackLoaded = false;
+    m_changeJournaled = false;
     m_state = ShowingNothing;
     m_curDocumentOrigin = NoDocument;
     m_modified = NoModification;
@@ -312,6 +319,11 @@ CrossWordXmlGuiWindow::CrossWordXmlGuiWindow(QWidget* parent) : KXmlGuiWindow(pa
     setAutoSaveSettings(QLatin1String("CrosswordWindow"), false);
 
     m_undoStack = new UndoStackExt(this);
+    // Connected first, so that changes are journaled before autosaving
+    m_journal = new AutoSaveJournal(m_undoStack, this);
+    m_backgroundWriter = new KrossWordBackgroundWriter(this);
+    connect(m_backgroundWriter, SIGNAL(written(QString, bool, QString)),
+            this, SLOT(autoSaveWritten(QString, bool, QString)));
     connect(m_undoStack, SIGNAL(indexChanged(int)), this, SLOT(undoStackIndexChanged(int)));
 
     // Load theme
@@ -324,6 +336,11 @@ CrossWordXmlGuiWindow::CrossWordXmlGuiWindow(QWidget* parent) : KXmlGuiWindow(pa
     // Create main view
     m_view = createKrossWordPuzzleView();
     setCentralWidget(m_view);
+    m_undoStack->setKrossWord(krossWord());
+    updateUndoMemoryLimit();
+
+    // Flags answers without fitting dictionary words while editing
+    m_deadSlotChecker = new DeadSlotChecker(krossWord(), m_dictionary, this);
 
     // Create solution progress bar:
     m_solutionProgress = new QProgressBar;
@@ -335,6 +352,12 @@ CrossWordXmlGuiWindow::CrossWordXmlGuiWindow(QWidget* parent) : KXmlGuiWindow(pa
     m_solutionProgress->setMaximumWidth(150);
     statusBar()->addPermanentWidget(m_solutionProgress);
 
+    // Create symmetry label, only shown in edit mode:
+    m_symmetryLabel = new QLabel;
+    m_symmetryLabel->setVisible(false);
+    statusBar()->addPermanentWidget(m_symmetryLabel);
+    symmetryChanged(krossWord()->has180DegreeRotationSymmetry());
+
     // Create zoom widgets:
     m_zoomWidget = new ZoomWidget(3, 2);
     m_zoomWidget->setFixedWidth(150);
@@ -356,6 +379,8 @@ CrossWordXmlGuiWindow::CrossWordXmlGuiWindow(QWidget* parent) : KXmlGuiWindow(pa
 
 CrossWordXmlGuiWindow::~CrossWordXmlGuiWindow()
 {
+    // Uses the dictionary's suggester
+    delete m_deadSlotChecker;
     delete m_dictionary;
 }
 
@@ -405,6 +430,8 @@ const char *CrossWordXmlGuiWindow::actionName(CrossWordXmlGuiWindow::Action acti
         return "clue_number_mapping";
     case Edit_CheckRotationSymmetry:
         return "edit_check_rotation_symmetry";
+    case Edit_SymmetricClueRemoval:
+        return "edit_symmetric_clue_removal";
     case Edit_Statistics:
         return "edit_statistics";
     case Edit_MoveCells:
@@ -538,7 +565,7 @@ void CrossWordXmlGuiWindow::setState(CrossWordXmlGuiWindow::DisplayState state)
         krossWord()->setInteractive(true);
         m_zoomWidget->setEnabled(true);
         m_solutionProgress->setEnabled(true);
-        m_solutionProgress->setValue(krossWord()->solutionProgress() * 100);
+        updateSolutionProgress();
 
         m_animationCellList = krossWord()->cells();
 
@@ -558,7 +585,7 @@ void CrossWordXmlGuiWindow::setState(CrossWordXmlGuiWindow::DisplayState state)
 
         m_zoomWidget->setEnabled(false);
         m_solutionProgress->setEnabled(false);
-        m_solutionProgress->setValue(100);
+        m_solutionProgress->setValue(m_solutionProgress->maximum());
 
         showCongratulationsItems();
         break;
@@ -585,8 +612,13 @@ void CrossWordXmlGuiWindow::setEditMode(EditMode editMode)
         action(actionName(Edit_EnableEditMode))->setChecked(inEditMode);
     }
     enableEditActions();
+    if (m_symmetryLabel)
+        m_symmetryLabel->setVisible(inEditMode);
 
     if (inEditMode) {
+        // Edit commands need to be pushed on top of the stored edit history
+        loadUndoHistory();
+
         m_clueTree->setEditTriggers(QAbstractItemView::DoubleClicked | QAbstractItemView::EditKeyPressed);
         toolBar("editToolBar")->setVisible(true);
 
@@ -693,6 +725,7 @@ bool CrossWordXmlGuiWindow::loadFile(const QUrl &url, KrossWord::FileFormat file
                                                 QUrl(),
                                                 "application/x-krosswordpuzzle "
                                                 "application/x-krosswordpuzzle-compressed "
+                                                "application/x-krosswordpuzzle-binary "
                                                 "application/x-acrosslite-puz");
         if (resultUrl.isEmpty()) {
             return false; // No file was chosen
@@ -713,10 +746,32 @@ bool CrossWordXmlGuiWindow::loadFile(const QUrl &url, KrossWord::FileFormat file
 
     if (readOk) {
         setState(ShowingCrossword);
-        m_undoStack->createFromData(krossWord(), undoData);
-        m_undoStackLoaded = !undoData.isEmpty();
+        if (fileFormat == KrossWord::DetermineByFileName) {
+            fileFormat = KrossWord::fileFormatFromFileName(resultUrl.path());
+        }
+        if (undoData.isEmpty() && fileFormat != KrossWord::KrossWordPuzzleXmlFile
+                && fileFormat != KrossWord::AcrossLitePuzFile
+                && fileFormat != KrossWord::KrossWordPuzzleBinaryFile) {
+            // The edit history of compressed files gets loaded when needed
+            m_pendingUndoFileName = resultUrl.toLocalFile();
+            m_undoStackLoaded = false;
+        } else {
+            m_undoStack->createFromData(krossWord(), undoData);
+            m_undoStackLoaded = !undoData.isEmpty();
+        }
         m_lastAutoSave = QDateTime::currentDateTime();
 
+        if (loadCrashedFile) {
+            // Apply the changes made after the file was automatically saved
+            // and keep using it for automatic saves
+            const QString autoSaveFileName = resultUrl.toLocalFile();
+            if (QFile::exists(AutoSaveJournal::journalFileName(autoSaveFileName))) {
+                loadUndoHistory();
+                AutoSaveJournal::replay(autoSaveFileName, krossWord(), m_undoStack);
+            }
+            m_curTmpFileName = autoSaveFileName;
+        }
+
         statusBar()->showMessage(i18n("Loaded crossword from file '%1'", fileName), 5000);
         if (loadCrashedFile) {
             m_curDocumentOrigin = DocumentRestoredAfterCrash;
@@ -728,7 +783,7 @@ bool CrossWordXmlGuiWindow::loadFile(const QUrl &url, KrossWord::FileFormat file
         setCurrentFileName(resultUrl.path());
         m_lastSavedUndoIndex = m_undoStack->index();
 
-        m_solutionProgress->setValue(krossWord()->solutionProgress() * 100);
+        updateSolutionProgress();
 
         if (krossWord()->crosswordTypeInfo().crosswordType == UnknownCrosswordType) {
             if (KMessageBox::questionYesNo(this, i18n("The crossword type couldn't "
@@ -779,7 +834,9 @@ bool CrossWordXmlGuiWindow::save()
             || m_curDocumentOrigin == DocumentRestoredAfterCrash) {
         return saveAs(KrossWord::Normal);
     } else {
-        return writeTo(m_curFileName, KrossWord::Normal, m_undoStackLoaded);
+        // A not yet loaded edit history gets loaded by writeTo() to be saved again
+        return writeTo(m_curFileName, KrossWord::Normal,
+                       m_undoStackLoaded || !m_pendingUndoFileName.isEmpty());
     }
 }
 
@@ -792,11 +849,11 @@ bool CrossWordXmlGuiWindow::saveAs(const KrossWord::WriteMode writeMode)
         startDir = QUrl::fromLocalFile(m_curFileName);
     }
 
-    QString fileName = QFileDialog::getSaveFileName(this, QString(), startDir.path(), i18n("Crosswords (*.kwp *.kwpz *.puz)"));
+    QString fileName = QFileDialog::getSaveFileName(this, QString(), startDir.path(), i18n("Crosswords (*.kwp *.kwpz *.kwpb *.puz)"));
 
     if (!fileName.isEmpty()) {
         // Add default extension if non was selected
-        if (fileName.indexOf(QRegExp("\\.(kwp|kwpz|puz)$", Qt::CaseInsensitive)) == -1) {
+        if (fileName.indexOf(QRegExp("\\.(kwp|kwpz|kwpb|puz)$", Qt::CaseInsensitive)) == -1) {
             fileName += ".kwpz";
         }
         return writeTo(fileName, writeMode, true/*save_undo_stack*/); //CHECK: an option to choose if save_undo_stack?
@@ -862,16 +919,20 @@ bool CrossWordXmlGuiWindow::writeTo(const QString &fileName, KrossWord::WriteMod
     QString errorString;
     bool writeOk;
     if (saveUndoStack) {
+        loadUndoHistory();
         writeOk = krossWord()->write(fileName, &errorString, writeMode,
                                      KrossWord::DetermineByFileName,
-                                     m_undoStack->data());
+                                     m_undoStack->data(), KrossWord::EmbedThumbnails);
     } else {
-        writeOk = krossWord()->write(fileName, &errorString, writeMode);
+        writeOk = krossWord()->write(fileName, &errorString, writeMode,
+                                     KrossWord::DetermineByFileName,
+                                     QByteArray(), KrossWord::EmbedThumbnails);
     }
 
     if (writeOk) {
         QString oldFileName = m_curFileName;
         m_lastSavedUndoIndex = m_undoStack->index();
+        m_undoStack->setClean(); // Don't merge edits across the save point
         setModificationType(NoModification);
         setCurrentFileName(fileName);
         statusBar()->showMessage(i18n("Wrote crossword to file '%1'", m_curFileName), 5000);
@@ -1089,9 +1150,29 @@ void CrossWordXmlGuiWindow::removeSlot()
     ClueCell *clue;
     ImageCell *image;
     if ((clue = krossWord()->highlightedClue()) || (clue = qgraphicsitem_cast<ClueCell*>(m_popupMenuCell))) {
+        // Get the symmetric clue before removing the clue, which may remove letters
+        ClueCell *symmetricClue = NULL;
+        if (action(actionName(Edit_SymmetricClueRemoval))->isChecked()) {
+            symmetricClue = krossWord()->symmetricClue(clue);
+            if (symmetricClue == clue)
+                symmetricClue = NULL;
+        }
+
+        // Both clues get removed by a single command, to undo them together
+        UndoCommandExt *command;
+        if (symmetricClue) {
+            CrosswordCompoundUndoCommand *compoundCommand = new CrosswordCompoundUndoCommand(krossWord());
+            compoundCommand->setText(i18n("Remove Clues Symmetrically"));
+            compoundCommand->addRemoveClueCommand(clue);
+            compoundCommand->addRemoveClueCommand(symmetricClue);
+            command = compoundCommand;
+        } else
+            command = new RemoveClueCommand(krossWord(), clue);
+
         QString errorMessage;
-        if (!m_undoStack->tryPush(new RemoveClueCommand(krossWord(), clue), &errorMessage)) {
+        if (!m_undoStack->tryPush(command, &errorMessage)) {
             statusBar()->showMessage(i18nc("%1 contains the reason why the clue couldn't be removed", "Can't remove clue. %1", errorMessage));
+            delete command;
         }
     } else if ((image = qgraphicsitem_cast<ImageCell*>(krossWord()->currentCell())) || (image = qgraphicsitem_cast<ImageCell*>(m_popupMenuCell))) {
         QString errorMessage;
@@ -1161,6 +1242,16 @@ void CrossWordXmlGuiWindow::editCheckRotationSymmetrySlot()
     KMessageBox::information(this, message);
 }
 
+void CrossWordXmlGuiWindow::symmetryChanged(bool symmetric)
+{
+    if (!m_symmetryLabel)
+        return;
+
+    m_symmetryLabel->setText(symmetric ? i18n("Symmetric") : i18n("Not symmetric"));
+    m_symmetryLabel->setToolTip(i18n("Shows whether or not the crossword has "
+                                     "180 degree rotation symmetry"));
+}
+
 void CrossWordXmlGuiWindow::editStatisticsSlot()
 {
     QDialog *dialog = new StatisticsDialog(krossWord(), this);
@@ -1486,6 +1577,10 @@ void CrossWordXmlGuiWindow::setupActions()
     ac->addAction(actionName(Edit_CheckRotationSymmetry), editCheckRotationSymmetryAction);
     connect(editCheckRotationSymmetryAction, SIGNAL(triggered()), this, SLOT(editCheckRotationSymmetrySlot()));
 
+    QAction *editSymmetricClueRemovalAction = new KToggleAction(QIcon::fromTheme(QStringLiteral("object-rotate-left")), i18n("S&ymmetric Clue Removal"), this);
+    editSymmetricClueRemovalAction->setToolTip(i18n("Also removes the clue at the 180 degree rotated position when removing a clue"));
+    ac->addAction(actionName(Edit_SymmetricClueRemoval), editSymmetricClueRemovalAction);
+
     QAction *editStatisticsAction = new QAction(QIcon::fromTheme(QStringLiteral("view-statistics")), i18n("&Statistics..."), this);
     editStatisticsAction->setToolTip(i18n("Shows statistics about the crossword"));
     ac->addAction(actionName(Edit_Statistics), editStatisticsAction);
@@ -1547,6 +1642,11 @@ void CrossWordXmlGuiWindow::setupActions()
     connect(eraseAction, SIGNAL(triggered(bool)), this, SLOT(eraseSlot(bool)));
 }
 
+void CrossWordXmlGuiWindow::updateUndoMemoryLimit()
+{
+    m_undoStack->setMemoryLimit(qint64(Settings::undoMemoryLimit()) * 1024 * 1024);
+}
+
 void CrossWordXmlGuiWindow::updateTheme()
 {
     /* Should not do it manually */
@@ -1583,8 +1683,37 @@ void CrossWordXmlGuiWindow::setDefaultCursor()
 
 void CrossWordXmlGuiWindow::undoStackIndexChanged(int index)
 {
+    m_changeJournaled = true;
     setModificationType(m_lastSavedUndoIndex == index
                         ? NoModification : ModifiedCrossword);
+    m_changeJournaled = false;
+}
+
+void CrossWordXmlGuiWindow::undoViewDockVisibilityChanged(bool visible)
+{
+    if (visible)
+        loadUndoHistory();
+}
+
+void CrossWordXmlGuiWindow::loadUndoHistory()
+{
+    if (m_pendingUndoFileName.isEmpty())
+        return;
+
+    QByteArray undoData;
+    const QString fileName = m_pendingUndoFileName;
+    m_pendingUndoFileName.clear();
+    if (!KrossWordXmlReader::readUndoData(fileName, &undoData) || undoData.isEmpty()) {
+        m_undoStackLoaded = false;
+        return;
+    }
+
+    // Restoring the stored index isn't a modification
+    disconnect(m_undoStack, SIGNAL(indexChanged(int)), this, SLOT(undoStackIndexChanged(int)));
+    m_undoStack->createFromData(krossWord(), undoData);
+    m_undoStackLoaded = true;
+    m_lastSavedUndoIndex = m_undoStack->index();
+    connect(m_undoStack, SIGNAL(indexChanged(int)), this, SLOT(undoStackIndexChanged(int)));
 }
 
 void CrossWordXmlGuiWindow::clueListContextMenuRequested(const QPoint &pos)
@@ -1660,6 +1789,8 @@ QDockWidget *CrossWordXmlGuiWindow::createUndoViewDock()
     m_undoViewDock = new QDockWidget(i18n("Edit History"), this);
     m_undoViewDock->setObjectName("undoViewDock");
     m_undoViewDock->setWidget(m_undoView);
+    connect(m_undoViewDock, SIGNAL(visibilityChanged(bool)),
+            this, SLOT(undoViewDockVisibilityChanged(bool)));
 
     return m_undoViewDock;
 }
@@ -1899,6 +2030,13 @@ void CrossWordXmlGuiWindow::autoSaveToTempFile()
         return;
     }
 
+    // Changes appended to the journal are saved already. The journal gets
+    // compacted by writing the whole crossword, when it has grown too long.
+    if (m_changeJournaled && m_journal->isOpen()
+            && m_journal->recordCount() < MAX_AUTOSAVE_JOURNAL_RECORDS) {
+        return;
+    }
+
     int secsSinceLastAutoSave = m_lastAutoSave.secsTo(QDateTime::currentDateTime());
     if (secsSinceLastAutoSave < MIN_SECS_BETWEEN_AUTOSAVES) {
         m_lastAutoSave = QDateTime();
@@ -1922,21 +2060,48 @@ void CrossWordXmlGuiWindow::autoSaveToTempFile()
         tmpFileName = m_curTmpFileName;
     }
 
-    bool writeOk = krossWord()->write(tmpFileName, &errorString,
-                                      KrossWord::Normal,
-                                      KrossWord::KrossWordPuzzleCompressedXmlFile,
-                                      m_undoStack->data());
+    // Copy a not yet loaded edit history without loading it
+    QByteArray undoData;
+    if (m_pendingUndoFileName.isEmpty()
+            || !KrossWordXmlReader::readUndoData(m_pendingUndoFileName, &undoData)) {
+        undoData = m_undoStack->data();
+    }
 
+    // Only a snapshot is taken here, it gets written in the background.
+    // Changes made while writing aren't journaled, they cause another
+    // automatic save.
+    bool writeOk = m_backgroundWriter->write(krossWord(), tmpFileName,
+                                             KrossWord::Normal, undoData,
+                                             KrossWord::FastWrite, &errorString);
     if (!writeOk) {
         qDebug() << "Error while automatically saving temporary file:" << errorString;
     } else {
-        qDebug() << "Saved crossword to temporary file.";
         m_lastAutoSave = QDateTime::currentDateTime();
+        m_journal->close();
 
-        if (m_curTmpFileName != tmpFileName) {
-            m_curTmpFileName = tmpFileName;
-            emit tempAutoSaveFileChanged(tmpFileName);
-        }
+        // Edits after the snapshot don't get merged into commands stored in it
+        m_undoStack->setMergeBarrier();
+    }
+}
+
+void CrossWordXmlGuiWindow::autoSaveWritten(const QString &fileName, bool ok,
+        const QString &errorString)
+{
+    if (!ok) {
+        qDebug() << "Error while automatically saving temporary file:" << errorString;
+        return;
+    } else if (m_modified == NoModification) {
+        // Saved or closed while writing
+        QFile::remove(fileName);
+        return;
+    }
+
+    qDebug() << "Saved crossword to temporary file.";
+    m_journal->open(fileName);
+
+    if (m_curTmpFileName != fileName) {
+        m_curTmpFileName = fileName;
+        emit tempAutoSaveFileChanged(fileName);
     }
 }
 
@@ -1951,8 +2116,14 @@ void CrossWordXmlGuiWindow::removeTempFile(const QString &fileName)
         return;
     }
 
+    if (m_pendingUndoFileName == m_curTmpFileName) {
+        loadUndoHistory(); // The edit history would get lost otherwise
+    }
+
     qDebug() << "remove temp file";
 
+    m_journal->close();
+    AutoSaveJournal::remove(m_curTmpFileName);
     QFile::remove(m_curTmpFileName);
     m_curTmpFileName.clear();
 
@@ -1971,6 +2142,7 @@ void CrossWordXmlGuiWindow::setCurrentFileName(const QString& fileName)
         m_undoViewDock->setEnabled(false);
         m_currentCellDock->setEnabled(false);
         m_undoStack->clear(); // This causes the modification flag to be set
+        m_pendingUndoFileName.clear();
         if (m_clueModel) {
             m_clueModel->clear();
         }
@@ -2003,6 +2175,7 @@ KrossWordPuzzleView *CrossWordXmlGuiWindow::createKrossWordPuzzleView()
     connect(view->krossWord(), SIGNAL(cluesAdded(ClueCellList)), this, SLOT(cluesAdded(ClueCellList)));
     connect(view->krossWord(), SIGNAL(cluesAboutToBeRemoved(ClueCellList)), this, SLOT(cluesAboutToBeRemoved(ClueCellList)));
     connect(view->krossWord(), SIGNAL(currentClueChanged(ClueCell*)), this, SLOT(currentClueChanged(ClueCell*)));
+    connect(view->krossWord(), SIGNAL(symmetryChanged(bool)), this, SLOT(symmetryChanged(bool)));
     connect(view->krossWord(), SIGNAL(answerChanged(ClueCell*, const QString&)), this, SLOT(answerChanged(ClueCell*, const QString&)));      // TODO: No slot?
     connect(view->krossWord(), SIGNAL(currentCellChanged(KrossWordCell*, KrossWordCell*)), this, SLOT(currentCellChanged(KrossWordCell*, KrossWordCell*)));
     connect(view->krossWord(), SIGNAL(letterEditRequest(LetterCell*, QChar, QChar)), this, SLOT(letterEditRequest(LetterCell*, QChar, QChar)));
@@ -2117,7 +2290,7 @@ void CrossWordXmlGuiWindow::solveSlot()
         }
         connect(krossWord(), SIGNAL(answerChanged(ClueCell*, const QString&)), this, SLOT(answerChanged(ClueCell*, const QString&)));
 
-        m_solutionProgress->setValue(100);
+        m_solutionProgress->setValue(m_solutionProgress->maximum());
     }
 }
 
@@ -2494,7 +2667,7 @@ void CrossWordXmlGuiWindow::currentClueChanged(ClueCell* clue)
 
 void CrossWordXmlGuiWindow::answerChanged(ClueCell* clue, const QString &currentAnswer, bool statusbar)
 {
-    m_solutionProgress->setValue(krossWord()->solutionProgress() * 100);
+    updateSolutionProgress();
 
     /* disabled because it doesn't permit to update the clue list after a Solve action
     if (clue != krossWord()->highlightedClue())
@@ -2512,6 +2685,16 @@ void CrossWordXmlGuiWindow::answerChanged(ClueCell* clue, const QString &current
     }
 }
 
+void CrossWordXmlGuiWindow::updateSolutionProgress()
+{
+    const KrossWord::Statistics stats = krossWord()->statistics();
+    m_solutionProgress->setMaximum(qMax(1, stats.letterCellCount));
+    m_solutionProgress->setValue(stats.filledLetterCells);
+    m_solutionProgress->setToolTip(i18n("Shows the percentage of solved letter "
+                                        "cells (%1 of %2)", stats.filledLetterCells,
+                                        stats.letterCellCount));
+}
+
 void CrossWordXmlGuiWindow::currentCellChanged(KrossWordCell* currentCell, KrossWordCell* previousCell)
 {
     if (!currentCell)
@@ -2754,7 +2937,10 @@ void CrossWordXmlGuiWindow::letterEditRequest(LetterCell* letter, const QChar &c
         }
     } else {
         letter->setCurrentLetter(newLetter);
+        m_journal->appendLetter(letter->coord(), newLetter);
+        m_changeJournaled = true;
         setModificationType(ModifiedState);
+        m_changeJournaled = false;
     }
 }
 
@@ -2814,7 +3000,6 @@ void CrossWordXmlGuiWindow::optionsDictionarySlot()
 
     QPointer<DictionaryDialog> dialog = new DictionaryDialog(m_dictionary, this);
     dialog->exec();
-    dialog->databaseTable()->submitAll();
     //m_dictionary->closeDatabase();
     delete dialog;
 }
@@ -34,12 +34,16 @@
 #include <QDateTime>
 
 #define MIN_SECS_BETWEEN_AUTOSAVES 30
+#define MAX_AUTOSAVE_JOURNAL_RECORDS 1000
 
 
 using namespace Crossword;
 
 class CurrentCellWidget;
 class KrosswordDictionary;
+class DeadSlotChecker;
+class AutoSaveJournal;
+class KrossWordBackgroundWriter;
 class KrossWordPuzzleView;
 class UndoStackExt;
 class ClueModel;
@@ -47,6 +51,7 @@ class ClueModel;
 class QStringListModel;
 class QStandardItemModel;
 class QProgressBar;
+class QLabel;
 class QStandardItem;
 class QTreeView;
 class QUndoView;
@@ -160,6 +165,7 @@ public:
         Edit_Properties,
         Edit_ClueNumberMapping,
         Edit_CheckRotationSymmetry,
+        Edit_SymmetricClueRemoval,
         Edit_Statistics,
         Edit_MoveCells,
 
@@ -299,6 +305,8 @@ public slots:
     void clearCrosswordSlot();
     void propertiesSlot();
     void editCheckRotationSymmetrySlot();
+    /** Shows whether or not the crossword is symmetric in the status bar. */
+    void symmetryChanged(bool symmetric);
     void editStatisticsSlot();
     void editClueNumberMappingSlot();
     void editMoveCellsSlot();
@@ -335,6 +343,8 @@ public slots:
 
     // Settings actions
     void updateTheme();
+    /** Applies the memory limit for the edit history from the settings. */
+    void updateUndoMemoryLimit();
     void optionsDictionarySlot();
 
     //void hideCongratulations();
@@ -345,9 +355,11 @@ public slots:
 
 protected slots:
     void unlockAndCallAutoSave();
+    void autoSaveWritten(const QString &fileName, bool ok, const QString &errorString);
 
     void signalChangeStatusbar(const QString &text);
     void undoStackIndexChanged(int index);
+    void undoViewDockVisibilityChanged(bool visible);
 
     void clueListContextMenuRequested(const QPoint &pos);
     void clickedClueInDock(const QModelIndex &index);
@@ -404,6 +416,8 @@ private:
     void setupPrinter(QPrinter &printer);
     void updateClueDock();
     void updateSolutionInToolBar();
+    /** Shows the cached KrossWord::statistics() in the solution progress bar. */
+    void updateSolutionProgress();
     QDockWidget *createClueDock();
     QDockWidget *createUndoViewDock();
     QDockWidget *createCurrentCellDock();
@@ -413,6 +427,12 @@ private:
     void enableActions(KrossWordCell* currentCell = NULL);
     void enableEditActions(KrossWordCell *currentCell = NULL);
 
+    /** Loads the edit history of the current file, if it wasn't loaded yet.
+    * Compressed files store it in an entry of it's own, which is only read
+    * when the history is needed, ie. before editing or when the edit
+    * history dock gets shown. */
+    void loadUndoHistory();
+
     void setModificationType(ModificationType modificationType, bool set = true);
     void setCurrentFileName(const QString &fileName = QString());
 
@@ -445,6 +465,7 @@ private:
     ZoomWidget *m_zoomWidget;                   // Owned
     ViewZoomController *m_zoomController;       // Owned
     QProgressBar *m_solutionProgress;           // Owned
+    QLabel *m_symmetryLabel;                    // Owned
 
     QDockWidget *m_clueDock;                    // Owned
     QDockWidget *m_undoViewDock;                // Owned
@@ -452,6 +473,8 @@ private:
 
     QUndoView *m_undoView;                      // Owned
     UndoStackExt *m_undoStack;                  // Owned
+    AutoSaveJournal *m_journal;                 // Owned
+    KrossWordBackgroundWriter *m_backgroundWriter; // Owned
     CurrentCellWidget *m_currentCellWidget;     // Owned
     QTreeView *m_clueTree;                      // Owned
     ClueModel *m_clueModel;                     // Owned
@@ -460,9 +483,12 @@ private:
     KrossWordCell *m_popupMenuCell;             // Not Owned
 
     KrosswordDictionary *m_dictionary;          // Owned
+    DeadSlotChecker *m_deadSlotChecker;         // Owned
 
     QDateTime m_lastAutoSave;
+    bool m_changeJournaled; // Whether the current change was appended to m_journal
     bool m_undoStackLoaded;
+    QString m_pendingUndoFileName; // File with an edit history that wasn't loaded yet
 
     QParallelAnimationGroup *m_animation;       // Owned
 
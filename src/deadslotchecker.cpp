@@ -0,0 +1,219 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "deadslotchecker.h"
+#include "dictionary.h"
+#include "dictionarysuggester.h"
+#include "cells/lettercell.h"
+
+#include <QTimer>
+
+DeadSlotChecker::DeadSlotChecker(KrossWord* krossWord,
+                                 KrosswordDictionary* dictionary, QObject* parent)
+    : QObject(parent), m_krossWord(krossWord), m_dictionary(dictionary),
+      m_suggester(0), m_countCache(4096), m_enabled(true)
+{
+    m_checkTimer = new QTimer(this);
+    m_checkTimer->setSingleShot(true);
+    m_checkTimer->setInterval(300);
+    connect(m_checkTimer, SIGNAL(timeout()), this, SLOT(checkDirtyClues()));
+
+    connect(krossWord, SIGNAL(cluesAdded(ClueCellList)),
+            this, SLOT(cluesAdded(ClueCellList)));
+    connect(krossWord, SIGNAL(cluesAboutToBeRemoved(ClueCellList)),
+            this, SLOT(cluesAboutToBeRemoved(ClueCellList)));
+    connect(krossWord, SIGNAL(editModeChanged(bool)),
+            this, SLOT(editModeChanged(bool)));
+
+    cluesAdded(krossWord->clues());
+}
+
+void DeadSlotChecker::setEnabled(bool enabled)
+{
+    if (m_enabled == enabled)
+        return;
+
+    m_enabled = enabled;
+    if (enabled)
+        recheckAll();
+    else
+        removeFlags();
+}
+
+void DeadSlotChecker::recheckAll()
+{
+    if (!isActive())
+        return;
+
+    foreach(ClueCell * clue, m_krossWord->clues())
+        m_dirtyClues.insert(clue);
+    m_checkTimer->start();
+}
+
+bool DeadSlotChecker::isActive() const
+{
+    return m_enabled && m_krossWord->isEditable() && m_dictionary->hasConnection();
+}
+
+DictionarySuggester* DeadSlotChecker::suggester()
+{
+    if (!m_suggester) {
+        m_suggester = m_dictionary->suggester();
+        connect(m_suggester, SIGNAL(patternsCounted(QStringList, QList<int>)),
+                this, SLOT(patternsCounted(QStringList, QList<int>)));
+        connect(m_suggester, SIGNAL(cacheCleared()),
+                this, SLOT(dictionaryCacheCleared()));
+    }
+    return m_suggester;
+}
+
+void DeadSlotChecker::cluesAdded(ClueCellList clues)
+{
+    foreach(ClueCell * clue, clues) {
+        connect(clue, SIGNAL(correctAnswerChanged(ClueCell*, QString)),
+                this, SLOT(clueChanged(ClueCell*)));
+        connect(clue, SIGNAL(answerLengthChanged(ClueCell*, int)),
+                this, SLOT(clueChanged(ClueCell*)));
+        clueChanged(clue);
+    }
+}
+
+void DeadSlotChecker::cluesAboutToBeRemoved(ClueCellList clues)
+{
+    foreach(ClueCell * clue, clues) {
+        disconnect(clue, 0, this, 0);
+        m_dirtyClues.remove(clue);
+        m_waitingClues.remove(clue);
+    }
+}
+
+void DeadSlotChecker::clueChanged(ClueCell* clue)
+{
+    if (!isActive())
+        return;
+
+    markDirty(clue);
+    m_checkTimer->start();
+}
+
+void DeadSlotChecker::editModeChanged(bool editable)
+{
+    if (editable)
+        recheckAll();
+    else
+        removeFlags();
+}
+
+void DeadSlotChecker::dictionaryCacheCleared()
+{
+    m_countCache.clear();
+    recheckAll();
+}
+
+void DeadSlotChecker::markDirty(ClueCell* clue)
+{
+    // Changing letters of an answer also changes the crossing answers
+    m_dirtyClues.insert(clue);
+    const Qt::Orientation crossingOrientation = clue->isHorizontal()
+            ? Qt::Vertical : Qt::Horizontal;
+    foreach(LetterCell * letter, clue->letters()) {
+        ClueCell *crossingClue = letter->clue(crossingOrientation);
+        if (crossingClue)
+            m_dirtyClues.insert(crossingClue);
+    }
+}
+
+void DeadSlotChecker::removeFlags()
+{
+    m_checkTimer->stop();
+    m_dirtyClues.clear();
+    m_waitingClues.clear();
+    foreach(ClueCell * clue, m_krossWord->clues())
+        clue->setCandidateCount(-1);
+}
+
+QString DeadSlotChecker::answerPattern(ClueCell* clue)
+{
+    return clue->correctAnswer().toUpper()
+           .replace(ClueCell::EmptyCorrectCharacter, '?');
+}
+
+void DeadSlotChecker::setCount(ClueCell* clue, int count)
+{
+    clue->setCandidateCount(count <= FEW_CANDIDATES ? count : -1);
+}
+
+void DeadSlotChecker::checkDirtyClues()
+{
+    if (!isActive()) {
+        m_dirtyClues.clear();
+        return;
+    }
+
+    // Clues still waiting for counts are requested again, because the new
+    // request cancels the previous one
+    QSet<ClueCell*> clues = m_dirtyClues + m_waitingClues;
+    m_dirtyClues.clear();
+    m_waitingClues.clear();
+
+    QStringList patterns;
+    QSet<QString> requestedPatterns;
+    foreach(ClueCell * clue, clues) {
+        const QString pattern = answerPattern(clue);
+        if (!pattern.contains('?')) {
+            // Complete answers aren't checked, they may be missing in the
+            // dictionary on purpose
+            clue->setCandidateCount(-1);
+            continue;
+        }
+
+        const int *count = m_countCache.object(pattern);
+        if (count) {
+            setCount(clue, *count);
+        } else {
+            m_waitingClues.insert(clue);
+            if (!requestedPatterns.contains(pattern)) {
+                requestedPatterns.insert(pattern);
+                patterns << pattern;
+            }
+        }
+    }
+
+    // Only need to know if there are more than FEW_CANDIDATES words
+    if (!patterns.isEmpty())
+        suggester()->requestCounts(patterns, FEW_CANDIDATES + 1);
+}
+
+void DeadSlotChecker::patternsCounted(const QStringList& patterns,
+                                      const QList<int>& counts)
+{
+    for (int i = 0; i < counts.count(); ++i)
+        m_countCache.insert(patterns[i], new int(counts[i]));
+
+    QSet<ClueCell*>::iterator it = m_waitingClues.begin();
+    while (it != m_waitingClues.end()) {
+        const int *count = m_countCache.object(answerPattern(*it));
+        if (count) {
+            setCount(*it, *count);
+            it = m_waitingClues.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
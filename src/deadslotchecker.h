@@ -0,0 +1,96 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef DEADSLOTCHECKER_H
+#define DEADSLOTCHECKER_H
+
+#include "krossword.h"
+#include "cells/cluecell.h"
+
+#include <QObject>
+#include <QSet>
+#include <QCache>
+
+using namespace Crossword;
+
+class QTimer;
+class KrosswordDictionary;
+class DictionarySuggester;
+
+/** Flags answers, that no or only a few dictionary words fit into, while
+* editing a crossword.
+*
+* When the correct answer of a clue changes, only that clue and the clues
+* crossing it get checked again. Checks are started after a short delay
+* without further changes and the words are counted in the background thread
+* of the @ref DictionarySuggester, so that typing isn't slowed down. Counts
+* are cached by answer pattern. The result is shown using
+* @ref ClueCell::setCandidateCount(). */
+class DeadSlotChecker : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** Answers with at most this many fitting words get flagged. */
+    static const int FEW_CANDIDATES = 3;
+
+    DeadSlotChecker(KrossWord *krossWord, KrosswordDictionary *dictionary,
+                    QObject *parent = 0);
+
+    bool isEnabled() const {
+        return m_enabled;
+    };
+    /** Enables or disables checking. Disabling removes all flags. */
+    void setEnabled(bool enabled);
+
+public slots:
+    /** Checks all clues again, eg. after the dictionary has changed. */
+    void recheckAll();
+
+private slots:
+    void cluesAdded(ClueCellList clues);
+    void cluesAboutToBeRemoved(ClueCellList clues);
+    void clueChanged(ClueCell *clue);
+    void editModeChanged(bool editable);
+    void dictionaryCacheCleared();
+
+    void checkDirtyClues();
+    void patternsCounted(const QStringList &patterns, const QList<int> &counts);
+
+private:
+    bool isActive() const;
+    DictionarySuggester *suggester();
+    /** Marks @p clue and all clues crossing it to be checked again. */
+    void markDirty(ClueCell *clue);
+    void removeFlags();
+    /** The correct answer of @p clue with '?' for empty letters. */
+    static QString answerPattern(ClueCell *clue);
+    void setCount(ClueCell *clue, int count);
+
+    KrossWord *m_krossWord;
+    KrosswordDictionary *m_dictionary;
+    DictionarySuggester *m_suggester; // Created on first use
+    QTimer *m_checkTimer;
+    QSet<ClueCell*> m_dirtyClues;
+    QSet<ClueCell*> m_waitingClues; // Waiting for counts of their patterns
+    QCache<QString, int> m_countCache;
+    bool m_enabled;
+};
+
+#endif // DEADSLOTCHECKER_H
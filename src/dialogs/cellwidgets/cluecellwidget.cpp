@@ -21,19 +21,17 @@
 #include "../../cells/cluecell.h"
 #include "../../krossword.h"
 #include "../../dictionary.h"
-#include "../../extendedsqltablemodel.h"
 #include "../../htmldelegate.h"
 
 #include <QWidgetAction>
 #include <QMenu>
+#include <QStandardItemModel>
 
 #include <KCharSelect>
 
-#include <QSqlError>
-
 ClueCellWidget::ClueCellWidget(ClueCell* clueCell,
                                KrosswordDictionary *dictionary, QWidget* parent)
-    : QWidget(parent), m_clueCell(0)
+    : QWidget(parent), m_clueCell(0), m_suggester(0), m_dictionaryAnswersModel(0)
 {
     Q_ASSERT(clueCell);
 
@@ -98,13 +96,14 @@ ClueCellWidget::ClueCellWidget(ClueCell* clueCell,
     if (dictionary->isEmpty()) {
         ui_clue_properties_dock.grpDictionary->setVisible(false);
     } else {
-        ExtendedSqlTableModel *model = dictionary->createModel();
-        if (!model->select())
-            qDebug() << "Select failed" << model->lastError();
-        else {
-            ui_clue_properties_dock.dictionaryAnswers->setModel(model);
-            ui_clue_properties_dock.dictionaryAnswers->setModelColumn(1);
-        }
+        // Answers are looked up in a background thread, to not block while
+        // navigating through the clues
+        m_suggester = dictionary->suggester();
+        connect(m_suggester, SIGNAL(suggestionsReady(DictionaryQuery, DictionaryEntryList)),
+                this, SLOT(dictionarySuggestionsReady(DictionaryQuery, DictionaryEntryList)));
+
+        m_dictionaryAnswersModel = new QStandardItemModel(this);
+        ui_clue_properties_dock.dictionaryAnswers->setModel(m_dictionaryAnswersModel);
     }
 
     QMenu *menu = new QMenu;
@@ -132,6 +131,14 @@ ClueCellWidget::ClueCellWidget(ClueCell* clueCell,
     connect(onlyShowFirst100AnswersAction, SIGNAL(toggled(bool)),
             this, SLOT(resetDictionaryFilter(bool)));
 
+    QAction *rankByCrossingsAction = new QAction(
+        i18n("&Rank Answers by Fitting Crossing Answers"), this);
+    rankByCrossingsAction->setCheckable(true);
+    rankByCrossingsAction->setChecked(true);
+    rankByCrossingsAction->setObjectName("rankByCrossingsAction");
+    connect(rankByCrossingsAction, SIGNAL(toggled(bool)),
+            this, SLOT(resetDictionaryFilter(bool)));
+
 //     QAction *sortByAnswerAction = new QAction( i18n("Sort By &Answer"), this );
 //     sortByAnswerAction->setCheckable( true );
 //     sortByAnswerAction->setChecked( true );
@@ -154,6 +161,7 @@ ClueCellWidget::ClueCellWidget(ClueCell* clueCell,
     menuActions << onlyAnswersWithCurrentAnswerLengthAction;
     menuActions << onlyAnswersWithClueAction;
     menuActions << onlyShowFirst100AnswersAction;
+    menuActions << rankByCrossingsAction;
 //     menuActions << separator;
 //     menuActions << sortByAnswerAction;
 //     menuActions << sortByAnswerLengthAction;
@@ -177,7 +185,7 @@ ClueCellWidget::ClueCellWidget(ClueCell* clueCell,
     connect(ui_clue_properties_dock.pattern, SIGNAL(returnPressed()),
             this, SLOT(searchDictionaryClicked()));
     connect(ui_clue_properties_dock.pattern, SIGNAL(textEdited(QString)),
-            this, SLOT(searchDictionaryClicked()));
+            this, SLOT(dictionaryPatternEdited()));
     connect(ui_clue_properties_dock.dictionaryAnswers, SIGNAL(activated(QModelIndex)),
             this, SLOT(setAsCorrectAnswer(QModelIndex)));
 }
@@ -187,6 +195,10 @@ void ClueCellWidget::setClue(ClueCell *clueCell)
     if (m_clueCell == clueCell)
         return;
 
+    // Results for the previous clue aren't needed any longer
+    if (m_suggester)
+        m_suggester->cancel();
+
     if (m_clueCell) {
         disconnect(m_clueCell->krossWord(),
                    SIGNAL(cluesAboutToBeRemoved(ClueCellList)),
@@ -490,6 +502,48 @@ void ClueCellWidget::searchDictionaryClicked(bool forceFilterReset)
     m_lastDictionaryPattern = ui_clue_properties_dock.pattern->text();
 }
 
+void ClueCellWidget::dictionaryPatternEdited()
+{
+    if (m_lastDictionaryPattern == ui_clue_properties_dock.pattern->text())
+        return;
+
+    // Wait until typing pauses before querying the dictionary
+    dictionaryFilterString(ui_clue_properties_dock.pattern->text(),
+                           m_clueCell->maxAnswerLength(), true);
+    m_lastDictionaryPattern = ui_clue_properties_dock.pattern->text();
+}
+
+void ClueCellWidget::dictionarySuggestionsReady(const DictionaryQuery& query,
+        const DictionaryEntryList& entries)
+{
+    if (query.key() != m_dictionaryQueryKey)
+        return; // Results for another clue cell widget
+
+    m_dictionaryAnswersModel->clear();
+    foreach(const DictionaryEntry & entry, entries) {
+        QStandardItem *item;
+        if (entry.crossingFits == -1) {
+            item = new QStandardItem(entry.word);
+            item->setToolTip(entry.clue);
+        } else {
+            item = new QStandardItem(i18nc("A suggested answer and the number of "
+                                           "dictionary words still fitting into "
+                                           "it's tightest crossing answer",
+                                           "%1 (%2)", entry.word, entry.crossingFits));
+            item->setToolTip(i18n("%1<br/>Fitting words for the tightest crossing "
+                                  "answer: %2", entry.clue, entry.crossingFits));
+            if (entry.crossingFits == 0) {
+                // Dead end, no word fits into a crossing answer
+                item->setForeground(palette().color(QPalette::Disabled, QPalette::Text));
+            }
+        }
+        item->setData(entry.word, WordRole);
+        item->setData(entry.clue, ClueRole);
+        item->setEditable(false);
+        m_dictionaryAnswersModel->appendRow(item);
+    }
+}
+
 void ClueCellWidget::fillDictionaryAnswers()
 {
     if (!ui_clue_properties_dock.grpDictionary->isVisible())
@@ -516,19 +570,13 @@ void ClueCellWidget::fillDictionaryAnswers()
 }
 
 void ClueCellWidget::dictionaryFilterString(const QString& wildcardPattern,
-        int maxLength)
+        int maxLength, bool delayed)
 {
-    ExtendedSqlTableModel *model = qobject_cast< ExtendedSqlTableModel* >(
-                                       ui_clue_properties_dock.dictionaryAnswers->model());
-    if (model) {
-        QString mysqlPattern = wildcardPattern;
-        mysqlPattern.replace('?', '_').replace('*', '%');
-        if (mysqlPattern.isEmpty())
-            mysqlPattern = '%';
-
+    if (m_suggester) {
         // Get checked settings from the menu settings button
         bool onlyAnswersWithClueAction = false;
         bool onlyShowFirst100AnswersAction = false;
+        bool rankByCrossingsAction = false;
         m_onlyAnswersWithCurrentAnswerLengthAction = false;
         QMenu *menu = ui_clue_properties_dock.patternSettings->menu();
         if (menu) {
@@ -542,27 +590,47 @@ void ClueCellWidget::dictionaryFilterString(const QString& wildcardPattern,
                     onlyShowFirst100AnswersAction = true;
                 else if (action->objectName() == "onlyAnswersWithCurrentAnswerLengthAction")
                     m_onlyAnswersWithCurrentAnswerLengthAction = true;
+                else if (action->objectName() == "rankByCrossingsAction")
+                    rankByCrossingsAction = true;
             }
         }
 
-        QString filterString = QString("word LIKE '%1'").arg(mysqlPattern);
-
-        if (m_onlyAnswersWithCurrentAnswerLengthAction) {
-            filterString.append(QString(" AND CHAR_LENGTH(word) = %2").arg(
-                                    m_clueCell->answerLength()));
-        } else if (maxLength != -1) {
-            filterString.append(QString(" AND CHAR_LENGTH(word) <= %2").arg(maxLength));
-        }
+        DictionaryQuery query;
+        query.pattern = wildcardPattern;
+        if (m_onlyAnswersWithCurrentAnswerLengthAction)
+            query.length = m_clueCell->answerLength();
+        else
+            query.maxLength = maxLength;
+        query.onlyWithClue = onlyAnswersWithClueAction;
+        if (onlyShowFirst100AnswersAction)
+            query.limit = 100;
+
+        if (rankByCrossingsAction) {
+            // Get the current answers of crossing clues, candidates get ranked
+            // by how many words still fit into them
+            const Qt::Orientation crossingOrientation = m_clueCell->isHorizontal()
+                    ? Qt::Vertical : Qt::Horizontal;
+            LetterCellList letters = m_clueCell->letters();
+            for (int i = 0; i < letters.count(); ++i) {
+                ClueCell *crossingClue = letters[i]->clue(crossingOrientation);
+                if (!crossingClue)
+                    continue;
 
-        if (onlyAnswersWithClueAction)
-            filterString.append(" AND clue IS NOT NULL AND clue != ''");
+                DictionaryCrossing crossing;
+                crossing.position = i;
+                crossing.crossingPosition = crossingClue->posOfLetter(letters[i]);
+                crossing.pattern = crossingClue->correctAnswer().toUpper();
+                crossing.pattern.replace(ClueCell::EmptyCorrectCharacter, '?');
+                if (crossing.crossingPosition < 0
+                        || crossing.crossingPosition >= crossing.pattern.length())
+                    continue;
 
-        if (onlyShowFirst100AnswersAction)
-            model->setLimit(0, 100);
-        else
-            model->removeLimit();
+                query.crossings << crossing;
+            }
+        }
 
-        model->setFilter(filterString);
+        m_dictionaryQueryKey = query.key();
+        m_suggester->request(query, delayed);
     }
 }
 
@@ -571,9 +639,8 @@ void ClueCellWidget::setAsCorrectAnswer(const QModelIndex& index)
     if (!index.isValid())
         return;
 
-    QString text = index.data().toString();
-    QString clue = ui_clue_properties_dock.dictionaryAnswers->model()->index(
-                       index.row(), 2).data().toString();
+    QString text = index.data(WordRole).toString();
+    QString clue = index.data(ClueRole).toString();
 
     int actualLength = m_clueCell->setAnswerLength(text.length());
     text = text.left(actualLength);
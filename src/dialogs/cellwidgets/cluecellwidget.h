@@ -23,7 +23,9 @@
 #include <QtWidgets/QWidget>
 #include "ui_clue_properties_dock.h"
 #include <global.h>
+#include "../../dictionarysuggester.h"
 
+class QStandardItemModel;
 class KrosswordDictionary;
 namespace Crossword
 {
@@ -69,21 +71,34 @@ protected slots:
     void clueTextEdited(const QString &text);
     void charSelected(const QChar &ch);
     void searchDictionaryClicked(bool forceFilterReset = false);
+    void dictionaryPatternEdited();
+    void dictionarySuggestionsReady(const DictionaryQuery &query,
+                                    const DictionaryEntryList &entries);
     void setAsCorrectAnswer(const QModelIndex &index);
     void resetDictionaryFilter(bool);
 
 private:
+    /** The model role for the clue of a suggested dictionary answer. */
+    static const int ClueRole = Qt::UserRole + 1;
+    /** The model role for the suggested answer, the display text may also
+    * contain it's rank. */
+    static const int WordRole = Qt::UserRole + 2;
+
     void enableAnswerOffsets();
     void showAnswerOffsets(bool show);
     void enableOrientations();
 
     void fillDictionaryAnswers();
-    void dictionaryFilterString(const QString &wildcardPattern, int maxLength = -1);
+    void dictionaryFilterString(const QString &wildcardPattern, int maxLength = -1,
+                                bool delayed = false);
 
     Ui::clue_properties_dock ui_clue_properties_dock;
     ClueCell *m_clueCell;
     QButtonGroup *m_btnGroupAnswerOffset;
     QMenu *m_cluePropertiesCharMenu;
+    DictionarySuggester *m_suggester;
+    QStandardItemModel *m_dictionaryAnswersModel;
+    QString m_dictionaryQueryKey;
     QString m_lastDictionaryPattern;
     bool m_onlyAnswersWithCurrentAnswerLengthAction;
 };
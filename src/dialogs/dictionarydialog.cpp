@@ -18,7 +18,7 @@
 */
 
 #include "dictionarydialog.h"
-#include "extendedsqltablemodel.h"
+#include "dictionarybrowsermodel.h"
 #include "htmldelegate.h"
 #include "dictionary.h"
 
@@ -31,6 +31,10 @@
 #include <QPointer>
 #include <QStandardPaths>
 #include <QFileDialog>
+#include <QApplication>
+
+#include <algorithm>
+#include <functional>
 
 DictionaryDialog::DictionaryDialog(KrosswordDictionary* dictionary, QWidget* parent)
     : QDialog(parent), m_dictionary(dictionary), m_infoMessage(0)
@@ -48,15 +52,17 @@ DictionaryDialog::DictionaryDialog(KrosswordDictionary* dictionary, QWidget* par
     ui_dictionaries.clear->setIcon(QIcon::fromTheme(QStringLiteral("edit-clear")));
     ui_dictionaries.importFromCSV->setIcon(QIcon::fromTheme(QStringLiteral("document-import")));
     ui_dictionaries.exportToCSV->setIcon(QIcon::fromTheme(QStringLiteral("document-export")));
+    ui_dictionaries.createSnapshot->setIcon(QIcon::fromTheme(QStringLiteral("document-save")));
 
-    m_dbTable = m_dictionary->createModel();
+    m_dbTable = m_dictionary->createBrowserModel(this);
     m_dbTable->select();
 
     ui_dictionaries.tableDictionary->setModel(m_dbTable);
-    ui_dictionaries.tableDictionary->hideColumn(0);   // Hide id
-    ui_dictionaries.tableDictionary->hideColumn(3);   // Hide score
-    ui_dictionaries.tableDictionary->hideColumn(4);   // Hide language
-    ui_dictionaries.tableDictionary->setItemDelegateForColumn(1, new CrosswordAnswerDelegate);  // Set delegate for column 'answer'
+    ui_dictionaries.tableDictionary->hideColumn(DictionaryBrowserModel::IdColumn);
+    ui_dictionaries.tableDictionary->hideColumn(DictionaryBrowserModel::ScoreColumn);
+    ui_dictionaries.tableDictionary->hideColumn(DictionaryBrowserModel::LanguageColumn);
+    ui_dictionaries.tableDictionary->setItemDelegateForColumn(
+        DictionaryBrowserModel::WordColumn, new CrosswordAnswerDelegate);
     ui_dictionaries.removeEntries->setDisabled(true);
 
     connect(ui_dictionaries.addEntry, SIGNAL(clicked()),
@@ -75,6 +81,10 @@ DictionaryDialog::DictionaryDialog(KrosswordDictionary* dictionary, QWidget* par
             this, SLOT(importFromCsvClicked()));
     connect(ui_dictionaries.exportToCSV, SIGNAL(clicked()),
             this, SLOT(exportToCsvClicked()));
+    connect(ui_dictionaries.createSnapshot, SIGNAL(clicked()),
+            this, SLOT(createSnapshotClicked()));
+    connect(m_dictionary, SIGNAL(snapshotExported(bool, QString)),
+            this, SLOT(snapshotExported(bool, QString)));
     connect(ui_dictionaries.filter, SIGNAL(textChanged(QString)),
             this, SLOT(filterChanged(QString)));
     connect(ui_dictionaries.tableDictionary->selectionModel(),
@@ -94,8 +104,8 @@ void DictionaryDialog::tableSelectionChanged(const QItemSelection& selected,
 void DictionaryDialog::addEntryClicked()
 {
     int row = m_dbTable->rowCount();
-    if (m_dbTable->insertRecord(row, m_dbTable->record())) {
-        QModelIndex index = m_dbTable->index(row, 0);
+    if (m_dbTable->insertRow(row)) {
+        QModelIndex index = m_dbTable->index(row, DictionaryBrowserModel::WordColumn);
         ui_dictionaries.tableDictionary->setCurrentIndex(index);
         ui_dictionaries.tableDictionary->scrollToBottom();
     }
@@ -189,7 +199,7 @@ void DictionaryDialog::addDictionaryFromLibraryClicked()
 
 void DictionaryDialog::addDictionaryFromCrosswordsClicked()
 {
-    QStringList fileNames = QFileDialog::getOpenFileNames(this, "", "", i18n("Crosswords (*.kwp *.kwpz *.puz)")); //CHECK: to test
+    QStringList fileNames = QFileDialog::getOpenFileNames(this, "", "", i18n("Crosswords (*.kwp *.kwpz *.kwpb *.puz)")); //CHECK: to test
     if (fileNames.isEmpty()) {
         return;
     }
@@ -207,10 +217,17 @@ void DictionaryDialog::removeEntriesClicked()
     if (selectedRows.isEmpty())
         return;
 
+    // Remove from the last to the first row, to keep the row numbers valid
+    QList<int> rows;
     foreach(const QModelIndex & index, selectedRows)
-    m_dbTable->removeRow(index.row());
+    rows << index.row();
+    std::sort(rows.begin(), rows.end(), std::greater<int>());
+
+    bool ok = true;
+    foreach(int row, rows)
+    ok = m_dbTable->removeRow(row) && ok;
 
-    if (!m_dbTable->submitAll())
+    if (!ok)
         showInfoMessage(i18n("Couldn't submit removed entries to the database: %1",
                              m_dbTable->lastError().text()));
     else
@@ -241,6 +258,23 @@ void DictionaryDialog::exportToCsvClicked()
     }
 }
 
+void DictionaryDialog::createSnapshotClicked()
+{
+    ui_dictionaries.createSnapshot->setEnabled(false);
+    showInfoMessage(i18n("Creating the snapshot..."));
+    m_dictionary->exportSnapshot();
+}
+
+void DictionaryDialog::snapshotExported(bool ok, const QString& errorString)
+{
+    ui_dictionaries.createSnapshot->setEnabled(true);
+    if (!ok) {
+        showInfoMessage(i18n("There was an error while creating the snapshot: %1", errorString));
+    } else {
+        showInfoMessage(i18n("Snapshot created, it gets used until the dictionary is changed"));
+    }
+}
+
 void DictionaryDialog::importFromCsvClicked()
 {
     QString fileName = QFileDialog::getOpenFileName(this,
@@ -260,8 +294,7 @@ void DictionaryDialog::importFromCsvClicked()
 
 void DictionaryDialog::filterChanged(const QString& filter)
 {
-    m_dbTable->submitAll(); // submit possible changes
-    m_dbTable->setFilter(QString("word LIKE '%%1%'").arg(filter));
+    m_dbTable->setSubstringFilter(filter);
 }
 
 
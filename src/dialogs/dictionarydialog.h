@@ -23,7 +23,7 @@
 #include "ui_dictionaries.h"
 #include <QDialog>
 
-class ExtendedSqlTableModel;
+class DictionaryBrowserModel;
 class KrosswordDictionary;
 
 class DictionaryDialog : public QDialog
@@ -33,7 +33,7 @@ class DictionaryDialog : public QDialog
 public:
     explicit DictionaryDialog(KrosswordDictionary *dictionary, QWidget* parent = 0);
 
-    ExtendedSqlTableModel *databaseTable() const {
+    DictionaryBrowserModel *databaseTable() const {
         return m_dbTable;
     };
 
@@ -48,6 +48,8 @@ protected slots:
     void clearClicked();
     void importFromCsvClicked();
     void exportToCsvClicked();
+    void createSnapshotClicked();
+    void snapshotExported(bool ok, const QString &errorString);
     void filterChanged(const QString &filter);
     void hideInfoMessage();
 
@@ -56,7 +58,7 @@ private:
 
     Ui::dictionaries ui_dictionaries;
     KrosswordDictionary *m_dictionary;
-    ExtendedSqlTableModel *m_dbTable;
+    DictionaryBrowserModel *m_dbTable;
     QLabel *m_infoMessage;
 };
 
@@ -67,6 +67,10 @@ void StatisticsDialog::setup()
         layout->addWidget(hLine, row++, 0, 1, 2);
 
         if (stats.letterCellCount > 0) {
+            addStatisticsValue(layout, i18n("Filled:"),
+                               stats.filledLetterCells, stats.letterCellCount,
+                               i18n("Number of filled letter cells, percentage of total "
+                                    "letter cell count in braces"));
             addStatisticsValue(layout, i18n("Crossed:"),
                                stats.crossedLetterCells, stats.letterCellCount,
                                i18n("Number of crossed letter cells, percentage of total "
@@ -21,9 +21,13 @@
 #include "krossword.h"
 #include "cells/cluecell.h"
 #include "extendedsqltablemodel.h"
+#include "dictionarybrowsermodel.h"
+#include "dictionarysuggester.h"
+#include "dictionarysnapshot.h"
 #include "htmldelegate.h"
 
 #include <QFile>
+#include <QFileInfo>
 #include <QTextStream>
 #include <QRegExp>
 #include <QSqlDatabase>
@@ -39,6 +43,8 @@
 #include <QDialog>
 #include <QPointer>
 #include <QSqlError>
+#include <QStandardPaths>
+#include <QDir>
 
 using namespace Crossword;
 
@@ -47,13 +53,19 @@ const QString KrosswordDictionary::CONNECTION_NAME = "krosswordpuzzle";
 KrosswordDictionary::KrosswordDictionary(QObject* parent)
     : QObject(parent),
       m_cancel(false),
-      m_hasConnection(makeStandardConnection())
+      m_hasConnection(makeStandardConnection()),
+      m_hasTrigramIndex(false),
+      m_entriesGeneration(0),
+      m_suggester(0)
 {
     if (m_hasConnection) {
         qDebug() << "Database ready";
+        upgradeDatabase();
     } else {
         qDebug() << "Database has not been setted up yet";
     }
+
+    loadSnapshot();
 }
 
 KrosswordDictionary::~KrosswordDictionary()
@@ -74,6 +86,31 @@ bool KrosswordDictionary::makeStandardConnection()
     return db.open();
 }
 
+void KrosswordDictionary::upgradeDatabase()
+{
+    if (getDatabase().tables().contains("dictionary_trigram")) {
+        m_hasTrigramIndex = true;
+        return;
+    }
+
+    // Databases created by older versions don't have the trigram index yet.
+    // Building it takes long for big dictionaries, so don't block the GUI.
+    qDebug() << "Building trigram index for existing dictionary entries";
+    connect(suggester(), SIGNAL(databaseUpgraded(bool)),
+            this, SLOT(databaseUpgraded(bool)), Qt::UniqueConnection);
+    suggester()->upgradeDatabase();
+}
+
+void KrosswordDictionary::databaseUpgraded(bool ok)
+{
+    if (!ok)
+        return;
+
+    // Index entries that were added while the index was built
+    indexNewEntries(getDatabase());
+    m_hasTrigramIndex = true;
+}
+
 QSqlDatabase KrosswordDictionary::getDatabase() const
 {
     QSqlDatabase db;
@@ -103,6 +140,8 @@ bool KrosswordDictionary::openDatabase(QWidget *dlgParent)
          if (setupDatabase(dlgParent)) {
             m_hasConnection = makeStandardConnection();
             qDebug() << "Database opened";
+            if (m_hasConnection)
+                upgradeDatabase();
          } else {
             success = false;
             qDebug() << "Unable to open database";
@@ -221,10 +260,132 @@ bool KrosswordDictionary::createTables()
                     "UNIQUE (word)) ENGINE = InnoDB DEFAULT CHARSET = utf8;");
     if (!ok)
         qDebug() << "Couldn't create table" << query.lastError();
+    else
+        ok = createTrigramIndex(db);
 
     return ok;
 }
 
+bool KrosswordDictionary::createTrigramIndex(QSqlDatabase db)
+{
+    if (!db.isOpen())
+        return false;
+
+    if (db.tables().contains("dictionary_trigram"))
+        return true;
+
+    // Maps each trigram to the ids of the words containing it, to look up
+    // substrings without scanning the whole dictionary table
+    QSqlQuery query(db);
+    if (!query.exec("CREATE TABLE dictionary_trigram ( " \
+                    "trigram CHAR (3) NOT NULL, " \
+                    "word_id INTEGER NOT NULL, " \
+                    "PRIMARY KEY(trigram, word_id), " \
+                    "INDEX (word_id), " \
+                    "FOREIGN KEY (word_id) REFERENCES dictionary(id) ON DELETE CASCADE) " \
+                    "ENGINE = InnoDB DEFAULT CHARSET = utf8;")) {
+        qDebug() << "Couldn't create trigram index table" << query.lastError();
+        return false;
+    }
+
+    return indexNewEntries(db);
+}
+
+QStringList KrosswordDictionary::trigrams(const QString& word)
+{
+    QStringList list;
+    const QString upperWord = word.toUpper();
+    for (int i = 0; i + TRIGRAM_LENGTH <= upperWord.length(); ++i) {
+        const QString trigram = upperWord.mid(i, TRIGRAM_LENGTH);
+        if (!list.contains(trigram))
+            list << trigram;
+    }
+    return list;
+}
+
+bool KrosswordDictionary::updateTrigramIndex(int id, const QString& word)
+{
+    QSqlDatabase db = QSqlDatabase::database(CONNECTION_NAME);
+    if (!db.isOpen() || !m_hasTrigramIndex)
+        return false; // The index gets built from the current words later
+
+    QSqlQuery query(db);
+    query.prepare("DELETE FROM dictionary_trigram WHERE word_id = ?");
+    query.addBindValue(id);
+    if (!query.exec()) {
+        qDebug() << "Couldn't remove old trigrams" << query.lastError();
+        return false;
+    }
+
+    QVariantList trigramValues, idValues;
+    foreach(const QString & trigram, trigrams(word)) {
+        trigramValues << trigram;
+        idValues << id;
+    }
+    if (trigramValues.isEmpty())
+        return true;
+
+    query.prepare("INSERT IGNORE INTO dictionary_trigram (trigram, word_id) VALUES (?, ?)");
+    query.addBindValue(trigramValues);
+    query.addBindValue(idValues);
+    if (!query.execBatch()) {
+        qDebug() << "Couldn't add trigrams" << query.lastError();
+        return false;
+    }
+    return true;
+}
+
+bool KrosswordDictionary::indexNewEntries(QSqlDatabase db)
+{
+    if (!db.isOpen())
+        return false;
+
+    // Entries are only added, so everything above the highest indexed id is
+    // new. Words shorter than a trigram have no rows and get checked again.
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT id, word FROM dictionary WHERE id > "
+                    "(SELECT COALESCE(MAX(word_id), 0) FROM dictionary_trigram)")) {
+        qDebug() << "Couldn't read new dictionary entries" << query.lastError();
+        return false;
+    }
+
+    QSqlQuery insertQuery(db);
+    insertQuery.prepare("INSERT IGNORE INTO dictionary_trigram (trigram, word_id) VALUES (?, ?)");
+    QVariantList trigramValues, idValues;
+    bool ok = true;
+
+    db.transaction();
+    while (query.next()) {
+        const int id = query.value(0).toInt();
+        foreach(const QString & trigram, trigrams(query.value(1).toString())) {
+            trigramValues << trigram;
+            idValues << id;
+        }
+
+        // Insert chunks of 1000 trigrams into the database
+        if (trigramValues.count() > 1000) {
+            insertQuery.addBindValue(trigramValues);
+            insertQuery.addBindValue(idValues);
+            ok = insertQuery.execBatch() && ok;
+            trigramValues.clear();
+            idValues.clear();
+        }
+    }
+
+    // Insert the remaining trigrams (< 1000)
+    if (!trigramValues.isEmpty()) {
+        insertQuery.addBindValue(trigramValues);
+        insertQuery.addBindValue(idValues);
+        ok = insertQuery.execBatch() && ok;
+    }
+    db.commit();
+
+    if (!ok)
+        qDebug() << "Couldn't add trigrams" << insertQuery.lastError();
+    return ok;
+}
+
 bool KrosswordDictionary::hasConnection() const {
     return m_hasConnection;
 }
@@ -248,6 +409,109 @@ ExtendedSqlTableModel* KrosswordDictionary::createModel()
     return dbTable;
 }
 
+DictionarySuggester* KrosswordDictionary::suggester()
+{
+    if (!m_suggester) {
+        QSqlDatabase db = getDatabase();
+        m_suggester = new DictionarySuggester(db.driverName(), db.hostName(),
+                                              db.databaseName(), db.userName(),
+                                              db.password(), this);
+        m_suggester->setSnapshot(m_snapshot);
+    }
+    return m_suggester;
+}
+
+void KrosswordDictionary::entriesChanged()
+{
+    ++m_entriesGeneration;
+
+    // The snapshot is outdated now, remove it so that it doesn't get loaded
+    // again on the next start. Processes that have it mapped keep their copy.
+    if (m_snapshot) {
+        m_snapshot.clear();
+        QFile::remove(defaultSnapshotFileName());
+    }
+
+    if (m_suggester) {
+        m_suggester->setSnapshot(m_snapshot);
+        m_suggester->clearCache();
+    }
+}
+
+void KrosswordDictionary::entriesAdded()
+{
+    if (m_hasTrigramIndex)
+        indexNewEntries(getDatabase());
+    entriesChanged();
+}
+
+QString KrosswordDictionary::defaultSnapshotFileName()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::DataLocation)
+           + "/dictionary.kwdawg";
+}
+
+void KrosswordDictionary::exportSnapshot(const QString& fileName)
+{
+    const QString snapshotFileName = fileName.isEmpty()
+                                     ? defaultSnapshotFileName() : fileName;
+    connect(suggester(), SIGNAL(snapshotExported(int, QString, bool, QString)),
+            this, SLOT(snapshotWritten(int, QString, bool, QString)),
+            Qt::UniqueConnection);
+    suggester()->exportSnapshot(m_entriesGeneration, snapshotFileName);
+}
+
+void KrosswordDictionary::snapshotWritten(int requestId, const QString& fileName,
+        bool ok, const QString& errorString)
+{
+    if (!ok) {
+        emit snapshotExported(false, errorString);
+        return;
+    }
+
+    // Don't use snapshots of entries, that were changed while writing it
+    if (requestId != m_entriesGeneration) {
+        QFile::remove(fileName);
+        emit snapshotExported(false, i18n("The dictionary was changed while "
+                                          "creating the snapshot"));
+        return;
+    }
+
+    if (!loadSnapshot(fileName)) {
+        emit snapshotExported(false, i18n("The snapshot couldn't be opened"));
+        return;
+    }
+
+    emit snapshotExported(true, QString());
+}
+
+bool KrosswordDictionary::loadSnapshot(const QString& fileName)
+{
+    const QString snapshotFileName = fileName.isEmpty()
+                                     ? defaultSnapshotFileName() : fileName;
+    if (!QFile::exists(snapshotFileName))
+        return false;
+
+    DictionarySnapshot *snapshot = new DictionarySnapshot;
+    if (!snapshot->open(snapshotFileName)) {
+        delete snapshot;
+        return false;
+    }
+
+    qDebug() << "Mapped dictionary snapshot" << snapshotFileName
+             << "with" << snapshot->wordCount() << "words";
+    m_snapshot = QSharedPointer<const DictionarySnapshot>(snapshot);
+    if (m_suggester)
+        m_suggester->setSnapshot(m_snapshot);
+    return true;
+}
+
+DictionaryBrowserModel* KrosswordDictionary::createBrowserModel(QObject *parent)
+{
+    QSqlDatabase db = QSqlDatabase::database(CONNECTION_NAME);
+    return new DictionaryBrowserModel(this, db, parent ? parent : this);
+}
+
 bool KrosswordDictionary::exportToCsv(const QString& fileName)
 {
     QSqlDatabase db = QSqlDatabase::database(CONNECTION_NAME);
@@ -431,6 +695,8 @@ int KrosswordDictionary::importFromCsv(const QString& fileName, QWidget *parent)
             qDebug() << query.lastError();
     }
 
+    entriesAdded();
+
     dlgProgress->close();
     return entryCount() - entryCountBefore;
 }
@@ -527,6 +793,8 @@ int KrosswordDictionary::addEntriesFromDictionary(const QString& fileName, QWidg
         db.commit();
     }
 
+    entriesAdded();
+
     dlgProgress->close();
 
     return entryCount() - entryCountBefore;
@@ -534,7 +802,14 @@ int KrosswordDictionary::addEntriesFromDictionary(const QString& fileName, QWidg
 
 bool KrosswordDictionary::isEmpty()
 {
-    return entryCount() == 0;
+    QSqlDatabase db = QSqlDatabase::database(CONNECTION_NAME);
+
+    if (!db.isValid())
+        return true;
+
+    // Don't count all rows, InnoDB needs to scan the whole table for that
+    QSqlQuery query = db.exec("SELECT 1 FROM dictionary LIMIT 1");
+    return !query.next();
 }
 
 int KrosswordDictionary::entryCount()
@@ -623,6 +898,8 @@ int KrosswordDictionary::addEntriesFromCrosswords(const QStringList& fileNames,
         db.commit();
     }
 
+    entriesAdded();
+
     dlgProgress->close();
     return entryCount() - entryCountBefore;
 }
@@ -634,5 +911,6 @@ bool KrosswordDictionary::clearDatabase()
         return false;
 
     QSqlQuery query = db.exec("DELETE FROM dictionary");
+    entriesChanged();
     return true;
 }
@@ -25,10 +25,14 @@
 #include <QObject>
 #include <QStringList>
 #include <QSqlDatabase>
+#include <QSharedPointer>
 
 class QProgressBar;
 class QDialog;
 class ExtendedSqlTableModel;
+class DictionaryBrowserModel;
+class DictionarySuggester;
+class DictionarySnapshot;
 
 class KrosswordDictionary : public QObject
 {
@@ -51,6 +55,48 @@ public:
     int importFromCsv(const QString &fileName, QWidget *parent);
 
     ExtendedSqlTableModel *createModel();
+    /** Creates a model that fetches entries page by page, to browse big
+    * dictionaries. */
+    DictionaryBrowserModel *createBrowserModel(QObject *parent = nullptr);
+
+    /** Gets the suggester used to look up answers for patterns in a background
+    * thread. It gets created on first use. */
+    DictionarySuggester *suggester();
+    /** Needs to be called when entries were changed without using this class.
+    * Drops cached suggestions and the outdated snapshot. */
+    void entriesChanged();
+
+    /** The file name of the snapshot that gets loaded on startup. */
+    static QString defaultSnapshotFileName();
+    /** Writes all entries into a memory mappable snapshot file, that is used
+    * for suggestions instead of the database until entries get changed.
+    * The snapshot is built in the thread of the suggester, @ref
+    * snapshotExported() gets emitted when it's done.
+    * @see DictionarySnapshot */
+    void exportSnapshot(const QString &fileName = QString());
+    /** Maps the snapshot file @p fileName, if it exists. */
+    bool loadSnapshot(const QString &fileName = QString());
+
+    /** The length of the substrings stored in the trigram index. */
+    static const int TRIGRAM_LENGTH = 3;
+    /** Gets all distinct (case insensitive) substrings of @p word with
+    * @ref TRIGRAM_LENGTH characters. Returns an empty list for words shorter
+    * than @ref TRIGRAM_LENGTH. */
+    static QStringList trigrams(const QString &word);
+    /** Replaces the trigrams indexed for the entry with the given @p id by
+    * the trigrams of @p word. */
+    bool updateTrigramIndex(int id, const QString &word);
+    /** Whether the trigram index is complete and can be used for lookups.
+    * Databases of older versions get it built in the background. */
+    bool hasTrigramIndex() const {
+        return m_hasTrigramIndex;
+    };
+    /** Creates the trigram index table in @p db, if it doesn't exist yet,
+    * and indexes the entries of the dictionary. */
+    static bool createTrigramIndex(QSqlDatabase db);
+    /** Adds all entries, that were added to the dictionary table of @p db
+    * since the last call, to the trigram index. */
+    static bool indexNewEntries(QSqlDatabase db);
 
     int addEntriesFromCrosswords(const QStringList &fileNames, QWidget *parent);
     int addEntriesFromDictionary(const QString &fileName, QWidget *parent);
@@ -60,13 +106,27 @@ public:
 public slots:
     void cancelCurrentActionClicked();
 
+private slots:
+    void databaseUpgraded(bool ok);
+    void snapshotWritten(int requestId, const QString &fileName, bool ok,
+                         const QString &errorString);
+
 signals:
     void extractedEntriesFromCrossword(const QString &fileName, int entryCount);
     void errorExtractedEntriesFromCrossword(const QString &fileName, const QString &errorString);
+    /** Emitted when a snapshot started with @ref exportSnapshot() was
+    * written and loaded, or if that failed. */
+    void snapshotExported(bool ok, const QString &errorString);
 
 private:
     QDialog *createProgressDialog(QWidget *parent, const QString &text, QProgressBar *progressBar);
     bool makeStandardConnection();
+    /** Builds missing tables of databases created by older versions in the
+    * thread of the suggester. */
+    void upgradeDatabase();
+    /** Updates the trigram index and cached suggestions after entries
+    * were added. */
+    void entriesAdded();
     bool setupDatabase(QWidget *dlgParent);
     bool createUser(QSqlQuery &query);
     bool createKrosswordDatabase(QSqlQuery &query);
@@ -78,6 +138,10 @@ private:
 
     bool m_cancel;  //Cancel action clicked (yeah really!!)
     bool m_hasConnection;
+    bool m_hasTrigramIndex;
+    int m_entriesGeneration; // Incremented when entries get changed
+    DictionarySuggester *m_suggester;
+    QSharedPointer<const DictionarySnapshot> m_snapshot;
     static const int MAX_WORD_LENGTH = 256;
     static const QString CONNECTION_NAME;
 };
@@ -0,0 +1,349 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "dictionarybrowsermodel.h"
+#include "dictionary.h"
+
+#include <QSqlQuery>
+#include <QStringList>
+#include <QDebug>
+#include <KLocalizedString>
+
+DictionaryBrowserModel::DictionaryBrowserModel(KrosswordDictionary *dictionary,
+        QSqlDatabase db, QObject* parent)
+    : QAbstractTableModel(parent), m_dictionary(dictionary), m_db(db),
+      m_fetchedCount(0), m_lastFetchedId(0), m_fetchedCandidateCount(0),
+      m_pageSize(256), m_atEnd(true)
+{
+}
+
+void DictionaryBrowserModel::setPageSize(int pageSize)
+{
+    m_pageSize = qMax(1, pageSize);
+}
+
+void DictionaryBrowserModel::setSubstringFilter(const QString& filter)
+{
+    if (m_filter == filter)
+        return;
+
+    m_filter = filter;
+    select();
+}
+
+void DictionaryBrowserModel::select()
+{
+    beginResetModel();
+    m_entries.clear();
+    m_fetchedCount = 0;
+    m_lastFetchedId = 0;
+    m_candidateIds.clear();
+    m_fetchedCandidateCount = 0;
+    m_atEnd = !m_filter.isEmpty() && !selectCandidates();
+    endResetModel();
+
+    fetchMore(QModelIndex());
+}
+
+bool DictionaryBrowserModel::selectCandidates()
+{
+    if (!m_db.isOpen())
+        return false;
+
+    // Escape LIKE wildcards in the filter string
+    QString likeFilter = m_filter;
+    likeFilter.replace('!', "!!").replace('%', "!%").replace('_', "!_");
+    QString sql = "SELECT id FROM dictionary WHERE word LIKE ? ESCAPE '!'";
+    QVariantList bindValues;
+    bindValues << QString("%%1%").arg(likeFilter);
+
+    // Narrow the candidates down to words containing all trigrams of
+    // the filter, the LIKE above then only checks these candidates
+    QStringList trigrams = KrosswordDictionary::trigrams(m_filter);
+    if (!trigrams.isEmpty() && m_dictionary->hasTrigramIndex()) {
+        QStringList placeholders;
+        foreach(const QString & trigram, trigrams) {
+            placeholders << "?";
+            bindValues << trigram;
+        }
+        sql.append(QString(" AND id IN (SELECT word_id FROM dictionary_trigram "
+                           "WHERE trigram IN (%1) GROUP BY word_id "
+                           "HAVING COUNT(*) = %2)")
+                   .arg(placeholders.join(",")).arg(trigrams.count()));
+    }
+    sql.append(" ORDER BY id");
+
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    query.prepare(sql);
+    foreach(const QVariant & value, bindValues)
+        query.addBindValue(value);
+    if (!query.exec()) {
+        qDebug() << "Couldn't filter dictionary entries" << query.lastError();
+        m_lastError = query.lastError();
+        return false;
+    }
+
+    while (query.next())
+        m_candidateIds << query.value(0).toInt();
+    return true;
+}
+
+int DictionaryBrowserModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : m_entries.count();
+}
+
+int DictionaryBrowserModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant DictionaryBrowserModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_entries.count()
+            || (role != Qt::DisplayRole && role != Qt::EditRole))
+        return QVariant();
+
+    const Entry &entry = m_entries[ index.row()];
+    switch (index.column()) {
+    case IdColumn:
+        return entry.id == -1 ? QVariant() : QVariant(entry.id);
+    case WordColumn:
+        return entry.word;
+    case ClueColumn:
+        return entry.clue;
+    case ScoreColumn:
+        return entry.score;
+    case LanguageColumn:
+        return entry.language;
+    default:
+        return QVariant();
+    }
+}
+
+QVariant DictionaryBrowserModel::headerData(int section,
+        Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+
+    switch (section) {
+    case IdColumn:
+        return "id";
+    case WordColumn:
+        return i18nc("The header title for answers in the dictionary database", "Answer");
+    case ClueColumn:
+        return i18nc("The header title for clues associated with answer words in the dictionary database", "Clue");
+    case ScoreColumn:
+        return i18nc("The header title for scores/difficulties of clue/answer pairs in the dictionary database", "Score");
+    case LanguageColumn:
+        return i18nc("The header title for languages of clue/answer pairs in the dictionary database", "Language");
+    default:
+        return QVariant();
+    }
+}
+
+Qt::ItemFlags DictionaryBrowserModel::flags(const QModelIndex& index) const
+{
+    Qt::ItemFlags flags = QAbstractTableModel::flags(index);
+    if (index.isValid() && index.column() != IdColumn)
+        flags |= Qt::ItemIsEditable;
+    return flags;
+}
+
+bool DictionaryBrowserModel::setData(const QModelIndex& index,
+                                     const QVariant& value, int role)
+{
+    if (!index.isValid() || role != Qt::EditRole
+            || index.row() >= m_entries.count() || index.column() == IdColumn)
+        return false;
+
+    Entry entry = m_entries[ index.row()];
+    QString field;
+    switch (index.column()) {
+    case WordColumn:
+        entry.word = value.toString();
+        field = "word";
+        break;
+    case ClueColumn:
+        entry.clue = value.toString();
+        field = "clue";
+        break;
+    case ScoreColumn:
+        entry.score = value.toInt();
+        field = "score";
+        break;
+    case LanguageColumn:
+        entry.language = value.toString();
+        field = "language";
+        break;
+    default:
+        return false;
+    }
+
+    QSqlQuery query(m_db);
+    if (entry.id == -1) {
+        // New rows are inserted into the database once they have a word
+        if (!entry.word.isEmpty()) {
+            query.prepare("INSERT INTO dictionary (word, clue, score, language) "
+                          "VALUES (?, ?, ?, ?)");
+            query.addBindValue(entry.word);
+            query.addBindValue(entry.clue);
+            query.addBindValue(entry.score);
+            query.addBindValue(entry.language.isEmpty()
+                               ? QString("en") : entry.language);
+            if (!query.exec()) {
+                qDebug() << "Couldn't insert dictionary entry" << query.lastError();
+                m_lastError = query.lastError();
+                return false;
+            }
+
+            entry.id = query.lastInsertId().toInt();
+            m_dictionary->updateTrigramIndex(entry.id, entry.word);
+        }
+    } else {
+        query.prepare(QString("UPDATE dictionary SET %1 = ? WHERE id = ?").arg(field));
+        query.addBindValue(value);
+        query.addBindValue(entry.id);
+        if (!query.exec()) {
+            qDebug() << "Couldn't update dictionary entry" << query.lastError();
+            m_lastError = query.lastError();
+            return false;
+        }
+
+        if (index.column() == WordColumn)
+            m_dictionary->updateTrigramIndex(entry.id, entry.word);
+    }
+
+    m_entries[ index.row()] = entry;
+    m_dictionary->entriesChanged();
+    emit dataChanged(this->index(index.row(), 0),
+                     this->index(index.row(), ColumnCount - 1));
+    return true;
+}
+
+bool DictionaryBrowserModel::insertRows(int row, int count, const QModelIndex& parent)
+{
+    Q_UNUSED(row);
+    if (parent.isValid() || count < 1)
+        return false;
+
+    beginInsertRows(QModelIndex(), m_entries.count(), m_entries.count() + count - 1);
+    m_entries.insert(m_entries.count(), count, Entry());
+    endInsertRows();
+    return true;
+}
+
+bool DictionaryBrowserModel::removeRows(int row, int count, const QModelIndex& parent)
+{
+    if (parent.isValid() || row < 0 || count < 1 || row + count > m_entries.count())
+        return false;
+
+    QStringList ids;
+    for (int i = row; i < row + count; ++i) {
+        if (m_entries[i].id != -1)
+            ids << QString::number(m_entries[i].id);
+    }
+
+    if (!ids.isEmpty()) {
+        // The trigrams of the removed words get deleted by the foreign key
+        QSqlQuery query(m_db);
+        if (!query.exec(QString("DELETE FROM dictionary WHERE id IN (%1)")
+                        .arg(ids.join(",")))) {
+            qDebug() << "Couldn't remove dictionary entries" << query.lastError();
+            m_lastError = query.lastError();
+            return false;
+        }
+        m_dictionary->entriesChanged();
+    }
+
+    beginRemoveRows(QModelIndex(), row, row + count - 1);
+    m_entries.remove(row, count);
+    if (row < m_fetchedCount)
+        m_fetchedCount -= qMin(count, m_fetchedCount - row);
+    endRemoveRows();
+    return true;
+}
+
+bool DictionaryBrowserModel::canFetchMore(const QModelIndex& parent) const
+{
+    return !parent.isValid() && !m_atEnd;
+}
+
+void DictionaryBrowserModel::fetchMore(const QModelIndex& parent)
+{
+    if (parent.isValid() || m_atEnd || !m_db.isOpen())
+        return;
+
+    QString sql = "SELECT id, word, clue, score, language FROM dictionary ";
+    if (m_filter.isEmpty()) {
+        sql.append(QString("WHERE id > %1 ORDER BY id LIMIT %2")
+                   .arg(m_lastFetchedId).arg(m_pageSize));
+    } else {
+        // Get the next page of the candidates found by selectCandidates()
+        const int count = qMin(m_pageSize,
+                               m_candidateIds.count() - m_fetchedCandidateCount);
+        QStringList ids;
+        for (int i = 0; i < count; ++i)
+            ids << QString::number(m_candidateIds[ m_fetchedCandidateCount + i ]);
+        m_fetchedCandidateCount += count;
+        m_atEnd = m_fetchedCandidateCount >= m_candidateIds.count();
+        if (ids.isEmpty())
+            return;
+
+        sql.append(QString("WHERE id IN (%1) ORDER BY id").arg(ids.join(",")));
+    }
+
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    if (!query.exec(sql)) {
+        qDebug() << "Couldn't fetch dictionary entries" << query.lastError();
+        m_lastError = query.lastError();
+        m_atEnd = true;
+        return;
+    }
+
+    QVector<Entry> page;
+    page.reserve(m_pageSize);
+    while (query.next()) {
+        Entry entry;
+        entry.id = query.value(0).toInt();
+        entry.word = query.value(1).toString();
+        entry.clue = query.value(2).toString();
+        entry.score = query.value(3).toInt();
+        entry.language = query.value(4).toString();
+        page << entry;
+    }
+
+    if (m_filter.isEmpty()) {
+        m_atEnd = page.count() < m_pageSize;
+        if (!page.isEmpty())
+            m_lastFetchedId = page.last().id;
+    }
+    if (page.isEmpty())
+        return; // All entries of this page of candidates were removed
+
+    // Fetched rows go before rows that were added in this model
+    beginInsertRows(QModelIndex(), m_fetchedCount, m_fetchedCount + page.count() - 1);
+    for (int i = 0; i < page.count(); ++i)
+        m_entries.insert(m_fetchedCount + i, page[i]);
+    m_fetchedCount += page.count();
+    endInsertRows();
+}
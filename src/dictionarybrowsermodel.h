@@ -0,0 +1,131 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef DICTIONARYBROWSERMODEL_H
+#define DICTIONARYBROWSERMODEL_H
+
+#include <QAbstractTableModel>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QVector>
+
+class KrosswordDictionary;
+
+/** A model to browse the dictionary table, that only loads the rows that are
+* actually shown.
+*
+* Rows are fetched in pages using keyset pagination on the primary key
+* ("WHERE id > last id ORDER BY id LIMIT page size"), so each page uses the
+* primary key instead of skipping over all previous rows like "LIMIT offset,
+* count" does. The id doesn't change when entries get edited, so edits don't
+* cause skipped or duplicated rows. Views request more pages using
+* @ref canFetchMore() and @ref fetchMore() while scrolling.
+*
+* For a substring filter set with @ref setSubstringFilter() the ids of all
+* matching entries are looked up once, using the trigram index of
+* @ref KrosswordDictionary if the filter is at least
+* @ref KrosswordDictionary::TRIGRAM_LENGTH characters long. Pages are then
+* fetched by id from that list.
+*
+* Changes are written to the database immediately. */
+class DictionaryBrowserModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    /** The columns of the model, in the order of the dictionary table. */
+    enum Column {
+        IdColumn = 0,
+        WordColumn,
+        ClueColumn,
+        ScoreColumn,
+        LanguageColumn,
+
+        ColumnCount
+    };
+
+    explicit DictionaryBrowserModel(KrosswordDictionary *dictionary,
+                                    QSqlDatabase db, QObject* parent = 0);
+
+    /** The number of rows fetched at once. Default is 256. */
+    int pageSize() const {
+        return m_pageSize;
+    };
+    void setPageSize(int pageSize);
+
+    /** Only shows entries which words contain @p filter. An empty @p filter
+    * shows all entries. This resets the model. */
+    void setSubstringFilter(const QString &filter);
+    QString substringFilter() const {
+        return m_filter;
+    };
+
+    /** Drops all fetched rows and fetches the first page again. */
+    void select();
+
+    QSqlError lastError() const {
+        return m_lastError;
+    };
+
+    virtual int rowCount(const QModelIndex& parent = QModelIndex()) const;
+    virtual int columnCount(const QModelIndex& parent = QModelIndex()) const;
+    virtual QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+    virtual QVariant headerData(int section, Qt::Orientation orientation,
+                                int role = Qt::DisplayRole) const;
+    virtual Qt::ItemFlags flags(const QModelIndex& index) const;
+    virtual bool setData(const QModelIndex& index, const QVariant& value,
+                         int role = Qt::EditRole);
+
+    /** Appends empty rows, which get inserted into the database once a
+    * word is set for them. @p row is ignored, new rows are always appended. */
+    virtual bool insertRows(int row, int count, const QModelIndex& parent = QModelIndex());
+    /** Removes the rows from the model and deletes them from the database. */
+    virtual bool removeRows(int row, int count, const QModelIndex& parent = QModelIndex());
+
+    virtual bool canFetchMore(const QModelIndex& parent) const;
+    virtual void fetchMore(const QModelIndex& parent);
+
+private:
+    /** Looks up the ids of all entries matching the substring filter. */
+    bool selectCandidates();
+
+    struct Entry {
+        Entry() : id(-1), score(0) {};
+
+        int id; // -1 for rows that aren't yet in the database
+        QString word;
+        QString clue;
+        int score;
+        QString language;
+    };
+
+    KrosswordDictionary *m_dictionary;
+    QSqlDatabase m_db;
+    QVector<Entry> m_entries;
+    int m_fetchedCount; // Rows before this index come from fetched pages
+    int m_lastFetchedId; // The key for the next page without a filter
+    QVector<int> m_candidateIds; // Ids of entries matching m_filter, sorted
+    int m_fetchedCandidateCount; // The next page starts at this candidate
+    QString m_filter;
+    QSqlError m_lastError;
+    int m_pageSize;
+    bool m_atEnd;
+};
+
+#endif // DICTIONARYBROWSERMODEL_H
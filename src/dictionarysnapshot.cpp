@@ -0,0 +1,496 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "dictionarysnapshot.h"
+
+#include <QSaveFile>
+#include <QDataStream>
+#include <QHash>
+#include <QMap>
+#include <QVector>
+#include <QtEndian>
+#include <QDebug>
+
+namespace
+{
+const char MAGIC[] = "KWDAWG";
+const int MAGIC_LENGTH = 6;
+const quint16 VERSION = 1;
+const int HEADER_SIZE = 40;
+const int NODE_SIZE = 12;
+const int EDGE_SIZE = 8;
+const int ENTRY_SIZE = 12;
+const quint16 FINAL_NODE_FLAG = 0x1;
+
+/** Patterns are matched by an NFA, which states are the positions in the
+* pattern, stored as bits of a quint64. */
+const int MAX_PATTERN_LENGTH = 63;
+
+quint64 patternClosure(quint64 states, const QString &pattern)
+{
+    // A '*' can also match no character
+    for (int i = 0; i < pattern.length(); ++i) {
+        if ((states & (Q_UINT64_C(1) << i)) && pattern[i] == '*')
+            states |= Q_UINT64_C(1) << (i + 1);
+    }
+    return states;
+}
+
+quint64 patternStep(quint64 states, const QString &pattern, ushort ch)
+{
+    quint64 nextStates = 0;
+    for (int i = 0; i < pattern.length(); ++i) {
+        if (!(states & (Q_UINT64_C(1) << i)))
+            continue;
+
+        if (pattern[i] == '*')
+            nextStates |= Q_UINT64_C(1) << i;
+        else if (pattern[i] == '?' || pattern[i].unicode() == ch)
+            nextStates |= Q_UINT64_C(1) << (i + 1);
+    }
+    return patternClosure(nextStates, pattern);
+}
+
+struct BuildNode {
+    BuildNode() : final(false) {};
+
+    bool final;
+    QVector< QPair<ushort, quint32> > edges;
+};
+
+struct UncheckedEdge {
+    quint32 parent;
+    quint32 child;
+};
+
+QByteArray nodeSignature(const BuildNode &node)
+{
+    QByteArray signature;
+    signature.reserve(1 + node.edges.count() * 6);
+    signature.append(node.final ? '1' : '0');
+    for (int i = 0; i < node.edges.count(); ++i) {
+        signature.append(reinterpret_cast<const char*>(&node.edges[i].first), sizeof(ushort));
+        signature.append(reinterpret_cast<const char*>(&node.edges[i].second), sizeof(quint32));
+    }
+    return signature;
+}
+
+/** Replaces unchecked nodes above @p downTo by equivalent registered nodes
+* or registers them (Daciuk et al., incremental construction from sorted
+* words). */
+void minimize(QVector<BuildNode> &nodes, QVector<UncheckedEdge> &unchecked,
+              QHash<QByteArray, quint32> &registry, int downTo)
+{
+    while (unchecked.count() > downTo) {
+        const UncheckedEdge edge = unchecked.last();
+        const QByteArray signature = nodeSignature(nodes[edge.child]);
+        QHash<QByteArray, quint32>::const_iterator it = registry.constFind(signature);
+        if (it != registry.constEnd()) {
+            nodes[edge.parent].edges.last().second = it.value();
+            nodes[edge.child] = BuildNode(); // Unreachable now, free it's edges
+        } else {
+            registry.insert(signature, edge.child);
+        }
+        unchecked.removeLast();
+    }
+}
+
+quint32 countWords(const QVector<BuildNode> &nodes, quint32 index,
+                   QHash<quint32, quint32> &wordCounts)
+{
+    QHash<quint32, quint32>::const_iterator it = wordCounts.constFind(index);
+    if (it != wordCounts.constEnd())
+        return it.value();
+
+    quint32 count = nodes[index].final ? 1 : 0;
+    for (int i = 0; i < nodes[index].edges.count(); ++i)
+        count += countWords(nodes, nodes[index].edges[i].second, wordCounts);
+    wordCounts.insert(index, count);
+    return count;
+}
+}; // namespace
+
+
+DictionarySnapshot::DictionarySnapshot()
+    : m_data(0), m_size(0), m_wordCount(0), m_nodeCount(0), m_edgeCount(0),
+      m_nodesOffset(0), m_edgesOffset(0), m_entriesOffset(0),
+      m_cluesOffset(0), m_cluesSize(0)
+{
+}
+
+DictionarySnapshot::~DictionarySnapshot()
+{
+    close();
+}
+
+bool DictionarySnapshot::write(const QString& fileName,
+                               const DictionaryEntryList& entries, QString* errorString)
+{
+    // Sort words and remove duplicates
+    QMap<QString, int> sortedWords;
+    for (int i = 0; i < entries.count(); ++i) {
+        const QString word = DictionaryEntry::normalizedWord(entries[i].word);
+        if (!word.isEmpty() && !sortedWords.contains(word))
+            sortedWords.insert(word, i);
+    }
+
+    // Build the minimized DAWG
+    QVector<BuildNode> nodes;
+    nodes << BuildNode(); // Root
+    QVector<UncheckedEdge> unchecked;
+    QHash<QByteArray, quint32> registry;
+    QString previousWord;
+    for (QMap<QString, int>::const_iterator it = sortedWords.constBegin();
+            it != sortedWords.constEnd(); ++it) {
+        const QString &word = it.key();
+        int commonPrefix = 0;
+        while (commonPrefix < word.length() && commonPrefix < previousWord.length()
+                && word[commonPrefix] == previousWord[commonPrefix])
+            ++commonPrefix;
+
+        minimize(nodes, unchecked, registry, commonPrefix);
+
+        quint32 nodeIndex = unchecked.isEmpty() ? 0 : unchecked.last().child;
+        for (int i = commonPrefix; i < word.length(); ++i) {
+            const quint32 childIndex = nodes.count();
+            nodes << BuildNode();
+            nodes[nodeIndex].edges << qMakePair(word[i].unicode(), childIndex);
+            UncheckedEdge edge = { nodeIndex, childIndex };
+            unchecked << edge;
+            nodeIndex = childIndex;
+        }
+        nodes[nodeIndex].final = true;
+        previousWord = word;
+    }
+    minimize(nodes, unchecked, registry, 0);
+
+    // Number the reachable nodes, the root gets index 0
+    QHash<quint32, quint32> newIndices;
+    QVector<quint32> order;
+    order << 0;
+    newIndices.insert(0, 0);
+    for (int i = 0; i < order.count(); ++i) {
+        const BuildNode &node = nodes[order[i]];
+        for (int e = 0; e < node.edges.count(); ++e) {
+            if (!newIndices.contains(node.edges[e].second)) {
+                newIndices.insert(node.edges[e].second, order.count());
+                order << node.edges[e].second;
+            }
+        }
+    }
+
+    QHash<quint32, quint32> wordCounts;
+    quint32 edgeCount = 0;
+    foreach(quint32 index, order)
+    edgeCount += nodes[index].edges.count();
+
+    // Collect clues in word order
+    QByteArray clues;
+    QVector<quint32> clueOffsets, clueLengths;
+    QVector<qint32> scores;
+    for (QMap<QString, int>::const_iterator it = sortedWords.constBegin();
+            it != sortedWords.constEnd(); ++it) {
+        const DictionaryEntry &entry = entries[it.value()];
+        const QByteArray clue = entry.clue.toUtf8();
+        clueOffsets << clues.size();
+        clueLengths << clue.size();
+        scores << entry.score;
+        clues.append(clue);
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorString)
+            *errorString = file.errorString();
+        return false;
+    }
+
+    const quint32 nodesOffset = HEADER_SIZE;
+    const quint32 edgesOffset = nodesOffset + order.count() * NODE_SIZE;
+    const quint32 entriesOffset = edgesOffset + edgeCount * EDGE_SIZE;
+    const quint32 cluesOffset = entriesOffset + sortedWords.count() * ENTRY_SIZE;
+
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.writeRawData(MAGIC, MAGIC_LENGTH);
+    stream << VERSION << quint32(sortedWords.count()) << quint32(order.count())
+           << edgeCount << nodesOffset << edgesOffset << entriesOffset
+           << cluesOffset << quint32(clues.size());
+
+    quint32 firstEdge = 0;
+    foreach(quint32 index, order) {
+        const BuildNode &node = nodes[index];
+        stream << firstEdge << quint16(node.edges.count())
+               << quint16(node.final ? FINAL_NODE_FLAG : 0)
+               << countWords(nodes, index, wordCounts);
+        firstEdge += node.edges.count();
+    }
+    foreach(quint32 index, order) {
+        const BuildNode &node = nodes[index];
+        for (int e = 0; e < node.edges.count(); ++e)
+            stream << quint16(node.edges[e].first) << quint16(0)
+                   << newIndices[node.edges[e].second];
+    }
+    for (int i = 0; i < scores.count(); ++i)
+        stream << scores[i] << clueOffsets[i] << clueLengths[i];
+    stream.writeRawData(clues.constData(), clues.size());
+
+    if (stream.status() != QDataStream::Ok || !file.commit()) {
+        if (errorString)
+            *errorString = file.errorString();
+        return false;
+    }
+
+    qDebug() << "Wrote dictionary snapshot with" << sortedWords.count()
+             << "words and" << order.count() << "nodes to" << fileName;
+    return true;
+}
+
+bool DictionarySnapshot::open(const QString& fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    m_size = m_file.size();
+    if (m_size < HEADER_SIZE) {
+        qDebug() << "Dictionary snapshot is too small" << fileName;
+        m_file.close();
+        return false;
+    }
+
+    // The file needs to stay open, closing it would unmap it
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        qDebug() << "Couldn't map dictionary snapshot" << fileName;
+        m_file.close();
+        return false;
+    }
+
+    if (qstrncmp(reinterpret_cast<const char*>(m_data), MAGIC, MAGIC_LENGTH) != 0
+            || qFromLittleEndian<quint16>(m_data + MAGIC_LENGTH) != VERSION) {
+        qDebug() << "Unknown dictionary snapshot format" << fileName;
+        close();
+        return false;
+    }
+
+    const uchar *header = m_data + 8;
+    m_wordCount = qFromLittleEndian<quint32>(header);
+    m_nodeCount = qFromLittleEndian<quint32>(header + 4);
+    m_edgeCount = qFromLittleEndian<quint32>(header + 8);
+    m_nodesOffset = qFromLittleEndian<quint32>(header + 12);
+    m_edgesOffset = qFromLittleEndian<quint32>(header + 16);
+    m_entriesOffset = qFromLittleEndian<quint32>(header + 20);
+    m_cluesOffset = qFromLittleEndian<quint32>(header + 24);
+    m_cluesSize = qFromLittleEndian<quint32>(header + 28);
+
+    if (m_nodeCount == 0
+            || qint64(m_nodesOffset) + qint64(m_nodeCount) * NODE_SIZE > m_size
+            || qint64(m_edgesOffset) + qint64(m_edgeCount) * EDGE_SIZE > m_size
+            || qint64(m_entriesOffset) + qint64(m_wordCount) * ENTRY_SIZE > m_size
+            || qint64(m_cluesOffset) + m_cluesSize > m_size) {
+        qDebug() << "Dictionary snapshot is corrupt" << fileName;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void DictionarySnapshot::close()
+{
+    if (m_data) {
+        m_file.unmap(const_cast<uchar*>(m_data));
+        m_data = 0;
+    }
+    m_file.close();
+    m_size = 0;
+    m_wordCount = m_nodeCount = m_edgeCount = 0;
+}
+
+DictionarySnapshot::Node DictionarySnapshot::node(quint32 index) const
+{
+    const uchar *data = m_data + m_nodesOffset + index * NODE_SIZE;
+    Node node;
+    node.firstEdge = qFromLittleEndian<quint32>(data);
+    node.edgeCount = qFromLittleEndian<quint16>(data + 4);
+    node.final = qFromLittleEndian<quint16>(data + 6) & FINAL_NODE_FLAG;
+    node.wordCount = qFromLittleEndian<quint32>(data + 8);
+    return node;
+}
+
+ushort DictionarySnapshot::edgeCharacter(quint32 edge) const
+{
+    return qFromLittleEndian<quint16>(m_data + m_edgesOffset + edge * EDGE_SIZE);
+}
+
+quint32 DictionarySnapshot::edgeTarget(quint32 edge) const
+{
+    return qFromLittleEndian<quint32>(m_data + m_edgesOffset + edge * EDGE_SIZE + 4);
+}
+
+int DictionarySnapshot::indexOf(const QString& word) const
+{
+    if (!m_data)
+        return -1;
+
+    const QString upperWord = DictionaryEntry::normalizedWord(word);
+    int index = 0;
+    Node current = node(0);
+    for (int i = 0; i < upperWord.length(); ++i) {
+        if (current.final)
+            ++index;
+
+        // Binary search for the edge with the next character
+        const ushort ch = upperWord[i].unicode();
+        int low = 0, high = current.edgeCount - 1, found = -1;
+        while (low <= high) {
+            const int middle = (low + high) / 2;
+            const ushort middleCh = edgeCharacter(current.firstEdge + middle);
+            if (middleCh == ch) {
+                found = middle;
+                break;
+            } else if (middleCh < ch)
+                low = middle + 1;
+            else
+                high = middle - 1;
+        }
+        if (found == -1)
+            return -1;
+
+        // Skip the words below the edges with smaller characters
+        for (int e = 0; e < found; ++e)
+            index += node(edgeTarget(current.firstEdge + e)).wordCount;
+        current = node(edgeTarget(current.firstEdge + found));
+    }
+
+    return current.final ? index : -1;
+}
+
+int DictionarySnapshot::score(int index) const
+{
+    if (!m_data || index < 0 || quint32(index) >= m_wordCount)
+        return 0;
+
+    return qFromLittleEndian<qint32>(m_data + m_entriesOffset + index * ENTRY_SIZE);
+}
+
+QString DictionarySnapshot::clue(int index) const
+{
+    if (!m_data || index < 0 || quint32(index) >= m_wordCount)
+        return QString();
+
+    const uchar *entry = m_data + m_entriesOffset + index * ENTRY_SIZE;
+    const quint32 offset = qFromLittleEndian<quint32>(entry + 4);
+    const quint32 length = qFromLittleEndian<quint32>(entry + 8);
+    if (length == 0 || quint64(offset) + length > m_cluesSize)
+        return QString();
+
+    return QString::fromUtf8(reinterpret_cast<const char*>(
+                                 m_data + m_cluesOffset + offset), length);
+}
+
+bool DictionarySnapshot::find(const DictionaryQuery& query,
+                              DictionaryEntryList* entries) const
+{
+    Q_ASSERT(entries);
+    if (!m_data)
+        return false;
+
+    QString pattern = query.pattern.isEmpty()
+                      ? "*" : DictionaryEntry::normalizedWord(query.pattern);
+    if (pattern.length() > MAX_PATTERN_LENGTH)
+        return false;
+
+    QString word;
+    find(0, 0, patternClosure(1, pattern), pattern, 0, query, &word, entries);
+    return true;
+}
+
+void DictionarySnapshot::find(quint32 nodeIndex, int wordIndex, quint64 states,
+                              const QString& pattern, int depth,
+                              const DictionaryQuery& query, QString* word,
+                              DictionaryEntryList* entries) const
+{
+    if (query.limit != -1 && entries->count() >= query.limit)
+        return;
+
+    const Node current = node(nodeIndex);
+    const bool lengthOk = query.length != -1 ? depth == query.length
+                          : (query.maxLength == -1 || depth <= query.maxLength);
+    if (current.final && lengthOk && (states & (Q_UINT64_C(1) << pattern.length()))) {
+        DictionaryEntry entry;
+        entry.word = *word;
+        entry.clue = clue(wordIndex);
+        entry.score = score(wordIndex);
+        if (!query.onlyWithClue || !entry.clue.isEmpty())
+            *entries << entry;
+    }
+
+    const int maxDepth = query.length != -1 ? query.length : query.maxLength;
+    if (maxDepth != -1 && depth >= maxDepth)
+        return;
+
+    int childWordIndex = wordIndex + (current.final ? 1 : 0);
+    for (quint32 e = current.firstEdge; e < current.firstEdge + current.edgeCount; ++e) {
+        const quint32 target = edgeTarget(e);
+        const ushort ch = edgeCharacter(e);
+        const quint64 nextStates = patternStep(states, pattern, ch);
+        if (nextStates) {
+            word->append(QChar(ch));
+            find(target, childWordIndex, nextStates, pattern, depth + 1,
+                 query, word, entries);
+            word->chop(1);
+        }
+        childWordIndex += node(target).wordCount;
+    }
+}
+
+int DictionarySnapshot::count(const QString& pattern, int maxCount) const
+{
+    if (!m_data || maxCount <= 0)
+        return 0;
+
+    return count(0, DictionaryEntry::normalizedWord(pattern), 0, maxCount);
+}
+
+int DictionarySnapshot::count(quint32 nodeIndex, const QString& pattern,
+                              int depth, int maxCount) const
+{
+    const Node current = node(nodeIndex);
+    if (depth == pattern.length())
+        return current.final ? 1 : 0;
+
+    int matches = 0;
+    const ushort ch = pattern[depth].unicode();
+    for (quint32 e = current.firstEdge;
+            e < current.firstEdge + current.edgeCount && matches < maxCount; ++e) {
+        const ushort edgeCh = edgeCharacter(e);
+        if (ch != '?' && edgeCh != ch) {
+            if (edgeCh > ch)
+                break; // Edges are sorted by character
+            continue;
+        }
+
+        matches += count(edgeTarget(e), pattern, depth + 1, maxCount - matches);
+    }
+    return matches;
+}
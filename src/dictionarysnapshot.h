@@ -0,0 +1,118 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef DICTIONARYSNAPSHOT_H
+#define DICTIONARYSNAPSHOT_H
+
+#include "dictionarysuggester.h"
+
+#include <QFile>
+
+/** A read only copy of the dictionary, stored as a minimized DAWG (directed
+* acyclic word graph) in a file, that gets memory mapped.
+*
+* Mapping the file is all that needs to be done to use it, so opening is
+* fast, and processes that map the same file share it's pages. Words are
+* numbered in sorted order by counting the words below each node, which is
+* used to look up the score and clue of a word in a separate table.
+*
+* The file layout (all numbers little endian):
+* @li Header: "KWDAWG", quint16 version, quint32 word/node/edge count,
+*     quint32 offsets of the node/edge/entry tables and the clue strings,
+*     quint32 size of the clue strings.
+* @li Nodes: quint32 first edge, quint16 edge count, quint16 flags,
+*     quint32 number of words below (including the node itself).
+* @li Edges, sorted by character for each node: quint16 character,
+*     quint16 reserved, quint32 target node.
+* @li Entries, one per word in sorted order: qint32 score, quint32 clue
+*     offset, quint32 clue length in bytes.
+* @li Clues: UTF-8 strings.
+*
+* The root node is the first node. */
+class DictionarySnapshot
+{
+public:
+    DictionarySnapshot();
+    ~DictionarySnapshot();
+
+    /** Writes a snapshot of @p entries to @p fileName. Words are normalized
+    * using @ref DictionaryEntry::normalizedWord(), of duplicate words only the
+    * first one is used.
+    * The file gets replaced atomically, so that processes having the old
+    * file mapped aren't affected. */
+    static bool write(const QString &fileName, const DictionaryEntryList &entries,
+                      QString *errorString = 0);
+
+    /** Maps the snapshot file @p fileName into memory. */
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const {
+        return m_data;
+    };
+
+    int wordCount() const {
+        return m_wordCount;
+    };
+
+    /** Gets the index of @p word in the sorted word list or -1 if it isn't
+    * contained in the snapshot. */
+    int indexOf(const QString &word) const;
+    int score(int index) const;
+    QString clue(int index) const;
+
+    /** Finds all entries matching @p query, sorted by word.
+    * @returns false if the query can't be answered using the snapshot, ie.
+    * if it's pattern is too long. */
+    bool find(const DictionaryQuery &query, DictionaryEntryList *entries) const;
+
+    /** Counts the words matching @p pattern, which can only contain the
+    * wildcard '?'. Stops counting at @p maxCount. */
+    int count(const QString &pattern, int maxCount) const;
+
+private:
+    struct Node {
+        quint32 firstEdge;
+        quint16 edgeCount;
+        bool final;
+        quint32 wordCount;
+    };
+
+    Node node(quint32 index) const;
+    ushort edgeCharacter(quint32 edge) const;
+    quint32 edgeTarget(quint32 edge) const;
+
+    void find(quint32 nodeIndex, int wordIndex, quint64 states,
+              const QString &pattern, int depth, const DictionaryQuery &query,
+              QString *word, DictionaryEntryList *entries) const;
+    int count(quint32 nodeIndex, const QString &pattern, int depth, int maxCount) const;
+
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+    quint32 m_wordCount;
+    quint32 m_nodeCount;
+    quint32 m_edgeCount;
+    quint32 m_nodesOffset;
+    quint32 m_edgesOffset;
+    quint32 m_entriesOffset;
+    quint32 m_cluesOffset;
+    quint32 m_cluesSize;
+};
+
+#endif // DICTIONARYSNAPSHOT_H
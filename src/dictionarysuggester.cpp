@@ -0,0 +1,513 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "dictionarysuggester.h"
+#include "dictionarysnapshot.h"
+#include "dictionary.h"
+
+#include <QThread>
+#include <QTimer>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QHash>
+#include <QDir>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <QDebug>
+
+QString DictionaryQuery::key() const
+{
+    QString key = QString("%1|%2|%3|%4|%5").arg(pattern).arg(length).arg(maxLength)
+                  .arg(onlyWithClue ? 1 : 0).arg(limit);
+    foreach(const DictionaryCrossing & crossing, crossings) {
+        key.append(QString("|%1:%2:%3").arg(crossing.position)
+                   .arg(crossing.crossingPosition).arg(crossing.pattern));
+    }
+    return key;
+}
+
+bool greaterThanCrossingFits(const DictionaryEntry &entry1, const DictionaryEntry &entry2)
+{
+    return entry1.crossingFits > entry2.crossingFits;
+}
+
+
+DictionarySuggestionWorker::DictionarySuggestionWorker(const QString& driver,
+        const QString& hostName, const QString& databaseName,
+        const QString& userName, const QString& password,
+        QAtomicInt *latestRequestId, QAtomicInt *latestCountRequestId)
+    : QObject(), m_driver(driver), m_hostName(hostName),
+      m_databaseName(databaseName), m_userName(userName), m_password(password),
+      m_latestRequestId(latestRequestId), m_latestCountRequestId(latestCountRequestId)
+{
+    m_connectionName = QString("krosswordpuzzle_suggestions_%1")
+                       .arg(reinterpret_cast<quintptr>(this));
+}
+
+DictionarySuggestionWorker::~DictionarySuggestionWorker()
+{
+    if (QSqlDatabase::contains(m_connectionName)) {
+        {
+            QSqlDatabase db = QSqlDatabase::database(m_connectionName, false);
+            db.close();
+        }
+        QSqlDatabase::removeDatabase(m_connectionName);
+    }
+}
+
+QSqlDatabase DictionarySuggestionWorker::database()
+{
+    // The connection is created here, because it can only be used in the
+    // thread that created it
+    QSqlDatabase db;
+    if (QSqlDatabase::contains(m_connectionName)) {
+        db = QSqlDatabase::database(m_connectionName);
+    } else {
+        db = QSqlDatabase::addDatabase(m_driver, m_connectionName);
+        db.setHostName(m_hostName);
+        db.setDatabaseName(m_databaseName);
+        db.setUserName(m_userName);
+        db.setPassword(m_password);
+    }
+    if (!db.isOpen() && !db.open())
+        qDebug() << "Couldn't open database connection for suggestions" << db.lastError();
+
+    return db;
+}
+
+void DictionarySuggestionWorker::runQuery(int requestId, const DictionaryQuery& query,
+        const DictionarySnapshotPtr& snapshot)
+{
+    // Skip requests that were superseded while waiting in the queue
+    if (isStale(requestId))
+        return;
+
+    DictionaryEntryList entries;
+    if (!snapshot || !snapshot->find(query, &entries)) {
+        QSqlDatabase db = database();
+        if (!db.isOpen() || !findEntries(requestId, query, db, &entries)) {
+            if (!isStale(requestId))
+                emit queryFailed(requestId, query);
+            return;
+        }
+    }
+
+    if (!query.crossings.isEmpty()
+            && !rankByCrossings(requestId, query, snapshot, &entries))
+        return; // Cancelled
+
+    emit queryFinished(requestId, query, entries);
+}
+
+bool DictionarySuggestionWorker::findEntries(int requestId, const DictionaryQuery& query,
+        QSqlDatabase db, DictionaryEntryList* entries)
+{
+    QString mysqlPattern = query.pattern;
+    mysqlPattern.replace('?', '_').replace('*', '%');
+    if (mysqlPattern.isEmpty())
+        mysqlPattern = '%';
+
+    QString sql = "SELECT word, clue, score FROM dictionary WHERE word LIKE ?";
+    if (query.length != -1)
+        sql.append(QString(" AND CHAR_LENGTH(word) = %1").arg(query.length));
+    else if (query.maxLength != -1)
+        sql.append(QString(" AND CHAR_LENGTH(word) <= %1").arg(query.maxLength));
+    if (query.onlyWithClue)
+        sql.append(" AND clue IS NOT NULL AND clue != ''");
+    sql.append(" ORDER BY word");
+    if (query.limit != -1)
+        sql.append(QString(" LIMIT %1").arg(query.limit));
+
+    QSqlQuery sqlQuery(db);
+    sqlQuery.setForwardOnly(true);
+    sqlQuery.prepare(sql);
+    sqlQuery.addBindValue(mysqlPattern);
+    if (!sqlQuery.exec()) {
+        qDebug() << "Dictionary query failed" << sqlQuery.lastError();
+        return false;
+    }
+
+    while (sqlQuery.next()) {
+        DictionaryEntry entry;
+        entry.word = DictionaryEntry::normalizedWord(sqlQuery.value(0).toString());
+        entry.clue = sqlQuery.value(1).toString();
+        entry.score = sqlQuery.value(2).toInt();
+        *entries << entry;
+
+        // Stop reading results of cancelled requests
+        if (entries->count() % 256 == 0 && isStale(requestId))
+            return false;
+    }
+
+    return true;
+}
+
+bool DictionarySuggestionWorker::rankByCrossings(int requestId,
+        const DictionaryQuery& query, const DictionarySnapshotPtr& snapshot,
+        DictionaryEntryList* entries)
+{
+    // Many candidates put the same letter at the same position, so there are
+    // at most (crossing count * alphabet size) different patterns to count
+    QHash<QString, int> fitsByPattern;
+
+    for (int i = 0; i < entries->count(); ++i) {
+        DictionaryEntry &entry = (*entries)[i];
+        const QString &word = entry.word;
+        entry.crossingFits = -1;
+
+        foreach(const DictionaryCrossing & crossing, query.crossings) {
+            if (crossing.position >= word.length())
+                continue;
+
+            QString pattern = crossing.pattern;
+            pattern[crossing.crossingPosition] = word[crossing.position];
+
+            int fits = fitsByPattern.value(pattern, -1);
+            if (fits == -1) {
+                if (isStale(requestId))
+                    return false;
+
+                fits = qMax(0, countMatches(pattern, MAX_CROSSING_FITS, snapshot));
+                fitsByPattern.insert(pattern, fits);
+            }
+
+            // The tightest crossing limits the candidate
+            if (entry.crossingFits == -1 || fits < entry.crossingFits)
+                entry.crossingFits = fits;
+        }
+    }
+
+    // Best candidates first, dead ends last. Stable, to keep candidates with
+    // equal fits sorted by word.
+    qStableSort(entries->begin(), entries->end(), greaterThanCrossingFits);
+    return true;
+}
+
+void DictionarySuggestionWorker::countPatterns(int requestId, const QStringList& patterns,
+        int maxCount, const DictionarySnapshotPtr& snapshot)
+{
+    if (isCountStale(requestId))
+        return;
+
+    QList<int> counts;
+    foreach(const QString & pattern, patterns) {
+        // Report what was counted so far, these counts are still valid
+        if (isCountStale(requestId))
+            break;
+
+        const int count = countMatches(pattern, maxCount, snapshot);
+        if (count == -1)
+            break;
+        counts << count;
+    }
+
+    emit patternsCounted(requestId, patterns, counts);
+}
+
+void DictionarySuggestionWorker::upgradeDatabase()
+{
+    QSqlDatabase db = database();
+    emit databaseUpgraded(db.isOpen() && KrosswordDictionary::createTrigramIndex(db));
+}
+
+void DictionarySuggestionWorker::exportSnapshot(int requestId, const QString& fileName)
+{
+    QSqlDatabase db = database();
+    if (!db.isOpen()) {
+        emit snapshotExported(requestId, fileName, false, db.lastError().text());
+        return;
+    }
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT word, clue, score FROM dictionary")) {
+        qDebug() << "Couldn't read the dictionary" << query.lastError();
+        emit snapshotExported(requestId, fileName, false, query.lastError().text());
+        return;
+    }
+
+    DictionaryEntryList entries;
+    while (query.next()) {
+        DictionaryEntry entry;
+        entry.word = query.value(0).toString();
+        entry.clue = query.value(1).toString();
+        entry.score = query.value(2).toInt();
+        entries << entry;
+    }
+
+    QString errorString;
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    const bool ok = DictionarySnapshot::write(fileName, entries, &errorString);
+    emit snapshotExported(requestId, fileName, ok, errorString);
+}
+
+void DictionarySuggestionWorker::clearPatternIndex()
+{
+    m_lengthIndices.clear();
+}
+
+const DictionarySuggestionWorker::LengthIndex *DictionarySuggestionWorker::lengthIndex(int length)
+{
+    QHash<int, LengthIndex>::const_iterator it = m_lengthIndices.constFind(length);
+    if (it != m_lengthIndices.constEnd())
+        return &it.value();
+
+    // Read all words of the length once, instead of running a LIKE query,
+    // that scans the whole table, for each counted pattern
+    QSqlDatabase db = database();
+    if (!db.isOpen())
+        return NULL;
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT word FROM dictionary WHERE CHAR_LENGTH(word) = ?");
+    query.addBindValue(length);
+    if (!query.exec()) {
+        qDebug() << "Couldn't read dictionary words" << query.lastError();
+        return NULL;
+    }
+
+    LengthIndex index;
+    index.positions.resize(length);
+    while (query.next()) {
+        const QString word = DictionaryEntry::normalizedWord(query.value(0).toString());
+        if (word.length() != length)
+            continue;
+
+        for (int i = 0; i < length; ++i)
+            index.positions[i][word[i]] << index.wordCount;
+        ++index.wordCount;
+    }
+
+    return &m_lengthIndices.insert(length, index).value();
+}
+
+int DictionarySuggestionWorker::countMatches(const QString& pattern, int maxCount,
+        const DictionarySnapshotPtr& snapshot)
+{
+    if (snapshot)
+        return snapshot->count(pattern, maxCount);
+
+    const LengthIndex *index = lengthIndex(pattern.length());
+    if (!index)
+        return -1;
+
+    // Intersect the word lists of the known letters, smallest list first
+    const QString upperPattern = DictionaryEntry::normalizedWord(pattern);
+    QList< const QVector<int>* > lists;
+    for (int i = 0; i < upperPattern.length(); ++i) {
+        if (upperPattern[i] == '?')
+            continue;
+
+        QHash<QChar, QVector<int> >::const_iterator it
+            = index->positions[i].constFind(upperPattern[i]);
+        if (it == index->positions[i].constEnd())
+            return 0;
+
+        int insertAt = 0;
+        while (insertAt < lists.count() && lists[insertAt]->count() <= it.value().count())
+            ++insertAt;
+        lists.insert(insertAt, &it.value());
+    }
+    if (lists.isEmpty())
+        return qMin(index->wordCount, maxCount);
+
+    int count = 0;
+    foreach(int word, *lists.first()) {
+        bool matches = true;
+        for (int i = 1; i < lists.count() && matches; ++i)
+            matches = std::binary_search(lists[i]->constBegin(), lists[i]->constEnd(), word);
+
+        if (matches && ++count >= maxCount)
+            break;
+    }
+
+    return count;
+}
+
+DictionarySuggester::DictionarySuggester(const QString& driver,
+        const QString& hostName, const QString& databaseName,
+        const QString& userName, const QString& password, QObject* parent)
+    : QObject(parent), m_cache(MAX_CACHE_COST), m_latestRequestId(0),
+      m_latestCountRequestId(0), m_cacheClearedRequestId(0),
+      m_cacheClearedCountRequestId(0), m_queryRunning(false)
+{
+    qRegisterMetaType<QList<int> >("QList<int>");
+    qRegisterMetaType<DictionaryQuery>("DictionaryQuery");
+    qRegisterMetaType<DictionaryEntryList>("DictionaryEntryList");
+    qRegisterMetaType<DictionarySnapshotPtr>("DictionarySnapshotPtr");
+
+    m_debounceTimer = new QTimer(this);
+    m_debounceTimer->setSingleShot(true);
+    m_debounceTimer->setInterval(250);
+    connect(m_debounceTimer, SIGNAL(timeout()), this, SLOT(startPendingQuery()));
+
+    DictionarySuggestionWorker *worker = new DictionarySuggestionWorker(
+        driver, hostName, databaseName, userName, password,
+        &m_latestRequestId, &m_latestCountRequestId);
+    m_thread = new QThread(this);
+    worker->moveToThread(m_thread);
+    connect(m_thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+    connect(this, SIGNAL(runQueryRequest(int, DictionaryQuery, DictionarySnapshotPtr)),
+            worker, SLOT(runQuery(int, DictionaryQuery, DictionarySnapshotPtr)));
+    connect(worker, SIGNAL(queryFinished(int, DictionaryQuery, DictionaryEntryList)),
+            this, SLOT(queryFinished(int, DictionaryQuery, DictionaryEntryList)));
+    connect(worker, SIGNAL(queryFailed(int, DictionaryQuery)),
+            this, SLOT(queryFailed(int, DictionaryQuery)));
+    connect(this, SIGNAL(countPatternsRequest(int, QStringList, int, DictionarySnapshotPtr)),
+            worker, SLOT(countPatterns(int, QStringList, int, DictionarySnapshotPtr)));
+    connect(worker, SIGNAL(patternsCounted(int, QStringList, QList<int>)),
+            this, SLOT(countsFinished(int, QStringList, QList<int>)));
+    connect(this, SIGNAL(upgradeDatabaseRequest()), worker, SLOT(upgradeDatabase()));
+    connect(worker, SIGNAL(databaseUpgraded(bool)), this, SIGNAL(databaseUpgraded(bool)));
+    connect(this, SIGNAL(exportSnapshotRequest(int, QString)),
+            worker, SLOT(exportSnapshot(int, QString)));
+    connect(worker, SIGNAL(snapshotExported(int, QString, bool, QString)),
+            this, SIGNAL(snapshotExported(int, QString, bool, QString)));
+    connect(this, SIGNAL(clearPatternIndexRequest()), worker, SLOT(clearPatternIndex()));
+    m_thread->start();
+}
+
+DictionarySuggester::~DictionarySuggester()
+{
+    cancel();
+    m_latestCountRequestId.fetchAndAddOrdered(1);
+    m_thread->quit();
+    m_thread->wait();
+}
+
+int DictionarySuggester::debounceInterval() const
+{
+    return m_debounceTimer->interval();
+}
+
+void DictionarySuggester::setDebounceInterval(int msecs)
+{
+    m_debounceTimer->setInterval(msecs);
+}
+
+void DictionarySuggester::request(const DictionaryQuery& query, bool delayed)
+{
+    // Let a running query continue, if the same query is requested again
+    if (m_queryRunning && query.key() == m_pendingQuery.key())
+        return;
+
+    cancel();
+    m_pendingQuery = query;
+
+    DictionaryEntryList *cachedEntries = m_cache.object(query.key());
+    if (cachedEntries) {
+        emit suggestionsReady(query, *cachedEntries);
+        return;
+    }
+
+    if (delayed)
+        m_debounceTimer->start();
+    else
+        startPendingQuery();
+}
+
+void DictionarySuggester::cancel()
+{
+    m_debounceTimer->stop();
+    m_latestRequestId.fetchAndAddOrdered(1);
+    m_queryRunning = false;
+}
+
+void DictionarySuggester::requestCounts(const QStringList& patterns, int maxCount)
+{
+    const int requestId = m_latestCountRequestId.fetchAndAddOrdered(1) + 1;
+    emit countPatternsRequest(requestId, patterns, maxCount, m_snapshot);
+}
+
+void DictionarySuggester::upgradeDatabase()
+{
+    emit upgradeDatabaseRequest();
+}
+
+void DictionarySuggester::exportSnapshot(int requestId, const QString& fileName)
+{
+    emit exportSnapshotRequest(requestId, fileName);
+}
+
+void DictionarySuggester::clearCache()
+{
+    m_cache.clear();
+    emit clearPatternIndexRequest();
+    m_cacheClearedRequestId = m_latestRequestId.load();
+    m_cacheClearedCountRequestId = m_latestCountRequestId.load();
+    emit cacheCleared();
+}
+
+void DictionarySuggester::setSnapshot(const DictionarySnapshotPtr& snapshot)
+{
+    // The worker keeps a reference to the old snapshot while using it
+    m_snapshot = snapshot;
+    clearCache();
+}
+
+void DictionarySuggester::startPendingQuery()
+{
+    m_queryRunning = true;
+    emit runQueryRequest(m_latestRequestId.load(), m_pendingQuery, m_snapshot);
+}
+
+void DictionarySuggester::queryFinished(int requestId, const DictionaryQuery& query,
+                                        const DictionaryEntryList& entries)
+{
+    // Also cache results of cancelled requests, they may be requested again
+    if (requestId > m_cacheClearedRequestId)
+        m_cache.insert(query.key(), new DictionaryEntryList(entries), cacheCost(entries));
+
+    if (requestId == m_latestRequestId.load()) {
+        m_queryRunning = false;
+        emit suggestionsReady(query, entries);
+    }
+}
+
+int DictionarySuggester::cacheCost(const DictionaryEntryList& entries)
+{
+    // Count the strings and the list nodes, results bigger than the whole
+    // cache don't get cached
+    qint64 cost = sizeof(DictionaryEntryList);
+    foreach(const DictionaryEntry & entry, entries) {
+        cost += sizeof(DictionaryEntry) + sizeof(void*)
+                + (entry.word.size() + entry.clue.size()) * sizeof(QChar);
+    }
+    return static_cast<int>(qMin<qint64>(cost, MAX_CACHE_COST + 1));
+}
+
+void DictionarySuggester::queryFailed(int requestId, const DictionaryQuery& query)
+{
+    // Don't cache anything, the next request for this query tries again
+    if (requestId == m_latestRequestId.load()) {
+        m_queryRunning = false;
+        emit suggestionsReady(query, DictionaryEntryList());
+    }
+}
+
+void DictionarySuggester::countsFinished(int requestId, const QStringList& patterns,
+        const QList<int>& counts)
+{
+    // Counts of cancelled requests are reported too, but not outdated ones
+    if (requestId > m_cacheClearedCountRequestId)
+        emit patternsCounted(patterns.mid(0, counts.count()), counts);
+}
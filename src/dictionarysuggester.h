@@ -0,0 +1,300 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef DICTIONARYSUGGESTER_H
+#define DICTIONARYSUGGESTER_H
+
+#include <QObject>
+#include <QCache>
+#include <QAtomicInt>
+#include <QMetaType>
+#include <QStringList>
+#include <QSharedPointer>
+#include <QSqlDatabase>
+#include <QHash>
+#include <QVector>
+
+class QThread;
+class QTimer;
+class DictionarySnapshot;
+
+/** A word/clue pair found in the dictionary. */
+struct DictionaryEntry {
+    DictionaryEntry() : score(0), crossingFits(-1) {};
+
+    /** Words and patterns are compared in upper case. All suggested words
+    * and the words of snapshots are normalized using this function. */
+    static QString normalizedWord(const QString &word) {
+        return word.toUpper();
+    };
+
+    QString word;
+    QString clue;
+    int score;
+    /** The number of dictionary words, that still fit into the crossing
+    * answer with the fewest fitting words, if this word gets used (capped
+    * at @ref DictionarySuggestionWorker::MAX_CROSSING_FITS). 0 means that
+    * this word is a dead end, -1 that it wasn't ranked. */
+    int crossingFits;
+};
+typedef QList<DictionaryEntry> DictionaryEntryList;
+
+/** Sorts entries with more @ref DictionaryEntry::crossingFits first. */
+bool greaterThanCrossingFits(const DictionaryEntry &entry1, const DictionaryEntry &entry2);
+
+/** An answer crossing the answer to find suggestions for. */
+struct DictionaryCrossing {
+    DictionaryCrossing() : position(-1), crossingPosition(-1) {};
+
+    /** The letter index in the suggested word, where the crossing is. */
+    int position;
+    /** The current answer of the crossing clue, '?' for empty letters. */
+    QString pattern;
+    /** The letter index in @ref pattern, where the suggested word crosses. */
+    int crossingPosition;
+};
+
+/** Describes which dictionary entries to suggest for an answer. */
+struct DictionaryQuery {
+    DictionaryQuery() : length(-1), maxLength(-1), onlyWithClue(false), limit(-1) {};
+
+    /** A pattern with the wildcards '?' (one character) and '*' (any
+    * number of characters). An empty pattern matches all words. */
+    QString pattern;
+    /** Only words with this length are suggested, if it isn't -1. */
+    int length;
+    /** Only words with at most this length are suggested, if it isn't -1 and
+    * no @ref length is given. */
+    int maxLength;
+    /** Only words with a clue are suggested. */
+    bool onlyWithClue;
+    /** The maximal number of suggested words, -1 for no limit. */
+    int limit;
+    /** If not empty, suggested words get ranked by the number of dictionary
+    * words that still fit into these crossing answers.
+    * @see DictionaryEntry::crossingFits */
+    QList<DictionaryCrossing> crossings;
+
+    /** A string that is equal for equal queries, used as cache key. */
+    QString key() const;
+};
+
+typedef QSharedPointer<const DictionarySnapshot> DictionarySnapshotPtr;
+
+Q_DECLARE_METATYPE(DictionaryEntryList)
+Q_DECLARE_METATYPE(DictionaryQuery)
+Q_DECLARE_METATYPE(DictionarySnapshotPtr)
+
+/** Runs dictionary queries in a thread of it's own, using a database
+* connection of it's own. Used by @ref DictionarySuggester. */
+class DictionarySuggestionWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** Counting fitting words for crossings stops here. */
+    static const int MAX_CROSSING_FITS = 1000;
+
+    DictionarySuggestionWorker(const QString &driver, const QString &hostName,
+                               const QString &databaseName, const QString &userName,
+                               const QString &password, QAtomicInt *latestRequestId,
+                               QAtomicInt *latestCountRequestId);
+    virtual ~DictionarySuggestionWorker();
+
+public slots:
+    /** Runs @p query using @p snapshot if it's not null and can answer the
+    * query, otherwise using the database. */
+    void runQuery(int requestId, const DictionaryQuery &query,
+                  const DictionarySnapshotPtr &snapshot);
+    /** Counts the words matching each of @p patterns, stopping at
+    * @p maxCount. Counting stops early if the request gets cancelled or
+    * fails, the counts done until then are still reported. */
+    void countPatterns(int requestId, const QStringList &patterns, int maxCount,
+                       const DictionarySnapshotPtr &snapshot);
+    /** Builds tables missing in databases created by older versions. */
+    void upgradeDatabase();
+    /** Writes all dictionary entries into the snapshot file @p fileName. */
+    void exportSnapshot(int requestId, const QString &fileName);
+    /** Drops the pattern index, eg. after the dictionary has changed. */
+    void clearPatternIndex();
+
+signals:
+    void queryFinished(int requestId, const DictionaryQuery &query,
+                       const DictionaryEntryList &entries);
+    void queryFailed(int requestId, const DictionaryQuery &query);
+    /** @p counts contains the counts for the first patterns of the request. */
+    void patternsCounted(int requestId, const QStringList &patterns,
+                         const QList<int> &counts);
+    void databaseUpgraded(bool ok);
+    void snapshotExported(int requestId, const QString &fileName, bool ok,
+                          const QString &errorString);
+
+private:
+    bool isStale(int requestId) const {
+        return requestId != m_latestRequestId->load();
+    };
+    bool isCountStale(int requestId) const {
+        return requestId != m_latestCountRequestId->load();
+    };
+
+    QSqlDatabase database();
+    bool findEntries(int requestId, const DictionaryQuery &query,
+                     QSqlDatabase db, DictionaryEntryList *entries);
+    /** Sets @ref DictionaryEntry::crossingFits and sorts @p entries by it.
+    * Uses @p snapshot to count fitting words, if it's not null.
+    * @returns false if the request was cancelled. */
+    bool rankByCrossings(int requestId, const DictionaryQuery &query,
+                         const DictionarySnapshotPtr &snapshot,
+                         DictionaryEntryList *entries);
+    /** Counts the words matching @p pattern using @p snapshot, if it's not
+    * null, otherwise using the pattern index for the length of @p pattern.
+    * @returns -1 if the words couldn't be read from the database. */
+    int countMatches(const QString &pattern, int maxCount,
+                     const DictionarySnapshotPtr &snapshot);
+
+    /** The words of one length, indexed by the character at each position. */
+    struct LengthIndex {
+        LengthIndex() : wordCount(0) {};
+
+        int wordCount;
+        /** Sorted numbers of the words with a character at a position. */
+        QVector< QHash<QChar, QVector<int> > > positions;
+    };
+    /** Gets the pattern index for words with @p length characters. It's read
+    * from the database on first use. @returns NULL if reading failed. */
+    const LengthIndex *lengthIndex(int length);
+
+    QString m_connectionName;
+    QString m_driver, m_hostName, m_databaseName, m_userName, m_password;
+    QAtomicInt *m_latestRequestId;
+    QAtomicInt *m_latestCountRequestId;
+    QHash<int, LengthIndex> m_lengthIndices; // Pattern indices by word length
+};
+
+/** Looks up dictionary entries for answer patterns without blocking the GUI.
+*
+* Queries are run by a @ref DictionarySuggestionWorker in a background thread.
+* Only the result of the latest request gets reported with
+* @ref suggestionsReady(), older requests are cancelled, ie. skipped if they
+* didn't start yet or aborted while reading their results. Results of recent
+* queries are kept in a least recently used cache, so that going back to a
+* clue doesn't hit the database again. */
+class DictionarySuggester : public QObject
+{
+    Q_OBJECT
+
+public:
+    DictionarySuggester(const QString &driver, const QString &hostName,
+                        const QString &databaseName, const QString &userName,
+                        const QString &password, QObject* parent = 0);
+    virtual ~DictionarySuggester();
+
+    /** The time in milliseconds to wait for further requests before starting
+    * a delayed request. Default is 250. */
+    int debounceInterval() const;
+    void setDebounceInterval(int msecs);
+
+    /** Requests suggestions for @p query. This cancels all previous requests.
+    * @param delayed If true, the query is started after
+    * @ref debounceInterval() milliseconds without further requests, eg. for
+    * requests caused by typing. Cached results are always reported
+    * immediately. */
+    void request(const DictionaryQuery &query, bool delayed = false);
+    /** Cancels the current request, no results get reported for it. */
+    void cancel();
+
+    /** Counts the words matching each of @p patterns, which can only contain
+    * the wildcard '?', stopping at @p maxCount. Cancels the previous count
+    * request, but not requests for suggestions. Counts get reported with
+    * @ref patternsCounted(), also those of cancelled count requests. */
+    void requestCounts(const QStringList &patterns, int maxCount);
+
+    /** Builds tables missing in databases created by older versions in the
+    * background thread. Emits @ref databaseUpgraded() when done. */
+    void upgradeDatabase();
+
+    /** Writes a snapshot of the dictionary to @p fileName in the background
+    * thread. Emits @ref snapshotExported() with @p requestId when done. */
+    void exportSnapshot(int requestId, const QString &fileName);
+
+    /** Drops all cached results, eg. after the dictionary has changed.
+    * Emits @ref cacheCleared(). */
+    void clearCache();
+
+    /** Sets a memory mapped snapshot of the dictionary to answer queries
+    * from instead of the database, or null to use the database. */
+    void setSnapshot(const DictionarySnapshotPtr &snapshot);
+    DictionarySnapshotPtr snapshot() const {
+        return m_snapshot;
+    };
+
+signals:
+    /** Emitted when the results for the latest request are available. */
+    void suggestionsReady(const DictionaryQuery &query,
+                          const DictionaryEntryList &entries);
+    /** Emitted when counts requested with @ref requestCounts() are available.
+    * @p counts has one count for each of @p patterns. */
+    void patternsCounted(const QStringList &patterns, const QList<int> &counts);
+    /** Emitted when cached results were dropped, results obtained before
+    * may be outdated. */
+    void cacheCleared();
+    /** Emitted when a database upgrade started with @ref upgradeDatabase()
+    * is done. */
+    void databaseUpgraded(bool ok);
+    /** Emitted when a snapshot requested with @ref exportSnapshot() is
+    * written, or writing failed (@p ok is false). */
+    void snapshotExported(int requestId, const QString &fileName, bool ok,
+                          const QString &errorString);
+
+    /** Used to queue requests to the worker thread. */
+    void runQueryRequest(int requestId, const DictionaryQuery &query,
+                         const DictionarySnapshotPtr &snapshot);
+    void countPatternsRequest(int requestId, const QStringList &patterns,
+                              int maxCount, const DictionarySnapshotPtr &snapshot);
+    void upgradeDatabaseRequest();
+    void exportSnapshotRequest(int requestId, const QString &fileName);
+    void clearPatternIndexRequest();
+
+private slots:
+    void startPendingQuery();
+    void queryFinished(int requestId, const DictionaryQuery &query,
+                       const DictionaryEntryList &entries);
+    void queryFailed(int requestId, const DictionaryQuery &query);
+    void countsFinished(int requestId, const QStringList &patterns,
+                        const QList<int> &counts);
+
+private:
+    /** The maximal approximate size of all cached results in bytes. */
+    static const int MAX_CACHE_COST = 8 * 1024 * 1024;
+    /** The approximate size of @p entries in bytes, used as cache cost. */
+    static int cacheCost(const DictionaryEntryList &entries);
+
+    QThread *m_thread;
+    QTimer *m_debounceTimer;
+    QCache<QString, DictionaryEntryList> m_cache;
+    QAtomicInt m_latestRequestId;
+    QAtomicInt m_latestCountRequestId;
+    int m_cacheClearedRequestId; // Results of older requests aren't cached
+    int m_cacheClearedCountRequestId; // Counts of older requests are dropped
+    bool m_queryRunning; // Whether m_pendingQuery was sent to the worker
+    DictionaryQuery m_pendingQuery;
+    DictionarySnapshotPtr m_snapshot;
+};
+
+#endif // DICTIONARYSUGGESTER_H
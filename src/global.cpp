@@ -537,21 +537,33 @@ QString CrosswordTypeInfo::allowedChars() const
     return QString();
 }
 
-bool CrosswordTypeInfo::isCharacterLegal(const QChar& testCharacter) const
-{
-    qDebug() << testCharacter;
-    switch (letterCellContent) {
-    case Characters:
-        return QString::fromUtf8("ABCDEFGHIJKLMNOPQRSTUVWXYZÅÆŒØ")
-               .contains(testCharacter, Qt::CaseInsensitive);
-    case Digits:
-        return testCharacter.isDigit();
-    case CharactersOrDigits:
-        return testCharacter.isDigit() || QString::fromUtf8("ABCDEFGHIJKLMNOPQRSTUVWXYZÅÆŒØ")
-               .contains(testCharacter, Qt::CaseInsensitive);
+/** Builds the table of legal characters for @p letterCellContent, indexed
+* by the unicode value of the characters. */
+static QBitArray buildLegalCharacters(LetterCellContent letterCellContent)
+{
+    const QString characters = QString::fromUtf8("ABCDEFGHIJKLMNOPQRSTUVWXYZÅÆŒØ");
+    const bool allowCharacters = letterCellContent != Digits;
+    const bool allowDigits = letterCellContent != Characters;
+
+    QBitArray table(0x10000);
+    for (int i = 0; i < table.size(); ++i) {
+        const QChar ch(i);
+        if ((allowDigits && ch >= QLatin1Char('0') && ch <= QLatin1Char('9'))
+                || (allowCharacters && characters.contains(ch, Qt::CaseInsensitive))) {
+            table.setBit(i);
+        }
     }
+    return table;
+}
 
-    return false;
+const QBitArray &CrosswordTypeInfo::legalCharacters(LetterCellContent letterCellContent)
+{
+    // Initialized once, thread safe
+    static const QBitArray tables[] = { buildLegalCharacters(Characters),
+                                        buildLegalCharacters(Digits),
+                                        buildLegalCharacters(CharactersOrDigits)
+                                      };
+    return tables[ letterCellContent ];
 }
 
 QDataStream &operator <<(QDataStream &stream, CrosswordTypeInfo typeInfo)
@@ -24,6 +24,7 @@
 #include <QList>
 #include <QSize>
 #include <QRegExp>
+#include <QBitArray>
 #include <QDebug>
 
 #include "kgrid2d.h"
@@ -343,7 +344,15 @@ public:
     bool containsIllegalCharacters(const QString &testString) const {
         return testString.contains(QRegExp(QString("[^%1]").arg(allowedChars())));
     };
-    bool isCharacterLegal(const QChar &testCharacter) const;
+    /** Checks if @p testCharacter can be used in letter cells, using the
+    * table of @ref legalCharacters for the letter cell content. */
+    bool isCharacterLegal(const QChar &testCharacter) const {
+        return legalCharacters(letterCellContent).testBit(testCharacter.unicode());
+    };
+    /** Returns a table with a bit for each UTF-16 code unit, which is set for
+    * characters legal in letter cells with @p letterCellContent. The tables
+    * are built once, on first use. */
+    static const QBitArray &legalCharacters(LetterCellContent letterCellContent);
 
     CrosswordType crosswordType; /**< The type of crossword this description belongs to. */
     QString name; /**< The name of the crossword type. */
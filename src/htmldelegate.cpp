@@ -95,27 +95,48 @@ QWidget* CrosswordAnswerDelegate::createEditor(QWidget* parent, const QStyleOpti
     return lineEdit;
 }
 
+/** Removes all characters from @p input, which aren't set in @p legalCharacters. */
+static void removeIllegalCharacters(QString &input, const QBitArray &legalCharacters)
+{
+    int count = 0;
+    for (int i = 0; i < input.length(); ++i) {
+        if (legalCharacters.testBit(input.at(i).unicode()))
+            input[ count++ ] = input.at(i);
+    }
+    input.truncate(count);
+}
 
 CrosswordAnswerValidator::CrosswordAnswerValidator(const QString& allowedChars, QObject* parent) : QValidator(parent)
 {
     m_allowedChars = allowedChars;
+    m_legalCharacters = NULL;
 }
 
 CrosswordAnswerValidator::CrosswordAnswerValidator(const Crossword::CrosswordTypeInfo& crosswordType, QObject* parent) : QValidator(parent)
 {
     m_allowedChars = crosswordType.allowedChars();
+    m_legalCharacters = &Crossword::CrosswordTypeInfo::legalCharacters(
+                            crosswordType.letterCellContent);
 }
 
 QValidator::State CrosswordAnswerValidator::validate(QString &input, int &pos) const
 {
-    fix(input, &pos, m_allowedChars);
+    if (m_legalCharacters) {
+        replaceSpecialCharacters(input, &pos);
+        removeIllegalCharacters(input, *m_legalCharacters);
+    } else
+        fix(input, &pos, m_allowedChars);
 
     return Acceptable;
 }
 
 void CrosswordAnswerValidator::fixup(QString &input) const
 {
-    fix(input, m_allowedChars);
+    if (m_legalCharacters) {
+        replaceSpecialCharacters(input, NULL);
+        removeIllegalCharacters(input, *m_legalCharacters);
+    } else
+        fix(input, m_allowedChars);
 }
 
 void CrosswordAnswerValidator::fix(QString& input, const QString &allowedChars)
@@ -126,15 +147,23 @@ void CrosswordAnswerValidator::fix(QString& input, const QString &allowedChars)
 void CrosswordAnswerValidator::fix(QString& input,
                                    const Crossword::CrosswordTypeInfo& crosswordType)
 {
-    fix(input, NULL, crosswordType.allowedChars());
+    fix(input, NULL, crosswordType);
 }
 
 void CrosswordAnswerValidator::fix(QString& input, int* pos, const Crossword::CrosswordTypeInfo& crosswordType)
 {
-    fix(input, pos, crosswordType.allowedChars());
+    replaceSpecialCharacters(input, pos);
+    removeIllegalCharacters(input, Crossword::CrosswordTypeInfo::legalCharacters(
+                                crosswordType.letterCellContent));
 }
 
 void CrosswordAnswerValidator::fix(QString& input, int *pos, const QString &allowedChars)
+{
+    replaceSpecialCharacters(input, pos);
+    input.remove(QRegExp(QString("[^%1]").arg(QRegExp::escape(allowedChars))));
+}
+
+void CrosswordAnswerValidator::replaceSpecialCharacters(QString& input, int* pos)
 {
     static QHash< QChar, QString > replacements;
     if (replacements.isEmpty()) {
@@ -193,7 +222,6 @@ void CrosswordAnswerValidator::fix(QString& input, int *pos, const QString &allo
     }
 
     input = input.toUpper();
-    input.remove(QRegExp(QString("[^%1]").arg(QRegExp::escape(allowedChars))));
 }
 
 
@@ -66,7 +66,10 @@ public:
 private:
     static void fix(QString &input, int *pos, const QString &allowedChars = "A-Z");
     static void fix(QString &input, int *pos, const Crossword::CrosswordTypeInfo &crosswordType);
+    static void replaceSpecialCharacters(QString &input, int *pos);
+
     QString m_allowedChars;
+    const QBitArray *m_legalCharacters; // Used instead of m_allowedChars, if not NULL
 };
 
 #endif // HTMLDELEGATE_H
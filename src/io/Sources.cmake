@@ -1,5 +1,7 @@
 set( krossword_SRCS ${krossword_SRCS}
    io/krosswordxmlreader.cpp
    io/krosswordxmlwriter.cpp
+   io/krosswordbackgroundwriter.cpp
    io/krosswordpuzreader.cpp
+   io/krosswordbinarystream.cpp
 )
\ No newline at end of file
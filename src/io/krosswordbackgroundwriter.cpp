@@ -0,0 +1,162 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "krosswordbackgroundwriter.h"
+
+#include <QSaveFile>
+#include <QThread>
+#include <QDebug>
+#include <KZip>
+#include <KLocalizedString>
+
+/** Passes the data written by KZip through to a QSaveFile. KArchive::close()
+* closes the device of the archive, which QSaveFile doesn't allow, closing
+* this device leaves the QSaveFile open to be committed. */
+class SaveFileDevice : public QIODevice
+{
+public:
+    SaveFileDevice(QSaveFile *file) : QIODevice(), m_file(file) {};
+
+    virtual bool seek(qint64 pos) {
+        return QIODevice::seek(pos) && m_file->seek(pos);
+    };
+    virtual qint64 size() const {
+        return m_file->size();
+    };
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize) {
+        Q_UNUSED(data);
+        Q_UNUSED(maxSize);
+        return -1;
+    };
+
+    virtual qint64 writeData(const char *data, qint64 size) {
+        return m_file->write(data, size);
+    };
+
+private:
+    QSaveFile *m_file;
+};
+
+void KrossWordBackgroundWriterWorker::write(const CompressedKrossWordData &data,
+        const QString &fileName)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Couldn't write" << fileName << file.errorString();
+        emit written(fileName, false, file.errorString());
+        return;
+    }
+
+    SaveFileDevice device(&file);
+    KZip zip(&device);
+    if (!zip.open(QIODevice::WriteOnly)) {
+        qDebug() << "Couldn't open the ZIP archive for writing" << fileName;
+        file.cancelWriting();
+        emit written(fileName, false, i18n("Couldn't open the ZIP archive for writing"));
+        return;
+    }
+
+    KrossWordXmlWriter xmlWriter;
+    if (!xmlWriter.writeCompressedData(&zip, data)) {
+        file.cancelWriting();
+        emit written(fileName, false, xmlWriter.errorString());
+        return;
+    }
+    if (!zip.close()) {
+        qDebug() << "Couldn't close the ZIP archive" << fileName;
+        file.cancelWriting();
+        emit written(fileName, false, i18n("Couldn't close the ZIP archive"));
+        return;
+    }
+
+    // Replaces the file atomically, it's left untouched if writing failed
+    if (!file.commit()) {
+        qDebug() << "Couldn't commit" << fileName << file.errorString();
+        emit written(fileName, false, file.errorString());
+        return;
+    }
+
+    emit written(fileName, true, QString());
+}
+
+KrossWordBackgroundWriter::KrossWordBackgroundWriter(QObject *parent)
+    : QObject(parent), m_writing(false), m_hasPendingData(false)
+{
+    qRegisterMetaType<CompressedKrossWordData>("CompressedKrossWordData");
+
+    KrossWordBackgroundWriterWorker *worker = new KrossWordBackgroundWriterWorker;
+    m_thread = new QThread(this);
+    worker->moveToThread(m_thread);
+    connect(m_thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+    connect(this, SIGNAL(writeRequest(CompressedKrossWordData, QString)),
+            worker, SLOT(write(CompressedKrossWordData, QString)));
+    connect(worker, SIGNAL(written(QString, bool, QString)),
+            this, SLOT(workerWritten(QString, bool, QString)));
+    m_thread->start();
+}
+
+KrossWordBackgroundWriter::~KrossWordBackgroundWriter()
+{
+    // Lets the file being written be finished
+    m_thread->quit();
+    m_thread->wait();
+}
+
+bool KrossWordBackgroundWriter::write(KrossWord *krossWord, const QString &fileName,
+                                      KrossWord::WriteMode writeMode,
+                                      const QByteArray &undoData,
+                                      KrossWord::WriteOptions writeOptions,
+                                      QString *errorString)
+{
+    CompressedKrossWordData data;
+    KrossWordXmlWriter xmlWriter;
+    xmlWriter.setWriteOptions(writeOptions);
+    if (!xmlWriter.createCompressedData(krossWord, writeMode, undoData, &data)) {
+        if (errorString)
+            *errorString = xmlWriter.errorString();
+        return false;
+    }
+
+    if (m_writing) {
+        // Only the latest snapshot needs to be written
+        m_pendingData = data;
+        m_pendingFileName = fileName;
+        m_hasPendingData = true;
+    } else {
+        m_writing = true;
+        emit writeRequest(data, fileName);
+    }
+    return true;
+}
+
+void KrossWordBackgroundWriter::workerWritten(const QString &fileName, bool ok,
+        const QString &errorString)
+{
+    if (m_hasPendingData) {
+        m_hasPendingData = false;
+        emit writeRequest(m_pendingData, m_pendingFileName);
+        m_pendingData = CompressedKrossWordData();
+    } else {
+        m_writing = false;
+    }
+
+    emit written(fileName, ok, errorString);
+}
@@ -0,0 +1,94 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef KROSSWORDBACKGROUNDWRITER_H
+#define KROSSWORDBACKGROUNDWRITER_H
+
+#include "krosswordxmlwriter.h"
+
+#include <QObject>
+
+class QThread;
+
+/** Compresses and writes crossword files in a thread of it's own. Used by
+* @ref KrossWordBackgroundWriter. */
+class KrossWordBackgroundWriterWorker : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    /** Serializes and compresses @p data and writes it to @p fileName. The
+    * file gets replaced atomically through a QSaveFile, it isn't touched if
+    * writing fails. */
+    void write(const CompressedKrossWordData &data, const QString &fileName);
+
+signals:
+    void written(const QString &fileName, bool ok, const QString &errorString);
+};
+
+/** Writes compressed crosswords without blocking the GUI.
+*
+* The crossword gets copied into a @ref CompressedKrossWordData snapshot in
+* the GUI thread using KrossWordXmlWriter::createCompressedData(), which only
+* copies plain data. Serializing, compressing and writing to disk is done by a
+* @ref KrossWordBackgroundWriterWorker in a background thread, while the
+* crossword can be edited further. */
+class KrossWordBackgroundWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    KrossWordBackgroundWriter(QObject *parent = 0);
+    virtual ~KrossWordBackgroundWriter();
+
+    /** Takes a snapshot of @p krossWord and writes it to @p fileName in the
+    * background. If a file is being written, it gets written afterwards,
+    * replacing a snapshot that is still waiting to be written.
+    * @param writeOptions Options for KrossWordXmlWriter::setWriteOptions().
+    * @returns false if the snapshot couldn't be taken. */
+    bool write(KrossWord *krossWord, const QString &fileName,
+               KrossWord::WriteMode writeMode = KrossWord::Normal,
+               const QByteArray &undoData = QByteArray(),
+               KrossWord::WriteOptions writeOptions = KrossWord::NoWriteOptions,
+               QString *errorString = 0);
+
+    /** Whether a file is being written or waiting to be written. */
+    bool isWriting() const {
+        return m_writing;
+    };
+
+signals:
+    /** Emitted in the GUI thread after a file was written or writing failed. */
+    void written(const QString &fileName, bool ok, const QString &errorString);
+
+    /** Used to queue snapshots to the worker thread. */
+    void writeRequest(const CompressedKrossWordData &data, const QString &fileName);
+
+private slots:
+    void workerWritten(const QString &fileName, bool ok, const QString &errorString);
+
+private:
+    QThread *m_thread;
+    bool m_writing;
+    bool m_hasPendingData;
+    CompressedKrossWordData m_pendingData;
+    QString m_pendingFileName;
+};
+
+#endif // KROSSWORDBACKGROUNDWRITER_H
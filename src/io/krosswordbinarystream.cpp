@@ -0,0 +1,488 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "krosswordbinarystream.h"
+#include "krossword.h"
+#include "animator.h"
+#include "cells/imagecell.h"
+#include "cells/lettercell.h"
+#include "cells/cluecell.h"
+
+#include <QFile>
+#include <QBuffer>
+#include <QtEndian>
+#include <QDebug>
+#include <KLocalizedString>
+
+#include <limits>
+
+namespace
+{
+const char MAGIC[] = "KWPB";
+const int MAGIC_LENGTH = 4;
+const quint16 VERSION = 1;
+const quint8 CLUE_SELECTED_FLAG = 0x1;
+
+struct Crc32Table {
+    quint32 values[256];
+
+    Crc32Table() {
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+            values[i] = crc;
+        }
+    };
+};
+
+quint32 crc32(const uchar *data, qint64 size)
+{
+    static const Crc32Table table;
+    quint32 crc = 0xFFFFFFFF;
+    for (qint64 i = 0; i < size; ++i)
+        crc = table.values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+}
+
+/** Gets the string with @p index from the string table at @p stringsOffset,
+* which data ends at @p stringsEnd. */
+QString stringAt(const uchar *data, quint32 stringsOffset, quint32 stringCount,
+                 qint64 stringsEnd, quint32 index)
+{
+    if (index >= stringCount)
+        return QString();
+
+    const uchar *entry = data + stringsOffset + index * 8;
+    const quint32 offset = qFromLittleEndian<quint32>(entry);
+    const quint32 length = qFromLittleEndian<quint32>(entry + 4);
+    if (qint64(offset) + length > stringsEnd) {
+        qDebug() << "String" << index << "is out of the string table";
+        return QString();
+    }
+    return QString::fromUtf8(reinterpret_cast<const char*>(data + offset), length);
+}
+} // namespace
+
+KrossWordBinaryStream::KrossWordBinaryStream()
+{
+}
+
+bool KrossWordBinaryStream::isBinaryCrossword(const QByteArray& data)
+{
+    return data.startsWith(QByteArray::fromRawData(MAGIC, MAGIC_LENGTH));
+}
+
+bool KrossWordBinaryStream::write(QIODevice* device, KrossWord* krossWord,
+                                  KrossWord::WriteMode writeMode,
+                                  const QByteArray& undoData)
+{
+    Q_ASSERT(device);
+    Q_ASSERT(krossWord);
+    m_errorString.clear();
+
+    const CrosswordTypeInfo info = krossWord->crosswordTypeInfo();
+    const ClueCellList clueList = krossWord->clues();
+    const ImageCellList imageList = krossWord->images();
+    const SolutionLetterCellList solutionLetterList = krossWord->solutionWordLetters();
+    const bool isTemplate = writeMode == KrossWord::Template;
+
+    // Collect all strings first to know the size of the file
+    QList<QByteArray> strings;
+    for (int i = 0; i < MetaStringCount; ++i)
+        strings << QByteArray();
+    strings[TypeString] = info.typeString().toUtf8();
+    if (!isTemplate)
+        strings[TitleString] = krossWord->getTitle().toUtf8();
+    strings[AuthorsString] = krossWord->getAuthors().toUtf8();
+    strings[CopyrightString] = krossWord->getCopyright().toUtf8();
+    strings[NotesString] = krossWord->getNotes().toUtf8();
+    strings[LetterContentToClueNumberMappingString] =
+        krossWord->letterContentToClueNumberMapping().toUtf8();
+    if (info.crosswordType == UserDefinedCrossword) {
+        strings[UserTypeNameString] = info.name.toUtf8();
+        strings[UserTypeIconNameString] = info.iconName.toUtf8();
+        strings[UserTypeDescriptionString] = info.description.toUtf8();
+        strings[UserTypeMinAnswerLengthString] = QByteArray::number(info.minAnswerLength);
+        strings[UserTypeClueCellHandlingString] = CrosswordTypeInfo::
+                stringFromClueCellHandling(info.clueCellHandling).toUtf8();
+        strings[UserTypeClueTypeString] = CrosswordTypeInfo::
+                                          stringFromClueType(info.clueType).toUtf8();
+        strings[UserTypeLetterCellContentString] = CrosswordTypeInfo::
+                stringFromLetterCellContent(info.letterCellContent).toUtf8();
+        strings[UserTypeClueMappingString] = CrosswordTypeInfo::
+                                             stringFromClueMapping(info.clueMapping).toUtf8();
+        strings[UserTypeCellTypesString] = CrosswordTypeInfo::
+                                           stringListFromCellTypes(info.cellTypes).join(",").toUtf8();
+    }
+    foreach(ClueCell * clue, clueList)
+    strings << (isTemplate ? QByteArray() : clue->clue().toUtf8());
+    foreach(ImageCell * image, imageList)
+    strings << (isTemplate ? QByteArray()
+                : image->url().url(QUrl::PreferLocalFile).toUtf8());
+
+    qint64 stringDataSize = 0;
+    foreach(const QByteArray & string, strings)
+    stringDataSize += string.size();
+
+    const quint32 width = krossWord->width();
+    const quint32 height = krossWord->height();
+    const qint64 cellCount = qint64(width) * height;
+    const qint64 recordsOffset = HEADER_SIZE + cellCount * 6;
+    const qint64 stringsOffset = recordsOffset
+                                 + clueList.count() * CLUE_RECORD_SIZE
+                                 + imageList.count() * IMAGE_RECORD_SIZE
+                                 + solutionLetterList.count() * SOLUTION_LETTER_RECORD_SIZE;
+    const qint64 undoOffset = stringsOffset + strings.count() * 8 + stringDataSize;
+    const qint64 size = undoOffset + undoData.size();
+    if (size > std::numeric_limits<int>::max()) {
+        m_errorString = i18n("The crossword is too big for the binary format");
+        return false;
+    }
+
+    // Fill a buffer of the final size, to write it with a single call
+    QByteArray buffer(size, '\0');
+    uchar *data = reinterpret_cast<uchar*>(buffer.data());
+
+    uchar *correctPlane = data + HEADER_SIZE;
+    uchar *currentPlane = correctPlane + cellCount * 2;
+    uchar *typePlane = currentPlane + cellCount * 2;
+    uchar *confidencePlane = typePlane + cellCount;
+    for (quint32 y = 0; y < height; ++y) {
+        for (quint32 x = 0; x < width; ++x) {
+            const qint64 i = qint64(y) * width + x;
+            const KrossWordCell *cell = krossWord->at(Coord(x, y));
+            if (!cell)
+                continue;
+
+            typePlane[i] = static_cast<quint8>(cell->getCellType());
+            if (cell->isLetterCell()) {
+                const LetterCell *letter = static_cast<const LetterCell*>(cell);
+                const ushort correct = isTemplate
+                                       ? ushort(ClueCell::EmptyCorrectCharacter)
+                                       : letter->correctLetter().unicode();
+                const ushort current = isTemplate ? ushort(' ')
+                                       : letter->currentLetter().unicode();
+                qToLittleEndian<quint16>(correct, correctPlane + i * 2);
+                qToLittleEndian<quint16>(current, currentPlane + i * 2);
+                confidencePlane[i] = static_cast<quint8>(letter->confidence());
+            }
+        }
+    }
+
+    quint32 stringIndex = MetaStringCount;
+    uchar *record = data + recordsOffset;
+    foreach(ClueCell * clue, clueList) {
+        qToLittleEndian<qint16>(clue->coord().first, record);
+        qToLittleEndian<qint16>(clue->coord().second, record + 2);
+        record[4] = clue->orientation() == Qt::Horizontal ? 0 : 1;
+        record[5] = static_cast<quint8>(clue->answerOffset());
+        record[6] = clue->isHighlighted() ? CLUE_SELECTED_FLAG : 0;
+        qToLittleEndian<quint16>(clue->correctAnswer().length(), record + 8);
+        qToLittleEndian<quint32>(stringIndex++, record + 10);
+        record += CLUE_RECORD_SIZE;
+    }
+    foreach(ImageCell * image, imageList) {
+        qToLittleEndian<qint16>(image->coord().first, record);
+        qToLittleEndian<qint16>(image->coord().second, record + 2);
+        qToLittleEndian<quint16>(image->horizontalCellSpan(), record + 4);
+        qToLittleEndian<quint16>(image->verticalCellSpan(), record + 6);
+        qToLittleEndian<quint32>(stringIndex++, record + 8);
+        record += IMAGE_RECORD_SIZE;
+    }
+    foreach(SolutionLetterCell * letter, solutionLetterList) {
+        qToLittleEndian<qint16>(letter->coord().first, record);
+        qToLittleEndian<qint16>(letter->coord().second, record + 2);
+        qToLittleEndian<quint32>(letter->solutionWordIndex(), record + 4);
+        record += SOLUTION_LETTER_RECORD_SIZE;
+    }
+
+    uchar *stringIndexEntry = data + stringsOffset;
+    qint64 stringPos = stringsOffset + strings.count() * 8;
+    foreach(const QByteArray & string, strings) {
+        qToLittleEndian<quint32>(stringPos, stringIndexEntry);
+        qToLittleEndian<quint32>(string.size(), stringIndexEntry + 4);
+        memcpy(data + stringPos, string.constData(), string.size());
+        stringIndexEntry += 8;
+        stringPos += string.size();
+    }
+
+    if (!undoData.isEmpty())
+        memcpy(data + undoOffset, undoData.constData(), undoData.size());
+
+    memcpy(data, MAGIC, MAGIC_LENGTH);
+    qToLittleEndian<quint16>(VERSION, data + MAGIC_LENGTH);
+    uchar *header = data + 8;
+    qToLittleEndian<quint32>(width, header);
+    qToLittleEndian<quint32>(height, header + 4);
+    qToLittleEndian<quint32>(clueList.count(), header + 8);
+    qToLittleEndian<quint32>(imageList.count(), header + 12);
+    qToLittleEndian<quint32>(solutionLetterList.count(), header + 16);
+    qToLittleEndian<quint32>(strings.count(), header + 20);
+    qToLittleEndian<quint32>(recordsOffset, header + 24);
+    qToLittleEndian<quint32>(stringsOffset, header + 28);
+    qToLittleEndian<quint32>(undoOffset, header + 32);
+    qToLittleEndian<quint32>(undoData.size(), header + 36);
+    qToLittleEndian<quint32>(crc32(data + HEADER_SIZE, size - HEADER_SIZE), header + 40);
+
+    bool closeAfterWrite;
+    if ((closeAfterWrite = !device->isOpen())
+            && !device->open(QIODevice::WriteOnly)) {
+        m_errorString = device->errorString();
+        return false;
+    }
+
+    const bool writeOk = device->write(buffer) == buffer.size();
+    if (!writeOk)
+        m_errorString = device->errorString();
+
+    if (closeAfterWrite)
+        device->close();
+    return writeOk;
+}
+
+bool KrossWordBinaryStream::read(QIODevice* device, KrossWord* krossWord,
+                                 QByteArray* undoData)
+{
+    Q_ASSERT(device);
+    Q_ASSERT(krossWord);
+    m_errorString.clear();
+
+    bool closeAfterRead;
+    if ((closeAfterRead = !device->isOpen()) && !device->open(QIODevice::ReadOnly)) {
+        m_errorString = device->errorString();
+        return false;
+    }
+
+    bool readOk;
+    QFile *file = qobject_cast<QFile*>(device);
+    QBuffer *buffer = qobject_cast<QBuffer*>(device);
+    uchar *mappedData = file ? file->map(0, file->size()) : 0;
+    if (mappedData) {
+        readOk = readData(mappedData, file->size(), krossWord, undoData);
+        file->unmap(mappedData);
+    } else if (buffer) {
+        // Eg. the file mapped by KrossWord::read()
+        readOk = readData(reinterpret_cast<const uchar*>(buffer->data().constData()),
+                          buffer->data().size(), krossWord, undoData);
+    } else {
+        const QByteArray data = device->readAll();
+        readOk = readData(reinterpret_cast<const uchar*>(data.constData()),
+                          data.size(), krossWord, undoData);
+    }
+
+    if (closeAfterRead)
+        device->close();
+    return readOk;
+}
+
+bool KrossWordBinaryStream::readData(const uchar* data, qint64 size,
+                                     KrossWord* krossWord, QByteArray* undoData)
+{
+    if (size < HEADER_SIZE
+            || qstrncmp(reinterpret_cast<const char*>(data), MAGIC, MAGIC_LENGTH) != 0) {
+        m_errorString = i18n("The file is not a binary crossword file.");
+        return false;
+    }
+    if (qFromLittleEndian<quint16>(data + MAGIC_LENGTH) != VERSION) {
+        m_errorString = i18n("The binary crossword file has an unsupported version.");
+        return false;
+    }
+
+    const uchar *header = data + 8;
+    const quint32 width = qFromLittleEndian<quint32>(header);
+    const quint32 height = qFromLittleEndian<quint32>(header + 4);
+    const quint32 clueCount = qFromLittleEndian<quint32>(header + 8);
+    const quint32 imageCount = qFromLittleEndian<quint32>(header + 12);
+    const quint32 solutionLetterCount = qFromLittleEndian<quint32>(header + 16);
+    const quint32 stringCount = qFromLittleEndian<quint32>(header + 20);
+    const quint32 recordsOffset = qFromLittleEndian<quint32>(header + 24);
+    const quint32 stringsOffset = qFromLittleEndian<quint32>(header + 28);
+    const quint32 undoOffset = qFromLittleEndian<quint32>(header + 32);
+    const quint32 undoSize = qFromLittleEndian<quint32>(header + 36);
+    const quint32 checksum = qFromLittleEndian<quint32>(header + 40);
+
+    const qint64 cellCount = qint64(width) * height;
+    if (stringCount < MetaStringCount
+            || HEADER_SIZE + cellCount * 6 > recordsOffset
+            || recordsOffset + qint64(clueCount) * CLUE_RECORD_SIZE
+            + qint64(imageCount) * IMAGE_RECORD_SIZE
+            + qint64(solutionLetterCount) * SOLUTION_LETTER_RECORD_SIZE > stringsOffset
+            || stringsOffset + qint64(stringCount) * 8 > undoOffset
+            || qint64(undoOffset) + undoSize > size) {
+        qDebug() << "Binary crossword header is corrupt";
+        m_errorString = i18n("The binary crossword file is corrupt.");
+        return false;
+    }
+    if (crc32(data + HEADER_SIZE, size - HEADER_SIZE) != checksum) {
+        qDebug() << "Binary crossword checksum mismatch";
+        m_errorString = i18n("The binary crossword file is corrupt.");
+        return false;
+    }
+
+    const uchar *correctPlane = data + HEADER_SIZE;
+    const uchar *currentPlane = correctPlane + cellCount * 2;
+    const uchar *typePlane = currentPlane + cellCount * 2;
+    const uchar *confidencePlane = typePlane + cellCount;
+#define STRING_AT(index) stringAt(data, stringsOffset, stringCount, undoOffset, index)
+
+    const bool animationEnabled = krossWord->animator()->isEnabled();
+    krossWord->animator()->setEnabled(false);
+    krossWord->removeAllCells();
+    krossWord->createNew(CrosswordTypeInfo::typeFromString(STRING_AT(TypeString)),
+                         QSize(width, height));
+    krossWord->setTitle(STRING_AT(TitleString));
+    krossWord->setAuthors(STRING_AT(AuthorsString));
+    krossWord->setCopyright(STRING_AT(CopyrightString));
+    krossWord->setNotes(STRING_AT(NotesString));
+
+    if (krossWord->crosswordTypeInfo().crosswordType == UserDefinedCrossword) {
+        CrosswordTypeInfo info = krossWord->crosswordTypeInfo();
+        info.name = STRING_AT(UserTypeNameString);
+        info.iconName = STRING_AT(UserTypeIconNameString);
+        info.description = STRING_AT(UserTypeDescriptionString);
+        info.minAnswerLength = qMax(1, STRING_AT(UserTypeMinAnswerLengthString).toInt());
+        info.clueCellHandling = CrosswordTypeInfo::clueCellHandlingFromString(
+                                    STRING_AT(UserTypeClueCellHandlingString));
+        info.clueType = CrosswordTypeInfo::clueTypeFromString(
+                            STRING_AT(UserTypeClueTypeString));
+        info.letterCellContent = CrosswordTypeInfo::letterCellContentFromString(
+                                     STRING_AT(UserTypeLetterCellContentString));
+        info.clueMapping = CrosswordTypeInfo::clueMappingFromString(
+                               STRING_AT(UserTypeClueMappingString));
+        info.cellTypes = CrosswordTypeInfo::cellTypesFromStringList(
+                             STRING_AT(UserTypeCellTypesString).split(','));
+        krossWord->setCrosswordTypeInfo(info);
+    }
+
+    const bool letterContentToClueNumberMappingUsed =
+        krossWord->crosswordTypeInfo().clueType == NumberClues1To26
+        && krossWord->crosswordTypeInfo().clueMapping == CluesReferToCells
+        && krossWord->crosswordTypeInfo().letterCellContent == Crossword::Characters;
+    if (letterContentToClueNumberMappingUsed) {
+        krossWord->setLetterContentToClueNumberMapping(
+            STRING_AT(LetterContentToClueNumberMappingString), false);
+    }
+
+    // Answers are taken from the correct letter plane
+    const uchar *record = data + recordsOffset;
+    for (quint32 i = 0; i < clueCount; ++i, record += CLUE_RECORD_SIZE) {
+        const Coord coord(qFromLittleEndian<qint16>(record),
+                          qFromLittleEndian<qint16>(record + 2));
+        const Qt::Orientation orientation = record[4] == 0 ? Qt::Horizontal : Qt::Vertical;
+        const AnswerOffset answerOffset = static_cast<AnswerOffset>(record[5]);
+        const int answerLength = qFromLittleEndian<quint16>(record + 8);
+        if (answerOffset == OffsetInvalid || answerOffset > OffsetTopRight
+                || answerLength == 0) {
+            qDebug() << "Invalid clue record at" << coord;
+            continue;
+        }
+
+        QString answer;
+        answer.reserve(answerLength);
+        foreach(const Coord & letterCoord, ClueCell::answerCoordList(
+                    coord, answerOffset, orientation, answerLength)) {
+            if (letterCoord.first < 0 || letterCoord.second < 0
+                    || uint(letterCoord.first) >= width
+                    || uint(letterCoord.second) >= height) {
+                answer.clear();
+                break;
+            }
+            const qint64 cellIndex = qint64(letterCoord.second) * width + letterCoord.first;
+            answer.append(QChar(qFromLittleEndian<quint16>(correctPlane + cellIndex * 2)));
+        }
+        if (answer.isEmpty()) {
+            qDebug() << "The answer of the clue at" << coord << "is out of the grid";
+            continue;
+        }
+
+        ClueCell *clueCell;
+        ErrorType errorType = krossWord->insertClue(
+                                  coord, orientation, answerOffset,
+                                  STRING_AT(qFromLittleEndian<quint32>(record + 10)),
+                                  answer, LetterCellType, DontIgnoreErrors, true,
+                                  &clueCell);
+        if (errorType == ErrorNone) {
+            if (record[6] & CLUE_SELECTED_FLAG)
+                clueCell->setHighlight();
+        } else
+            qDebug() << KrossWord::errorMessageFromErrorType(errorType);
+    }
+
+    // Set current letters before letters get converted to solution letters
+    for (qint64 i = 0; i < cellCount; ++i) {
+        if (!(typePlane[i] & (LetterCellType | SolutionLetterCellType)))
+            continue;
+
+        KrossWordCell *cell = krossWord->at(Coord(i % width, i / width));
+        if (cell && cell->isLetterCell()) {
+            static_cast<LetterCell*>(cell)->setCurrentLetter(
+                QChar(qFromLittleEndian<quint16>(currentPlane + i * 2)));
+        }
+    }
+
+    for (quint32 i = 0; i < imageCount; ++i, record += IMAGE_RECORD_SIZE) {
+        const Coord coord(qFromLittleEndian<qint16>(record),
+                          qFromLittleEndian<qint16>(record + 2));
+        ImageCell *imageCell;
+        ErrorType errorType = krossWord->insertImage(
+                                  coord, qFromLittleEndian<quint16>(record + 4),
+                                  qFromLittleEndian<quint16>(record + 6),
+                                  QUrl(STRING_AT(qFromLittleEndian<quint32>(record + 8))),
+                                  DontIgnoreErrors, &imageCell);
+        if (errorType != ErrorNone)
+            qDebug() << KrossWord::errorMessageFromErrorType(errorType);
+    }
+
+    for (quint32 i = 0; i < solutionLetterCount; ++i, record += SOLUTION_LETTER_RECORD_SIZE) {
+        const Coord coord(qFromLittleEndian<qint16>(record),
+                          qFromLittleEndian<qint16>(record + 2));
+        LetterCell *letter = qgraphicsitem_cast< LetterCell* >(krossWord->at(coord));
+        if (letter)
+            letter->toSolutionLetter(qFromLittleEndian<quint32>(record + 4));
+        else
+            qDebug() << QString("No letter cell at (%1, %2) to convert to a solution letter")
+                     .arg(coord.first).arg(coord.second);
+    }
+#undef STRING_AT
+
+    krossWord->assignClueNumbers();
+
+    if (letterContentToClueNumberMappingUsed)
+        krossWord->setupSameLetterSynchronization();
+
+    for (qint64 i = 0; i < cellCount; ++i) {
+        if (!(typePlane[i] & (LetterCellType | SolutionLetterCellType))
+                || confidencePlane[i] == Confident)
+            continue;
+
+        KrossWordCell *cell = krossWord->at(Coord(i % width, i / width));
+        if (cell && cell->isLetterCell())
+            static_cast<LetterCell*>(cell)->setConfidence(
+                static_cast<Confidence>(confidencePlane[i]));
+    }
+    krossWord->animator()->setEnabled(animationEnabled);
+
+    if (undoData) {
+        *undoData = QByteArray(reinterpret_cast<const char*>(data + undoOffset),
+                               undoSize);
+    }
+
+    return true;
+}
@@ -0,0 +1,104 @@
+/*
+*   Copyright 2010 Friedrich Pülz <fpuelz@gmx.de>
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU Library General Public License as
+*   published by the Free Software Foundation; either version 2 or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details
+*
+*   You should have received a copy of the GNU Library General Public
+*   License along with this program; if not, write to the
+*   Free Software Foundation, Inc.,
+*   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef KROSSWORDBINARYSTREAM_H
+#define KROSSWORDBINARYSTREAM_H
+
+#include <krossword.h>
+
+class QIODevice;
+
+namespace Crossword
+{
+class KrossWord;
+}
+using namespace Crossword;
+
+/** Reads and writes crosswords in the compact binary format (*.kwpb), which
+* is much faster to read than XML for big crosswords.
+*
+* All values are stored little-endian. The file starts with a header of
+* @ref HEADER_SIZE bytes: "KWPB", a quint16 version, a quint16 reserved for
+* flags, and quint32 values for the width, the height, the number of clues,
+* images, solution letters and strings, the offsets of the records, the
+* string table and the undo data, the size of the undo data and a CRC-32 of
+* everything following the header.
+*
+* The header is followed by four planes with one value per cell in row
+* order: the correct letters (quint16), the current letters (quint16), the
+* cell types (quint8, see CellType) and the confidences of letter cells
+* (quint8, see Confidence). Then follow fixed size records for clues, images
+* and solution letters. Texts are stored in a string table, that is an index
+* of quint32 offsets and lengths followed by UTF-8 data. The first
+* @ref MetaStringCount strings contain the crossword properties.
+*
+* Files get memory mapped for reading, if the device is a QFile. The data
+* of a QBuffer gets read without copying it. */
+class KrossWordBinaryStream
+{
+public:
+    static const int HEADER_SIZE = 56;
+    static const int CLUE_RECORD_SIZE = 14;
+    static const int IMAGE_RECORD_SIZE = 12;
+    static const int SOLUTION_LETTER_RECORD_SIZE = 8;
+
+    /** Indices of the crossword properties in the string table. */
+    enum MetaString {
+        TypeString = 0,
+        TitleString,
+        AuthorsString,
+        CopyrightString,
+        NotesString,
+        LetterContentToClueNumberMappingString,
+        UserTypeNameString,
+        UserTypeIconNameString,
+        UserTypeDescriptionString,
+        UserTypeMinAnswerLengthString,
+        UserTypeClueCellHandlingString,
+        UserTypeClueTypeString,
+        UserTypeLetterCellContentString,
+        UserTypeClueMappingString,
+        UserTypeCellTypesString,
+
+        MetaStringCount
+    };
+
+    KrossWordBinaryStream();
+
+    /** Checks the magic bytes at the beginning of @p data. */
+    static bool isBinaryCrossword(const QByteArray &data);
+
+    bool read(QIODevice *device, KrossWord *krossWord,
+              QByteArray *undoData = NULL);
+    bool write(QIODevice *device, KrossWord *krossWord,
+               KrossWord::WriteMode writeMode = KrossWord::Normal,
+               const QByteArray &undoData = QByteArray());
+
+    QString errorString() const {
+        return m_errorString;
+    };
+
+private:
+    bool readData(const uchar *data, qint64 size, KrossWord *krossWord,
+                  QByteArray *undoData);
+
+    QString m_errorString;
+};
+
+#endif // KROSSWORDBINARYSTREAM_H
@@ -169,6 +169,30 @@ bool KrossWordPuzStream::read(QIODevice *device,
     return true;
 }
 
+bool KrossWordPuzStream::verifyChecksums(QIODevice* device, QStringList* mismatches)
+{
+    PuzChecksums checksums;
+    KrossWordData krossWordData;
+    if (!read(device, &krossWordData, &checksums))
+        return false;
+
+    QStringList wrongChecksums;
+    PuzChecksums generatedChecksums = generateChecksums(device, krossWordData);
+    if (checksums.main != generatedChecksums.main)
+        wrongChecksums << "main";
+    if (checksums.cib != generatedChecksums.cib)
+        wrongChecksums << "cib";
+    for (int i = 0; i < qMin(checksums.masked.count(),
+                             generatedChecksums.masked.count()); ++i) {
+        if (checksums.masked[i] != generatedChecksums.masked[i])
+            wrongChecksums << QString("masked%1").arg(i);
+    }
+
+    if (mismatches)
+        *mismatches = wrongChecksums;
+    return wrongChecksums.isEmpty();
+}
+
 bool KrossWordPuzStream::read(QIODevice* device, KrossWord* krossWord)
 {
     Q_ASSERT(krossWord);
@@ -26,6 +26,7 @@
 
 class QBuffer;
 class QString;
+class QStringList;
 class QIODevice;
 
 namespace Crossword
@@ -97,6 +98,11 @@ public:
     bool read(QIODevice *device, KrossWordData *krossWordData,
               PuzChecksums *checksums);
     bool read(QIODevice *device, KrossWord *krossWord);
+    /** Compares the checksums stored in the .puz file in @p device with
+    * checksums generated from it's contents.
+    * @param mismatches Gets the names of the checksums that don't match.
+    * @returns False, if the file couldn't be read or a checksum doesn't match. */
+    bool verifyChecksums(QIODevice *device, QStringList *mismatches = NULL);
     bool write(QIODevice *device, KrossWord *krossWord,
                KrossWord::WriteMode writeMode = KrossWord::Normal);
 
@@ -29,6 +29,12 @@
 
 #include <KZip>
 #include <QUrl>
+#include <QDataStream>
+#include <QImage>
+
+const QString KrossWordXmlReader::INFO_ENTRY_NAME = "info.kwpi";
+const QString KrossWordXmlReader::THUMBNAIL_ENTRY_PREFIX = "thumbnail-";
+const QString KrossWordXmlReader::UNDO_ENTRY_NAME = "undo.kwpu";
 
 KrossWordXmlReader::KrossWordXmlReader()
 {
@@ -112,6 +118,9 @@ bool KrossWordXmlReader::readCompressedInfo(QIODevice* device,
 {
     Q_ASSERT(device);
 
+    if (readStoredInfo(device, krossWordInfo))
+        return true;
+
     // Read compressed XML from the given IO device
     KZip zip(device);
     zip.setCompression(KZip::DeflateCompression);
@@ -149,6 +158,175 @@ bool KrossWordXmlReader::readCompressedInfo(QIODevice* device,
     return readOk;
 }
 
+bool KrossWordXmlReader::readStoredEntryHeader(QIODevice* device,
+        KrossWordXmlReader::StoredEntry* entry)
+{
+    // Size of a ZIP local file header without the file name and extra field
+    const int localHeaderSize = 30;
+
+    const QByteArray header = device->read(localHeaderSize);
+    if (header.size() < localHeaderSize || !header.startsWith("PK\x03\x04"))
+        return false;
+
+    QDataStream stream(header);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    quint32 signature, crc, compressedSize, size;
+    quint16 version, flags, method, time, date, nameLength, extraLength;
+    stream >> signature >> version >> flags >> method >> time >> date
+           >> crc >> compressedSize >> size >> nameLength >> extraLength;
+
+    // The entry needs to be stored uncompressed with the sizes in the
+    // local header (flag bit 3 isn't set)
+    if (method != 0 || (flags & 0x08) || compressedSize != size)
+        return false;
+
+    const QByteArray name = device->read(nameLength);
+    if (name.size() != nameLength)
+        return false;
+
+    entry->name = QString::fromUtf8(name);
+    entry->dataPos = device->pos() + extraLength;
+    entry->size = size;
+    return device->seek(entry->dataPos);
+}
+
+bool KrossWordXmlReader::readStoredInfo(QIODevice* device,
+        KrossWordXmlReader::KrossWordInfo& krossWordInfo)
+{
+    bool closeAfterRead;
+    if ((closeAfterRead = !device->isOpen()) && !device->open(QIODevice::ReadOnly))
+        return false;
+    const qint64 startPos = device->pos();
+
+    // QFile buffers reads, so this reads only the beginning of the file
+    StoredEntry entry;
+    bool readOk = false;
+    if (readStoredEntryHeader(device, &entry) && entry.name == INFO_ENTRY_NAME) {
+        const QByteArray data = device->read(entry.size);
+        if (data.size() == int(entry.size))
+            readOk = readStoredInfoData(data, krossWordInfo);
+    }
+
+    if (closeAfterRead)
+        device->close();
+    else
+        device->seek(startPos);
+    return readOk;
+}
+
+QImage KrossWordXmlReader::readThumbnail(const QString& fileName, const QSize& size)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QImage();
+
+    // Thumbnails follow the info entry, walk through the stored entries at
+    // the beginning of the archive without reading the archive directory
+    const int requestedSize = qMax(size.width(), size.height());
+    StoredEntry entry, bestEntry;
+    int bestSize = -1;
+    while (readStoredEntryHeader(&file, &entry)) {
+        if (entry.name.startsWith(THUMBNAIL_ENTRY_PREFIX)
+                && entry.name.endsWith(".png")) {
+            const int thumbnailSize = entry.name.mid(THUMBNAIL_ENTRY_PREFIX.length())
+                                      .section('.', 0, 0).toInt();
+            // Use the smallest thumbnail that is big enough, otherwise the
+            // biggest one
+            if (bestSize == -1
+                    || (bestSize < requestedSize && thumbnailSize > bestSize)
+                    || (thumbnailSize >= requestedSize && thumbnailSize < bestSize)) {
+                bestEntry = entry;
+                bestSize = thumbnailSize;
+            }
+        } else if (entry.name != INFO_ENTRY_NAME) {
+            break;
+        }
+
+        if (!file.seek(entry.dataPos + entry.size))
+            break;
+    }
+
+    if (bestSize == -1 || !file.seek(bestEntry.dataPos))
+        return QImage();
+
+    QImage image;
+    image.loadFromData(file.read(bestEntry.size), "PNG");
+    return image;
+}
+
+bool KrossWordXmlReader::readUndoData(const QString& fileName, QByteArray* undoData)
+{
+    Q_ASSERT(undoData);
+
+    KZip zip(fileName);
+    if (!zip.open(QIODevice::ReadOnly)) {
+        qDebug() << "Couldn't open the ZIP archive for reading" << fileName;
+        return false;
+    }
+    const KArchiveDirectory *archive = zip.directory();
+    const KArchiveEntry *undoEntry = archive ? archive->entry(UNDO_ENTRY_NAME) : NULL;
+    if (!undoEntry || !undoEntry->isFile()) {
+        zip.close();
+        return false; // No edit history stored
+    }
+
+    *undoData = static_cast<const KArchiveFile*>(undoEntry)->data();
+    zip.close();
+    return true;
+}
+
+bool KrossWordXmlReader::readStoredInfoData(const QByteArray& data,
+        KrossWordXmlReader::KrossWordInfo& krossWordInfo)
+{
+    clear();
+    addData(data);
+
+    while (!atEnd()) {
+        readNext();
+
+        if (isStartElement()) {
+            if (name().compare(QLatin1String("krossWordInfo"), Qt::CaseInsensitive) != 0
+                    || attributes().value("version") != "1.0")
+                return false;
+
+            KrossWordInfo info;
+            info.type = attributes().value("type").toString();
+            info.width = attributes().value("width").toString().toInt();
+            info.height = attributes().value("height").toString().toInt();
+            if (attributes().hasAttribute("clueCount"))
+                info.clueCount = attributes().value("clueCount").toString().toInt();
+            if (attributes().hasAttribute("progress"))
+                info.progress = attributes().value("progress").toString().toFloat();
+
+            while (!atEnd()) {
+                readNext();
+                if (isEndElement())
+                    break;
+
+                if (isStartElement()) {
+                    if (name().compare(QLatin1String("title"), Qt::CaseInsensitive) == 0)
+                        info.title = readElementText();
+                    else if (name().compare(QLatin1String("authors"), Qt::CaseInsensitive) == 0)
+                        info.authors = readElementText();
+                    else if (name().compare(QLatin1String("copyright"), Qt::CaseInsensitive) == 0)
+                        info.copyright = readElementText();
+                    else if (name().compare(QLatin1String("notes"), Qt::CaseInsensitive) == 0)
+                        info.notes = readElementText();
+                    else
+                        skipCurrentElement();
+                }
+            }
+
+            if (error() || !info.isValid())
+                return false;
+            krossWordInfo = info;
+            return true;
+        }
+    }
+
+    return false;
+}
+
 bool KrossWordXmlReader::read(QIODevice* device, KrossWord *krossWord,
                               QByteArray *undoData)
 {
@@ -608,6 +786,8 @@ KrossWordXmlReader::KrossWordInfo::KrossWordInfo(
     this->authors = other.authors;
     this->copyright = other.copyright;
     this->notes = other.notes;
+    this->clueCount = other.clueCount;
+    this->progress = other.progress;
 }
 
 KrossWordXmlReader::KrossWordInfo::KrossWordInfo(const QString& type,
@@ -622,6 +802,8 @@ KrossWordXmlReader::KrossWordInfo::KrossWordInfo(const QString& type,
     this->authors = authors;
     this->copyright = copyright;
     this->notes = notes;
+    this->clueCount = -1;
+    this->progress = -1.0f;
 }
 
 
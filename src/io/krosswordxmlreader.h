@@ -23,6 +23,8 @@
 #include <QXmlStreamReader>
 #include <QUrl>
 
+class QImage;
+
 namespace Crossword
 {
 class KrossWord;
@@ -34,12 +36,30 @@ class KrossWordXmlReader : public QXmlStreamReader
 public:
     KrossWordXmlReader();
 
+    /** The name of the uncompressed entry with the crossword info, that is
+    * written as first entry into compressed crosswords. */
+    static const QString INFO_ENTRY_NAME;
+    /** Thumbnails are stored uncompressed after the info entry as PNG images
+    * named THUMBNAIL_ENTRY_PREFIX + size + ".png", eg. "thumbnail-64.png". */
+    static const QString THUMBNAIL_ENTRY_PREFIX;
+    /** The name of the entry with the raw undo data of compressed crosswords.
+    * It isn't read by @ref readCompressed(), but with @ref readUndoData(). */
+    static const QString UNDO_ENTRY_NAME;
+
     struct KrossWordInfo {
         int width, height;
         QString type, title, authors, copyright, notes;
+        /** The number of clues or -1 if unknown. Only stored in the info
+        * entry of compressed crosswords. */
+        int clueCount;
+        /** The percentage of solved letter cells (0.0 - 1.0) or -1 if
+        * unknown. Only stored in the info entry of compressed crosswords. */
+        float progress;
 
         KrossWordInfo() {
             this->width = this->height = -1; // make invalid initially
+            this->clueCount = -1;
+            this->progress = -1.0f;
         };
 
         KrossWordInfo(const KrossWordInfo &other);
@@ -60,8 +80,22 @@ public:
     * explaining the error (if @p errorString isn't NULL). */
     static KrossWordInfo readInfo(const QUrl &url, QString *errorString = NULL);
 
+    /** Reads the thumbnail embedded in the compressed crossword @p fileName,
+    * that fits @p size best, without reading the crossword itself.
+    * @returns A null image if the file has no embedded thumbnails. */
+    static QImage readThumbnail(const QString &fileName, const QSize &size);
+
+    /** Reads the undo data stored in the compressed crossword @p fileName,
+    * without reading the crossword itself.
+    * @returns false if the file has no undo entry, eg. files written before
+    * undo data was stored as entry of it's own. These have their undo data
+    * in the crossword XML, which gets read by @ref readCompressed(). */
+    static bool readUndoData(const QString &fileName, QByteArray *undoData);
+
     bool readCompressed(QIODevice *device, KrossWord *krossWord,
                         QByteArray *undoData = NULL);
+    /** Reads the info entry of a compressed crossword. Falls back to reading
+    * the info from the crossword itself for files without an info entry. */
     bool readCompressedInfo(QIODevice *device, KrossWordInfo &krossWordInfo);
 
     bool read(QIODevice *device, KrossWord *krossWord,
@@ -69,6 +103,23 @@ public:
     bool readInfo(QIODevice *device, KrossWordInfo &krossWordInfo);
 
 private:
+    struct StoredEntry {
+        QString name;
+        qint64 dataPos;
+        quint32 size;
+    };
+    /** Reads the ZIP local file header at the current position of @p device
+    * and seeks to the data of the entry.
+    * @returns false if there is no header or the entry isn't stored
+    * uncompressed with it's size in the header. */
+    static bool readStoredEntryHeader(QIODevice *device, StoredEntry *entry);
+
+    /** Reads the info entry, if it is the first entry of the archive in
+    * @p device. Only the beginning of the file gets read.
+    * @returns false if there is no such entry, eg. in older files. */
+    bool readStoredInfo(QIODevice *device, KrossWordInfo &krossWordInfo);
+    bool readStoredInfoData(const QByteArray &data, KrossWordInfo &krossWordInfo);
+
     void readUnknownElement();
     KrossWordInfo readKrossWordInfo();
     void readKrossWord(KrossWord *krossWord, QByteArray *undoData = NULL);
@@ -18,14 +18,68 @@
 */
 
 #include "krosswordxmlwriter.h"
+#include "krosswordxmlreader.h"
 #include "krossword.h"
 #include "cells/imagecell.h"
 #include "cells/lettercell.h"
 #include "cells/cluecell.h"
 
 #include <QBuffer>
+#include <QImage>
 #include <KZip>
 
+/** Writes into the current entry of a KZip archive. Data gets collected into
+* chunks, because the XML writer does lots of tiny writes. */
+class ArchiveEntryDevice : public QIODevice
+{
+public:
+    ArchiveEntryDevice(KZip *zip) : QIODevice(), m_zip(zip),
+        m_writtenSize(0), m_failed(false) {
+        m_buffer.reserve(CHUNK_SIZE);
+    };
+
+    virtual bool isSequential() const {
+        return true;
+    };
+
+    /** Writes buffered data into the archive. */
+    bool flushBuffer() {
+        if (!m_failed && !m_buffer.isEmpty()) {
+            m_failed = !m_zip->writeData(m_buffer.constData(), m_buffer.size());
+            m_buffer.clear();
+        }
+        return !m_failed;
+    };
+
+    /** The number of uncompressed bytes written. */
+    qint64 writtenSize() const {
+        return m_writtenSize;
+    };
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize) {
+        Q_UNUSED(data);
+        Q_UNUSED(maxSize);
+        return -1;
+    };
+
+    virtual qint64 writeData(const char *data, qint64 size) {
+        m_buffer.append(data, size);
+        m_writtenSize += size;
+        if (m_buffer.size() >= CHUNK_SIZE && !flushBuffer())
+            return -1;
+        return size;
+    };
+
+private:
+    static const int CHUNK_SIZE = 64 * 1024;
+
+    KZip *m_zip;
+    QByteArray m_buffer;
+    qint64 m_writtenSize;
+    bool m_failed;
+};
+
 bool KrossWordXmlWriter::writeCompressed(QIODevice* device,
         KrossWord* krossWord,
         KrossWord::WriteMode writeMode,
@@ -35,44 +89,199 @@ bool KrossWordXmlWriter::writeCompressed(QIODevice* device,
     Q_ASSERT(krossWord);
     m_errorString.clear();
 
-    // Write XML to a buffer
-    QBuffer buffer;
-    buffer.open(QBuffer::WriteOnly);
-    bool writeOk = write(&buffer, krossWord, writeMode, undoData);
-    buffer.close();
-
-    if (!writeOk)
-        return false;
-
     // Write compressed XML to the given IO device
     KZip zip(device);
-    zip.setCompression(KZip::DeflateCompression);
     if (!zip.open(QIODevice::WriteOnly)) {
         qDebug() << "Couldn't open the ZIP archive for writing";
         m_errorString = i18n("Couldn't open the ZIP archive for writing");
         return false;
     }
-    if (!zip.prepareWriting("crossword.kwp", "krosswordpuzzle",
-                            "krosswordpuzzle", buffer.size())) {
+
+    // The info entry is stored uncompressed as first entry followed by the
+    // thumbnails, so that readers find them at the beginning of the file
+    zip.setCompression(KZip::NoCompression);
+    if (!writeArchiveEntry(&zip, KrossWordXmlReader::INFO_ENTRY_NAME,
+                           infoData(krossWord, writeMode)))
+        return false;
+    if (m_writeOptions.testFlag(KrossWord::EmbedThumbnails)
+            && writeMode == KrossWord::Normal
+            && !writeThumbnails(&zip, thumbnailImage(krossWord)))
+        return false;
+
+    zip.setCompression(m_writeOptions.testFlag(KrossWord::FastWrite)
+                       ? KZip::NoCompression : KZip::DeflateCompression);
+    if (!writeCrosswordEntry(&zip, createXmlData(krossWord, writeMode)))
+        return false;
+
+    // The undo data gets stored as raw binary entry after the crossword, it's
+    // only read when the edit history is needed
+    if (!undoData.isEmpty()
+            && !writeArchiveEntry(&zip, KrossWordXmlReader::UNDO_ENTRY_NAME, undoData))
+        return false;
+
+    if (!zip.close()) {
+        qDebug() << "Couldn't close the ZIP archive";
+        m_errorString = i18n("Couldn't close the ZIP archive");
+        return false;
+    }
+
+    return true;
+}
+
+QByteArray KrossWordXmlWriter::infoData(KrossWord* krossWord,
+                                       KrossWord::WriteMode writeMode)
+{
+    QByteArray data;
+    QXmlStreamWriter writer(&data);
+    writer.writeStartDocument("1.0", true);
+    writer.writeStartElement("krossWordInfo");
+    writer.writeAttribute("version", "1.0");
+    writer.writeAttribute("type", krossWord->crosswordTypeInfo().typeString());
+    writer.writeAttribute("width", QString::number(krossWord->width()));
+    writer.writeAttribute("height", QString::number(krossWord->height()));
+    writer.writeAttribute("clueCount", QString::number(krossWord->clues().count()));
+    if (writeMode != KrossWord::Template) {
+        writer.writeAttribute("progress",
+                              QString::number(krossWord->solutionProgress()));
+    }
+
+    if (!krossWord->getTitle().isEmpty() && writeMode != KrossWord::Template)
+        writer.writeTextElement("title", krossWord->getTitle());
+    if (!krossWord->getAuthors().isEmpty())
+        writer.writeTextElement("authors", krossWord->getAuthors());
+    if (!krossWord->getCopyright().isEmpty())
+        writer.writeTextElement("copyright", krossWord->getCopyright());
+    if (!krossWord->getNotes().isEmpty())
+        writer.writeTextElement("notes", krossWord->getNotes());
+
+    writer.writeEndElement(); // </krossWordInfo>
+    writer.writeEndDocument();
+    return data;
+}
+
+bool KrossWordXmlWriter::writeArchiveEntry(KZip* zip, const QString& name,
+        const QByteArray& data)
+{
+    if (!zip->prepareWriting(name, "krosswordpuzzle",
+                             "krosswordpuzzle", data.size())) {
+        qDebug() << "Error while calling KZip::prepareWriting()" << name;
+        m_errorString = i18n("Error writing to the compressed file");
+        return false;
+    }
+    if (!zip->writeData(data.constData(), data.size())) {
+        qDebug() << "Error while calling KZip::writeData()" << name;
+        m_errorString = i18n("Error writing to the compressed file");
+        return false;
+    }
+    if (!zip->finishWriting(data.size())) {
+        qDebug() << "Error while calling KZip::finishWriting()" << name;
+        m_errorString = i18n("Error writing to the compressed file");
+        return false;
+    }
+
+    return true;
+}
+
+QImage KrossWordXmlWriter::thumbnailImage(KrossWord* krossWord)
+{
+    return krossWord->toPixmap(QSize(256, 256)).toImage();
+}
+
+bool KrossWordXmlWriter::writeThumbnails(KZip* zip, const QImage& image)
+{
+    // Render only once, smaller thumbnails get scaled down
+    const QList<int> sizes = QList<int>() << 256 << 128 << 64;
+    foreach(int size, sizes) {
+        const QImage thumbnail = size == sizes.first() ? image
+                                 : image.scaled(size, size, Qt::KeepAspectRatio,
+                                                Qt::SmoothTransformation);
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        if (!thumbnail.save(&buffer, "PNG")) {
+            qDebug() << "Couldn't create a thumbnail with size" << size;
+            continue;
+        }
+
+        const QString name = QString("%1%2.png")
+                             .arg(KrossWordXmlReader::THUMBNAIL_ENTRY_PREFIX).arg(size);
+        if (!writeArchiveEntry(zip, name, data))
+            return false;
+    }
+
+    return true;
+}
+
+bool KrossWordXmlWriter::writeCrosswordEntry(KZip* zip, const KrossWordXmlData& data)
+{
+    // Stream the XML into the archive. KZip doesn't need to know the size
+    // before writing.
+    if (!zip->prepareWriting("crossword.kwp", "krosswordpuzzle",
+                             "krosswordpuzzle", 0)) {
         qDebug() << "Error while calling KZip::prepareWriting()";
         m_errorString = i18n("Error writing to the compressed file");
         return false;
     }
-    if (!zip.writeData(buffer.data(), buffer.size())) {
+    ArchiveEntryDevice entryDevice(zip);
+    entryDevice.open(QIODevice::WriteOnly);
+    bool writeOk = writeXmlData(&entryDevice, data);
+    if (writeOk && !entryDevice.flushBuffer()) {
         qDebug() << "Error while calling KZip::writeData()";
         m_errorString = i18n("Error writing to the compressed file");
-        return false;
+        writeOk = false;
     }
-    if (!zip.finishWriting(buffer.size())) {
+    setDevice(0);
+    entryDevice.close();
+    if (!writeOk)
+        return false;
+
+    if (!zip->finishWriting(entryDevice.writtenSize())) {
         qDebug() << "Error while calling KZip::finishWriting()";
         m_errorString = i18n("Error writing to the compressed file");
         return false;
     }
-    if (!zip.close()) {
-        qDebug() << "Couldn't close the ZIP archive";
-        m_errorString = i18n("Couldn't close the ZIP archive");
+
+    return true;
+}
+
+bool KrossWordXmlWriter::createCompressedData(KrossWord* krossWord,
+        KrossWord::WriteMode writeMode, const QByteArray& undoData,
+        CompressedKrossWordData* data)
+{
+    Q_ASSERT(krossWord);
+    Q_ASSERT(data);
+
+    data->info = infoData(krossWord, writeMode);
+    data->thumbnail = m_writeOptions.testFlag(KrossWord::EmbedThumbnails)
+                      && writeMode == KrossWord::Normal
+                      ? thumbnailImage(krossWord) : QImage();
+    data->undoData = undoData;
+    data->compress = !m_writeOptions.testFlag(KrossWord::FastWrite);
+
+    // Only copied here, it gets serialized by writeCompressedData()
+    data->crossword = createXmlData(krossWord, writeMode);
+    return true;
+}
+
+bool KrossWordXmlWriter::writeCompressedData(KZip* zip,
+        const CompressedKrossWordData& data)
+{
+    Q_ASSERT(zip);
+    m_errorString.clear();
+
+    // Same layout as written by writeCompressed()
+    zip->setCompression(KZip::NoCompression);
+    if (!writeArchiveEntry(zip, KrossWordXmlReader::INFO_ENTRY_NAME, data.info))
+        return false;
+    if (!data.thumbnail.isNull() && !writeThumbnails(zip, data.thumbnail))
+        return false;
+
+    zip->setCompression(data.compress ? KZip::DeflateCompression : KZip::NoCompression);
+    if (!writeCrosswordEntry(zip, data.crossword))
+        return false;
+    if (!data.undoData.isEmpty()
+            && !writeArchiveEntry(zip, KrossWordXmlReader::UNDO_ENTRY_NAME, data.undoData))
         return false;
-    }
 
     return true;
 }
@@ -81,8 +290,87 @@ bool KrossWordXmlWriter::write(QIODevice* device, KrossWord* krossWord,
                                KrossWord::WriteMode writeMode,
                                const QByteArray &undoData)
 {
-    Q_ASSERT(device);
     Q_ASSERT(krossWord);
+    return writeXmlData(device, createXmlData(krossWord, writeMode, undoData));
+}
+
+KrossWordXmlData KrossWordXmlWriter::createXmlData(KrossWord* krossWord,
+        KrossWord::WriteMode writeMode, const QByteArray& undoData)
+{
+    Q_ASSERT(krossWord);
+
+    KrossWordXmlData data;
+    data.width = krossWord->width();
+    data.height = krossWord->height();
+    data.crosswordTypeInfo = krossWord->crosswordTypeInfo();
+    if (writeMode != KrossWord::Template)
+        data.title = krossWord->getTitle();
+    data.authors = krossWord->getAuthors();
+    data.copyright = krossWord->getCopyright();
+    data.notes = krossWord->getNotes();
+
+    if (data.crosswordTypeInfo.clueType == NumberClues1To26
+            && data.crosswordTypeInfo.clueMapping == CluesReferToCells
+            && data.crosswordTypeInfo.letterCellContent == Characters) {
+        data.letterContentToClueNumberMapping =
+            krossWord->letterContentToClueNumberMapping();
+    }
+
+    ClueCellList clueList = krossWord->clues();
+    foreach(ClueCell * clueCell, clueList) {
+        KrossWordXmlData::Clue clue;
+        clue.coord = clueCell->coord();
+        clue.orientation = clueCell->orientation();
+        clue.answerOffset = clueCell->answerOffset();
+        clue.highlighted = clueCell->isHighlighted();
+        if (writeMode == KrossWord::Template) {
+            QString emptyAnswer;
+            emptyAnswer.fill(ClueCell::EmptyCorrectCharacter,
+                             clueCell->correctAnswer().length());
+            clue.answer = emptyAnswer;
+            clue.currentAnswer = emptyAnswer;
+        } else {
+            if (writeMode != KrossWord::Normal)
+                qWarning() << "Write mode unknown" << static_cast<int>(writeMode);
+            clue.text = clueCell->clue();
+            clue.answer = clueCell->correctAnswer();
+            clue.currentAnswer = clueCell->currentAnswer();
+        }
+        data.clues << clue;
+    }
+
+    ImageCellList imageList = krossWord->images();
+    foreach(ImageCell * imageCell, imageList) {
+        KrossWordXmlData::Image image;
+        image.coord = imageCell->coord();
+        image.horizontalCellSpan = imageCell->horizontalCellSpan();
+        image.verticalCellSpan = imageCell->verticalCellSpan();
+        if (writeMode != KrossWord::Template)
+            image.url = imageCell->url().url(QUrl::PreferLocalFile);
+        data.images << image;
+    }
+
+    SolutionLetterCellList solutionLetterList = krossWord->solutionWordLetters();
+    foreach(SolutionLetterCell * letterCell, solutionLetterList) {
+        KrossWordXmlData::SolutionLetter solutionLetter;
+        solutionLetter.coord = letterCell->coord();
+        solutionLetter.index = letterCell->solutionWordIndex();
+        data.solutionLetters << solutionLetter;
+    }
+
+    LetterCellList letterList = krossWord->letters();
+    foreach(LetterCell * letter, letterList) {
+        if (letter->confidence() != Confident)
+            data.notConfidentLetters[ letter->confidence()] << letter->coord();
+    }
+
+    data.undoData = undoData;
+    return data;
+}
+
+bool KrossWordXmlWriter::writeXmlData(QIODevice* device, const KrossWordXmlData& data)
+{
+    Q_ASSERT(device);
     m_errorString.clear();
 
     bool closeAfterWrite;
@@ -96,36 +384,39 @@ bool KrossWordXmlWriter::write(QIODevice* device, KrossWord* krossWord,
     setAutoFormatting(true);
 
     writeStartDocument("1.0", true);
-    writeKrossWord(krossWord, writeMode, undoData);
+    writeKrossWord(data);
     writeEndDocument();
 
     if (closeAfterWrite)
         device->close();
 
+    if (hasError()) {
+        qDebug() << "Error while writing the XML";
+        m_errorString = i18n("Error writing to the file");
+        return false;
+    }
     return true;
 }
 
-void KrossWordXmlWriter::writeKrossWord(KrossWord* krossWord,
-                                        KrossWord::WriteMode writeMode,
-                                        const QByteArray &undoData)
+void KrossWordXmlWriter::writeKrossWord(const KrossWordXmlData& data)
 {
     writeStartElement("krossWord");
     writeAttribute("version", "1.1");
-    writeAttribute("width", QString::number(krossWord->width()));
-    writeAttribute("height", QString::number(krossWord->height()));
-    writeAttribute("type", krossWord->crosswordTypeInfo().typeString());
-
-    if (!krossWord->getTitle().isEmpty() && writeMode != KrossWord::Template)
-        writeTextElement("title", krossWord->getTitle());
-    if (!krossWord->getAuthors().isEmpty())
-        writeTextElement("authors", krossWord->getAuthors());
-    if (!krossWord->getCopyright().isEmpty())
-        writeTextElement("copyright", krossWord->getCopyright());
-    if (!krossWord->getNotes().isEmpty())
-        writeTextElement("notes", krossWord->getNotes());
-
-    if (krossWord->crosswordTypeInfo().crosswordType == UserDefinedCrossword) {
-        CrosswordTypeInfo info = krossWord->crosswordTypeInfo();
+    writeAttribute("width", QString::number(data.width));
+    writeAttribute("height", QString::number(data.height));
+    writeAttribute("type", data.crosswordTypeInfo.typeString());
+
+    if (!data.title.isEmpty())
+        writeTextElement("title", data.title);
+    if (!data.authors.isEmpty())
+        writeTextElement("authors", data.authors);
+    if (!data.copyright.isEmpty())
+        writeTextElement("copyright", data.copyright);
+    if (!data.notes.isEmpty())
+        writeTextElement("notes", data.notes);
+
+    if (data.crosswordTypeInfo.crosswordType == UserDefinedCrossword) {
+        const CrosswordTypeInfo &info = data.crosswordTypeInfo;
         writeStartElement("userDefinedCrosswordSettings");
         writeAttribute("name", info.name);
 
@@ -145,42 +436,31 @@ void KrossWordXmlWriter::writeKrossWord(KrossWord* krossWord,
         writeEndElement();
     }
 
-    if (krossWord->crosswordTypeInfo().clueType == NumberClues1To26
-            && krossWord->crosswordTypeInfo().clueMapping == CluesReferToCells
-            && krossWord->crosswordTypeInfo().letterCellContent == Characters) {
+    if (!data.letterContentToClueNumberMapping.isEmpty()) {
         writeTextElement("letterContentToClueNumberMapping",
-                         krossWord->letterContentToClueNumberMapping());
+                         data.letterContentToClueNumberMapping);
     }
 
-    ClueCellList clueList = krossWord->clues();
-    foreach(ClueCell * clue, clueList)
-    writeClue(clue, writeMode);
+    foreach(const KrossWordXmlData::Clue & clue, data.clues)
+    writeClue(clue);
 
-    ImageCellList imageList = krossWord->images();
-    foreach(ImageCell * image, imageList)
-    writeImage(image, writeMode);
+    foreach(const KrossWordXmlData::Image & image, data.images)
+    writeImage(image);
 
-    SolutionLetterCellList solutionLetterList = krossWord->solutionWordLetters();
-    foreach(SolutionLetterCell * letter, solutionLetterList)
+    foreach(const KrossWordXmlData::SolutionLetter & letter, data.solutionLetters)
     writeSolutionLetter(letter);
 
     // Writing not confident letters
-    QHash< Confidence, LetterCellList > notConfidentLetterLists;
-    LetterCellList letterList = krossWord->letters();
-    foreach(LetterCell * letter, letterList) {
-        if (letter->confidence() != Confident)
-            notConfidentLetterLists[ letter->confidence()] << letter;
-    }
-    if (!notConfidentLetterLists.isEmpty()) {
+    if (!data.notConfidentLetters.isEmpty()) {
         writeStartElement("confidence");
-        for (QHash<Confidence, LetterCellList>::const_iterator it =
-                    notConfidentLetterLists.constBegin();
-                it != notConfidentLetterLists.constEnd(); ++it) {
+        for (QHash<Confidence, QList<Coord> >::const_iterator it =
+                    data.notConfidentLetters.constBegin();
+                it != data.notConfidentLetters.constEnd(); ++it) {
             writeStartElement(LetterCell::confidenceToString(it.key()));
-            foreach(const LetterCell * letter, notConfidentLetterLists[it.key()]) {
+            foreach(const Coord & coord, it.value()) {
                 writeEmptyElement("letter");
                 writeAttribute("coord", QString("%1,%2")
-                               .arg(letter->coord().first).arg(letter->coord().second));
+                               .arg(coord.first).arg(coord.second));
             }
             writeEndElement();
         }
@@ -188,69 +468,59 @@ void KrossWordXmlWriter::writeKrossWord(KrossWord* krossWord,
     }
 
 
+    const QByteArray &undoData = data.undoData;
     if (!undoData.isEmpty()) {
 //       qDebug() << "WRITE DATA" << undoData.toBase64();
-        writeTextElement("undoData", undoData.toBase64());
+        // Encode in pieces, to not have the whole encoded undo data in memory.
+        // The piece size is a multiple of 3, so that no padding is inserted
+        // between the pieces.
+        const int pieceSize = 3 * 16 * 1024;
+        writeStartElement("undoData");
+        for (int pos = 0; pos < undoData.size(); pos += pieceSize) {
+            writeCharacters(QString::fromLatin1(QByteArray::fromRawData(
+                undoData.constData() + pos, qMin(pieceSize, undoData.size() - pos))
+                .toBase64()));
+        }
+        writeEndElement();
     }
 
     writeEndElement(); // </krossWord>
 }
 
-void KrossWordXmlWriter::writeClue(ClueCell* clue,
-                                   KrossWord::WriteMode writeMode)
+void KrossWordXmlWriter::writeClue(const KrossWordXmlData::Clue& clue)
 {
     writeStartElement("clue");
-    writeAttribute("coord", QString("%1,%2").arg(clue->coord().first).arg(clue->coord().second));
-    writeAttribute("orientation", clue->orientation() == Qt::Horizontal ? "horizontal" : "vertical");
-    writeAttribute("answerOffset", KrossWord::answerOffsetToString(clue->answerOffset()));
+    writeAttribute("coord", QString("%1,%2").arg(clue.coord.first).arg(clue.coord.second));
+    writeAttribute("orientation", clue.orientation == Qt::Horizontal ? "horizontal" : "vertical");
+    writeAttribute("answerOffset", KrossWord::answerOffsetToString(clue.answerOffset));
 
-    if (clue->isHighlighted())
+    if (clue.highlighted)
         writeAttribute("selected", "true");
 
-
-    if (writeMode == KrossWord::Normal) {
-        writeTextElement("text", clue->clue());
-        writeTextElement("answer", clue->correctAnswer());
-        writeTextElement("currentAnswer", clue->currentAnswer());
-    } else if (writeMode == KrossWord::Template) {
-        QString emptyAnswer;
-        emptyAnswer.fill(ClueCell::EmptyCorrectCharacter,
-                         clue->correctAnswer().length());
-        writeTextElement("text", QString());
-        writeTextElement("answer", emptyAnswer);
-        writeTextElement("currentAnswer", emptyAnswer);
-    } else
-        qWarning() << "Write mode unknown" << static_cast<int>(writeMode);
+    writeTextElement("text", clue.text);
+    writeTextElement("answer", clue.answer);
+    writeTextElement("currentAnswer", clue.currentAnswer);
 
     writeEndElement();
 }
 
-void KrossWordXmlWriter::writeImage(ImageCell* image,
-                                    KrossWord::WriteMode writeMode)
+void KrossWordXmlWriter::writeImage(const KrossWordXmlData::Image& image)
 {
     writeEmptyElement("image");
     writeAttribute("coordTopLeft", QString("%1,%2")
-                   .arg(image->coord().first).arg(image->coord().second));
-    writeAttribute("horizontalCellSpan", QString::number(image->horizontalCellSpan()));
-    writeAttribute("verticalCellSpan", QString::number(image->verticalCellSpan()));
-    if (writeMode == KrossWord::Normal)
-        writeAttribute("url", image->url().url(QUrl::PreferLocalFile));
-    else if (writeMode == KrossWord::Template)
-        writeAttribute("url", QString());
-    else
-        qWarning() << "Write mode unknown" << static_cast<int>(writeMode);
+                   .arg(image.coord.first).arg(image.coord.second));
+    writeAttribute("horizontalCellSpan", QString::number(image.horizontalCellSpan));
+    writeAttribute("verticalCellSpan", QString::number(image.verticalCellSpan));
+    writeAttribute("url", image.url);
 }
 
-void KrossWordXmlWriter::writeSolutionLetter(SolutionLetterCell* solutionLetter)
+void KrossWordXmlWriter::writeSolutionLetter(const KrossWordXmlData::SolutionLetter& solutionLetter)
 {
     writeStartElement("solutionLetter");
     writeAttribute("coord", QString("%1,%2")
-                   .arg(solutionLetter->coord().first)
-                   .arg(solutionLetter->coord().second));
+                   .arg(solutionLetter.coord.first)
+                   .arg(solutionLetter.coord.second));
     writeAttribute("index", QString("%1")
-                   .arg(solutionLetter->solutionWordIndex()));
+                   .arg(solutionLetter.index));
     writeEndElement();
 }
-
-
-
@@ -21,22 +21,107 @@
 #define KROSSWORDXMLWRITER_HEADER
 
 #include <QXmlStreamWriter>
+#include <QImage>
+#include <QMetaType>
 #include <krossword.h>
 
+class KZip;
 namespace Crossword
 {
-class ImageCell;
-class SolutionLetterCell;
-class ClueCell;
 class KrossWord;
 }
 using namespace Crossword;
 
+/** The contents of a crossword as written into it's XML. Copied from the
+* crossword by KrossWordXmlWriter::createXmlData() with the write mode
+* already applied, so that writing it doesn't access the crossword and can
+* run in another thread. */
+struct KrossWordXmlData {
+    struct Clue {
+        Coord coord;
+        Qt::Orientation orientation;
+        AnswerOffset answerOffset;
+        bool highlighted;
+        QString text;
+        QString answer;
+        QString currentAnswer;
+    };
+    struct Image {
+        Coord coord;
+        int horizontalCellSpan;
+        int verticalCellSpan;
+        QString url;
+    };
+    struct SolutionLetter {
+        Coord coord;
+        int index;
+    };
+
+    KrossWordXmlData() : width(0), height(0) {};
+
+    int width;
+    int height;
+    CrosswordTypeInfo crosswordTypeInfo;
+    QString title;
+    QString authors;
+    QString copyright;
+    QString notes;
+    /** Empty if the mapping doesn't get written for the crossword type. */
+    QString letterContentToClueNumberMapping;
+    QList<Clue> clues;
+    QList<Image> images;
+    QList<SolutionLetter> solutionLetters;
+    /** Coordinates of letters that aren't @ref Confident. */
+    QHash<Confidence, QList<Coord> > notConfidentLetters;
+    QByteArray undoData;
+};
+
+/** The contents of a compressed crossword file. Created from the crossword
+* by KrossWordXmlWriter::createCompressedData() and written by
+* KrossWordXmlWriter::writeCompressedData(), which doesn't access the
+* crossword, so that it can run in another thread. */
+struct CompressedKrossWordData {
+    CompressedKrossWordData() : compress(true) {};
+
+    QByteArray info;
+    /** The biggest thumbnail to embed, null to embed no thumbnails. */
+    QImage thumbnail;
+    /** The crossword, serialized to XML by writeCompressedData(). */
+    KrossWordXmlData crossword;
+    QByteArray undoData;
+    /** Whether the crossword and undo data get deflated or stored. */
+    bool compress;
+};
+Q_DECLARE_METATYPE(CompressedKrossWordData)
+
 class KrossWordXmlWriter : public QXmlStreamWriter
 {
 public:
-    KrossWordXmlWriter() { };
+    KrossWordXmlWriter() : m_writeOptions(KrossWord::NoWriteOptions) { };
+
+    /** Options used by @ref writeCompressed(). With
+    * @ref KrossWord::EmbedThumbnails PNG thumbnails with the sizes 64, 128
+    * and 256 pixels get embedded (only in the @ref KrossWord::Normal write
+    * mode, see KrossWordXmlReader::readThumbnail()). With
+    * @ref KrossWord::FastWrite the crossword gets stored uncompressed,
+    * otherwise it gets deflated. KZip::setCompression() doesn't take a level,
+    * so these are the only choices.
+    * Default is @ref KrossWord::NoWriteOptions. */
+    KrossWord::WriteOptions writeOptions() const {
+        return m_writeOptions;
+    };
+    void setWriteOptions(KrossWord::WriteOptions writeOptions) {
+        m_writeOptions = writeOptions;
+    };
 
+    /** Writes the crossword as XML into a ZIP archive. The first entry of the
+    * archive is a small uncompressed XML file with the crossword info (see
+    * @ref KrossWordXmlReader::INFO_ENTRY_NAME), so that it can be read
+    * without reading the archive directory or inflating the crossword.
+    * Thumbnails follow, if they are enabled. The XML of the crossword gets
+    * streamed into the archive, without buffering the whole document.
+    * @p undoData isn't written into the XML, but as a binary entry of it's
+    * own (see @ref KrossWordXmlReader::UNDO_ENTRY_NAME). */
     bool writeCompressed(QIODevice *device, KrossWord *krossWord,
                          KrossWord::WriteMode writeMode = KrossWord::Normal,
                          const QByteArray &undoData = QByteArray());
@@ -44,21 +129,44 @@ public:
                KrossWord::WriteMode writeMode = KrossWord::Normal,
                const QByteArray &undoData = QByteArray());
 
+    /** Takes a snapshot of the contents @ref writeCompressed() would write
+    * into @p data, without serializing or compressing it. Only this needs to
+    * be done in the GUI thread, @ref writeCompressedData() can run in another
+    * thread. */
+    bool createCompressedData(KrossWord *krossWord, KrossWord::WriteMode writeMode,
+                              const QByteArray &undoData,
+                              CompressedKrossWordData *data);
+    /** Writes @p data into @p zip, which needs to be open for writing. */
+    bool writeCompressedData(KZip *zip, const CompressedKrossWordData &data);
+
+    /** Copies the contents of @p krossWord that get written as XML. */
+    static KrossWordXmlData createXmlData(KrossWord *krossWord,
+                                          KrossWord::WriteMode writeMode = KrossWord::Normal,
+                                          const QByteArray &undoData = QByteArray());
+    /** Writes @p data as XML to @p device. */
+    bool writeXmlData(QIODevice *device, const KrossWordXmlData &data);
+
     QString errorString() const {
         return m_errorString;
     };
 
 private:
-    void writeKrossWord(KrossWord *krossWord,
-                        KrossWord::WriteMode writeMode = KrossWord::Normal,
-                        const QByteArray &undoData = QByteArray());
-    void writeClue(ClueCell *clue,
-                   KrossWord::WriteMode writeMode = KrossWord::Normal);
-    void writeImage(ImageCell *image,
-                    KrossWord::WriteMode writeMode = KrossWord::Normal);
-    void writeSolutionLetter(SolutionLetterCell *solutionLetter);
+    /** Gets the XML for the info entry of compressed crosswords. */
+    static QByteArray infoData(KrossWord *krossWord, KrossWord::WriteMode writeMode);
+    bool writeArchiveEntry(KZip *zip, const QString &name, const QByteArray &data);
+    /** Renders the biggest thumbnail, smaller ones get scaled from it. */
+    static QImage thumbnailImage(KrossWord *krossWord);
+    bool writeThumbnails(KZip *zip, const QImage &image);
+    /** Streams the XML of @p data into a new entry of @p zip. */
+    bool writeCrosswordEntry(KZip *zip, const KrossWordXmlData &data);
+
+    void writeKrossWord(const KrossWordXmlData &data);
+    void writeClue(const KrossWordXmlData::Clue &clue);
+    void writeImage(const KrossWordXmlData::Image &image);
+    void writeSolutionLetter(const KrossWordXmlData::SolutionLetter &solutionLetter);
 
     QString m_errorString;
+    KrossWord::WriteOptions m_writeOptions;
 };
 
 #endif // Multiple inclusion guard
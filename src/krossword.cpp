@@ -25,10 +25,12 @@
 #include "io/krosswordpuzreader.h"
 #include "io/krosswordxmlreader.h"
 #include "io/krosswordxmlwriter.h"
+#include "io/krosswordbinarystream.h"
 
 #include <QGraphicsScene>
 #include <QGraphicsView>
 #include <QFile>
+#include <QBuffer>
 #include <QStandardItemModel>
 #include <qfileinfo.h>
 
@@ -40,6 +42,7 @@
 #include <QPropertyAnimation>
 #include <QFontDatabase>
 #include <QMimeDatabase>
+#include <limits>
 
 
 namespace Crossword
@@ -69,10 +72,17 @@ KrossWord::KrossWord(const KrosswordTheme *theme, int width, int height)
 void KrossWord::init(uint width, uint height)
 {
     if (!m_theme) {
-        m_theme = KrosswordTheme::defaultValues();
+        // Shared by all crosswords without a theme, eg. in batch processing
+        static const KrosswordTheme *defaultTheme = KrosswordTheme::defaultValues();
+        m_theme = defaultTheme;
     }
 
     m_krossWordGrid = new KrosswordGrid(width, height);
+    m_statisticsDirty = true;
+    m_asymmetricCellCount = 0;
+    m_maxClueNumber = -1;
+    m_clueNumbersDirty = true;
+    m_runLengthsDirty = true;
     m_editable = false;
     m_interactive = true;
     m_drawForPrinting = false;
@@ -126,23 +136,81 @@ void KrossWord::createNew(const CrosswordTypeInfo &crosswordTypeInfo, const QSiz
         m_codedPuzzleMapping.clear();
 }
 
-bool KrossWord::has180DegreeRotationSymmetry() const
+ClueCell* KrossWord::symmetricClue(ClueCell* clue) const
 {
-    KrossWordCellList cellList = cells(EmptyCellType | ClueCellType);
+    LetterCell *lastLetter = clue->lastLetter();
+    if (!lastLetter)
+        return NULL;
 
-    while (!cellList.isEmpty()) {
-        KrossWordCell *cell = cellList.first();
-        KrossWordCell *symmetryCell = at(Coord(
-                                             width() - 1 - cell->coord().first,
-                                             height() - 1 - cell->coord().second));
-        if (cellList.contains(symmetryCell)) {
-            cellList.removeFirst(); // remove cell
-            cellList.removeOne(symmetryCell);
-        } else
-            return false;
+    // The first letter of the symmetric clue is at the rotated position of
+    // the last letter of clue
+    const Coord coord(width() - 1 - lastLetter->coord().first,
+                      height() - 1 - lastLetter->coord().second);
+    LetterCell *letter = dynamic_cast<LetterCell*>(at(coord));
+    if (!letter)
+        return NULL;
+
+    ClueCell *otherClue = letter->clue(clue->orientation());
+    if (!otherClue || otherClue->firstLetter() != letter
+            || otherClue->answerLength() != clue->answerLength())
+        return NULL;
+
+    return otherClue;
+}
+
+bool KrossWord::isBlockCell(KrossWordCell* cell)
+{
+    return cell && (cell->isType(EmptyCellType) || cell->isType(ClueCellType)
+                    || cell->isType(DoubleClueCellType));
+}
+
+void KrossWord::updateSymmetry()
+{
+    const bool wasSymmetric = has180DegreeRotationSymmetry();
+    const int size = m_krossWordGrid->size();
+    m_blockPlane.fill(false, size);
+    for (int i = 0; i < size; ++i) {
+        if (isBlockCell(m_krossWordGrid->at(i)))
+            m_blockPlane.setBit(i);
     }
 
-    return true;
+    // The 180 degree rotated position of index i is size - 1 - i
+    m_asymmetricCellCount = 0;
+    for (int i = 0; i < size; ++i) {
+        if (m_blockPlane.testBit(i) != m_blockPlane.testBit(size - 1 - i))
+            ++m_asymmetricCellCount;
+    }
+
+    if (wasSymmetric != has180DegreeRotationSymmetry())
+        emit symmetryChanged(has180DegreeRotationSymmetry());
+}
+
+void KrossWord::updateSymmetryAt(const Coord& coord)
+{
+    const int size = m_krossWordGrid->size();
+    if (m_blockPlane.size() != size) {
+        updateSymmetry(); // The grid was resized
+        return;
+    }
+
+    const int i = m_krossWordGrid->index(coord);
+    const bool isBlock = isBlockCell(m_krossWordGrid->at(i));
+    if (m_blockPlane.testBit(i) == isBlock)
+        return;
+
+    const bool wasSymmetric = has180DegreeRotationSymmetry();
+    m_blockPlane.setBit(i, isBlock);
+    const int rotated = size - 1 - i;
+    if (rotated != i) {
+        // Both cells of the pair are counted
+        if (m_blockPlane.testBit(rotated) == isBlock)
+            m_asymmetricCellCount -= 2;
+        else
+            m_asymmetricCellCount += 2;
+    }
+
+    if (wasSymmetric != has180DegreeRotationSymmetry())
+        emit symmetryChanged(has180DegreeRotationSymmetry());
 }
 
 void KrossWord::setupSameLetterSynchronization()
@@ -159,13 +227,12 @@ void KrossWord::setupSameLetterSynchronization()
         correctCharToLetters[ ch ] << letter;
     }
 
+    // Puts all letters with the same character into one synchronization group
     for (QHash<QChar, KrossWordCellList>::iterator it = correctCharToLetters.begin();
             it != correctCharToLetters.end(); ++it) {
-        while (!it.value().isEmpty()) {
-            KrossWordCell *letter = it.value().takeFirst();
-            letter->synchronizeWith(it.value(), SyncContent,
-                                    SameCharacterLetterSynchronization);
-        }
+        KrossWordCell *letter = it.value().takeFirst();
+        letter->synchronizeWith(it.value(), SyncContent,
+                                SameCharacterLetterSynchronization);
     }
 }
 
@@ -607,17 +674,12 @@ void KrossWord::currentCellDestroyed(QObject*)
 
 float KrossWord::solutionProgress() const
 {
-    LetterCellList letterList = letters();
-    if (letterList.isEmpty())
+    if (m_statisticsDirty)
+        updateStatistics();
+    if (m_statistics.letterCellCount == 0)
         return 0.0f;
 
-    int solved = 0;
-    foreach(LetterCell * letter, letterList) {
-        if (!letter->isEmpty())
-            ++ solved;
-    }
-
-    return (float)solved / (float)letterList.count();     // TODO Div/0!
+    return (float)m_statistics.filledLetterCells / (float)m_statistics.letterCellCount;
 }
 
 QSize KrossWord::emptyCellSpan(const Coord& coordTopLeft, SpannedCell *excludedCell)
@@ -682,42 +744,112 @@ ErrorType KrossWord::insertImage(const KGrid2D::Coord &coord,
 void KrossWord::assignClueNumbers()
 {
     int curClueNumber = 0;
+    m_clueNumberEnds.clear();
 
     //  Iterate through all cells
     for (uint y = 0; y < height(); ++y) {
         for (uint x = 0; x < width(); ++x) {
-            LetterCell *letter = qgraphicsitem_cast<LetterCell*>(at(Coord(x, y)));
-
-            if (!letter) {
-                ClueCell *clue;
-                DoubleClueCell *doubleClueCell;
-                if ((clue = qgraphicsitem_cast<ClueCell*>(at(Coord(x, y)))))
-                    clue->setClueNumber(curClueNumber++);
-                else if ((doubleClueCell = qgraphicsitem_cast<DoubleClueCell*>(
-                                               at(Coord(x, y))))) {
-                    doubleClueCell->clue1()->setClueNumber(curClueNumber++);
-                    doubleClueCell->clue2()->setClueNumber(curClueNumber++);
-                }
-            } else {
-                bool assignedNumber = false;
-                if (letter->clueHorizontal() && letter->clueHorizontal()->firstLetter() == letter
-                        && letter->clueHorizontal()->answerOffset() == OnClueCell) {
-                    letter->clueHorizontal()->setClueNumber(curClueNumber);
-                    assignedNumber = true;
-                }
-                if (letter->clueVertical() && letter->clueVertical()->firstLetter() == letter
-                        && letter->clueVertical()->answerOffset() == OnClueCell) {
-                    letter->clueVertical()->setClueNumber(curClueNumber);
-                    assignedNumber = true;
-                }
-
-                if (assignedNumber)
-                    ++curClueNumber;
+            const int count = assignClueNumbersAt(Coord(x, y), curClueNumber);
+            if (count > 0) {
+                curClueNumber += count;
+                m_clueNumberEnds.insert(m_krossWordGrid->index(Coord(x, y)), curClueNumber);
             }
         } // for x
     } // for y
 
     m_maxClueNumber = curClueNumber - 1;
+    m_clueNumbersDirty = false;
+}
+
+int KrossWord::assignClueNumbersAt(const Coord& coord, int clueNumber)
+{
+    KrossWordCell *cell = at(coord);
+    LetterCell *letter = qgraphicsitem_cast<LetterCell*>(cell);
+
+    if (!letter) {
+        ClueCell *clue;
+        DoubleClueCell *doubleClueCell;
+        if ((clue = qgraphicsitem_cast<ClueCell*>(cell))) {
+            clue->setClueNumber(clueNumber);
+            return 1;
+        } else if ((doubleClueCell = qgraphicsitem_cast<DoubleClueCell*>(cell))) {
+            doubleClueCell->clue1()->setClueNumber(clueNumber);
+            doubleClueCell->clue2()->setClueNumber(clueNumber + 1);
+            return 2;
+        }
+        return 0;
+    }
+
+    bool assignedNumber = false;
+    if (letter->clueHorizontal() && letter->clueHorizontal()->firstLetter() == letter
+            && letter->clueHorizontal()->answerOffset() == OnClueCell) {
+        letter->clueHorizontal()->setClueNumber(clueNumber);
+        assignedNumber = true;
+    }
+    if (letter->clueVertical() && letter->clueVertical()->firstLetter() == letter
+            && letter->clueVertical()->answerOffset() == OnClueCell) {
+        letter->clueVertical()->setClueNumber(clueNumber);
+        assignedNumber = true;
+    }
+
+    return assignedNumber ? 1 : 0;
+}
+
+Coord KrossWord::clueNumberCoord(ClueCell* clue) const
+{
+    if (clue->answerOffset() == OnClueCell && clue->firstLetter())
+        return clue->firstLetter()->coord();
+    else
+        return clue->coord();
+}
+
+void KrossWord::updateClueNumbers(const QList<Coord> &changedCoords)
+{
+    if (m_clueNumbersDirty) {
+        assignClueNumbers();
+        return;
+    }
+
+    // Mark changed cells, cells that are no longer numbered get removed below
+    int firstIndex = std::numeric_limits<int>::max();
+    int lastIndex = -1;
+    foreach(const Coord & coord, changedCoords) {
+        if (!inside(coord))
+            continue;
+
+        const int index = m_krossWordGrid->index(coord);
+        if (!m_clueNumberEnds.contains(index))
+            m_clueNumberEnds.insert(index, -1);
+        firstIndex = qMin(firstIndex, index);
+        lastIndex = qMax(lastIndex, index);
+    }
+    if (lastIndex == -1)
+        return;
+
+    QMap<int, int>::iterator it = m_clueNumberEnds.lowerBound(firstIndex);
+    int curClueNumber = 0;
+    if (it != m_clueNumberEnds.begin()) {
+        QMap<int, int>::iterator previous = it;
+        curClueNumber = (--previous).value();
+    }
+    while (it != m_clueNumberEnds.end()) {
+        const int count = assignClueNumbersAt(m_krossWordGrid->coord(it.key()), curClueNumber);
+        if (count == 0) {
+            it = m_clueNumberEnds.erase(it);
+            continue;
+        }
+
+        curClueNumber += count;
+        const bool unchanged = it.value() == curClueNumber;
+        it.value() = curClueNumber;
+
+        // The numbers of all following clues are unchanged
+        if (unchanged && it.key() > lastIndex)
+            break;
+        ++it;
+    }
+
+    m_maxClueNumber = m_clueNumberEnds.isEmpty() ? -1 : m_clueNumberEnds.last() - 1;
 }
 
 ClueCell* KrossWord::findClueCell(const Coord& coord,
@@ -742,18 +874,18 @@ ClueCell* KrossWord::findClueCell(const Coord& coord,
 
 ClueCellList KrossWord::clueCellsFromClueNumber(int clueNumber) const
 {
-    ClueCellList clueList = clues();
+    return m_cluesByNumber.value(clueNumber);
+}
 
-    ClueCellList ret;
-    foreach(ClueCell * clueCell, clueList) {
-        if (clueCell->clueNumber() == clueNumber) {
-            ret << clueCell;
-            if (ret.count() == 2)
-                return ret;
-        }
-    }
+void KrossWord::clueNumberChanged(ClueCell* clue, int previousClueNumber)
+{
+    QHash<int, ClueCellList>::iterator it = m_cluesByNumber.find(previousClueNumber);
+    if (it == m_cluesByNumber.end() || !it.value().removeOne(clue))
+        return; // Not yet added to m_clues
 
-    return ret;
+    if (it.value().isEmpty())
+        m_cluesByNumber.erase(it);
+    m_cluesByNumber[ clue->clueNumber()] << clue;
 }
 
 KrossWord::FileFormat KrossWord::fileFormatFromFileName(const QString& fileName)
@@ -766,13 +898,39 @@ KrossWord::FileFormat KrossWord::fileFormatFromFileName(const QString& fileName)
         return KrossWordPuzzleCompressedXmlFile;
     else if (extension == "puz")
         return AcrossLitePuzFile;
+    else if (extension == "kwpb")
+        return KrossWordPuzzleBinaryFile;
+    else
+        return DetermineByFileName; // couldn't determine file format
+}
+
+KrossWord::FileFormat KrossWord::fileFormatFromData(const QByteArray& data)
+{
+    const int puzMagicLength = qstrlen(KrossWordPuzStream::FILE_MAGIC);
+    if (data.size() >= KrossWordPuzStream::OFFSET_FILE_MAGIC + puzMagicLength
+            && qstrncmp(data.constData() + KrossWordPuzStream::OFFSET_FILE_MAGIC,
+                        KrossWordPuzStream::FILE_MAGIC, puzMagicLength) == 0)
+        return AcrossLitePuzFile;
+    else if (data.startsWith("PK\x03\x04")) // ZIP local file header
+        return KrossWordPuzzleCompressedXmlFile;
+    else if (KrossWordBinaryStream::isBinaryCrossword(data))
+        return KrossWordPuzzleBinaryFile;
+
+    // Skip a UTF-8 byte order mark and white space before the XML
+    int pos = data.startsWith("\xEF\xBB\xBF") ? 3 : 0;
+    while (pos < data.size() && QChar::fromLatin1(data[pos]).isSpace())
+        ++pos;
+    const QByteArray start = QByteArray::fromRawData(data.constData() + pos,
+                             data.size() - pos);
+    if (start.startsWith("<?xml") || start.startsWith("<krossWord"))
+        return KrossWordPuzzleXmlFile;
     else
         return DetermineByFileName; // couldn't determine file format
 }
 
 bool KrossWord::write(const QString& fileName, QString* errorString,
                       WriteMode writeMode, FileFormat fileFormat,
-                      const QByteArray &undoData)
+                      const QByteArray &undoData, WriteOptions writeOptions)
 {
     QFile file(fileName);
 
@@ -793,6 +951,7 @@ bool KrossWord::write(const QString& fileName, QString* errorString,
         }
     } else if (fileFormat == KrossWordPuzzleCompressedXmlFile) {
         KrossWordXmlWriter xmlWriter;
+        xmlWriter.setWriteOptions(writeOptions);
         bool writeOk = xmlWriter.writeCompressed(&file, this, writeMode, undoData);
         if (!writeOk) {
             *errorString = i18n("Error writing compressed crossword: %1",
@@ -809,6 +968,13 @@ bool KrossWord::write(const QString& fileName, QString* errorString,
             *errorString = i18n("Error writing AcrossLite's .puz-format.");
             return false;
         }
+    } else if (fileFormat == KrossWordPuzzleBinaryFile) {
+        KrossWordBinaryStream binaryWriter;
+        bool writeOk = binaryWriter.write(&file, this, writeMode, undoData);
+        if (!writeOk) {
+            *errorString = i18n("Error writing crossword: %1", binaryWriter.errorString());
+            return false;
+        }
     } else
         return false;
 
@@ -827,11 +993,15 @@ bool KrossWord::read(const QUrl &url, QString *errorString, QWidget *mainWindow,
         return false;
     }
 
-    setHighlightedClue(NULL);
-    removeAllCells();
-    bool wasBlocking = blockSignals(true);
+    // Map the file into memory once and let the readers read from there
+    const qint64 fileSize = file.size();
+    uchar *mappedData = fileSize > 0 ? file.map(0, fileSize) : 0;
+    QByteArray data = mappedData
+                      ? QByteArray::fromRawData(reinterpret_cast<const char*>(mappedData), fileSize)
+                      : file.readAll();
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
 
-    bool readOk = false, fileFormatDeterminationFailed = false;
     if (fileFormat == DetermineByFileName) {
         QString extension = QFileInfo(url.path()).suffix();
         if (extension == "puz")
@@ -840,47 +1010,52 @@ bool KrossWord::read(const QUrl &url, QString *errorString, QWidget *mainWindow,
             fileFormat = KrossWordPuzzleXmlFile;
         else if (extension == "kwpz")
             fileFormat = KrossWordPuzzleCompressedXmlFile;
-        else {
-            fileFormatDeterminationFailed = true;
-
-            // Cycle through the available readers
-            KrossWordPuzStream puzReader;
-            readOk = puzReader.read(&file, this);
-
-            if (!readOk) {
-                if (file.isOpen()) file.seek(0);
-                KrossWordXmlReader xmlReader;
-                readOk = xmlReader.read(&file, this, undoData);
-
-                if (!readOk) {
-                    if (file.isOpen()) file.seek(0);
-                    readOk = xmlReader.readCompressed(&file, this, undoData);
-                }
-            }
-
-            if (!readOk && errorString)
-                *errorString = "File format unknown";
-        }
+        else if (extension == "kwpb")
+            fileFormat = KrossWordPuzzleBinaryFile;
+        else
+            fileFormat = fileFormatFromData(data);
     }
 
-    if (!fileFormatDeterminationFailed) {
-        if (fileFormat == AcrossLitePuzFile) {
-            KrossWordPuzStream puzReader;
-            readOk = puzReader.read(&file, this);
-            if (!readOk && errorString)
-                *errorString = i18n("Error reading AcrossLite's .puz-format.");
-        } else if (fileFormat == KrossWordPuzzleXmlFile) {
-            KrossWordXmlReader xmlReader;
-            readOk = xmlReader.read(&file, this, undoData);
-            if (!readOk && errorString)
-                *errorString = xmlReader.errorString();
-        } else if (fileFormat == KrossWordPuzzleCompressedXmlFile) {
-            KrossWordXmlReader xmlReader;
-            readOk = xmlReader.readCompressed(&file, this, undoData);
-            if (!readOk && errorString)
-                *errorString = xmlReader.errorString();
-        }
+    // Keep the current crossword if the file can't be read anyway
+    if (fileFormat == DetermineByFileName) {
+        if (errorString)
+            *errorString = "File format unknown";
+        buffer.close();
+        if (mappedData)
+            file.unmap(mappedData);
+        return false;
     }
+
+    setHighlightedClue(NULL);
+    removeAllCells();
+    bool wasBlocking = blockSignals(true);
+
+    bool readOk = false;
+    if (fileFormat == AcrossLitePuzFile) {
+        KrossWordPuzStream puzReader;
+        readOk = puzReader.read(&buffer, this);
+        if (!readOk && errorString)
+            *errorString = i18n("Error reading AcrossLite's .puz-format.");
+    } else if (fileFormat == KrossWordPuzzleXmlFile) {
+        KrossWordXmlReader xmlReader;
+        readOk = xmlReader.read(&buffer, this, undoData);
+        if (!readOk && errorString)
+            *errorString = xmlReader.errorString();
+    } else if (fileFormat == KrossWordPuzzleCompressedXmlFile) {
+        KrossWordXmlReader xmlReader;
+        readOk = xmlReader.readCompressed(&buffer, this, undoData);
+        if (!readOk && errorString)
+            *errorString = xmlReader.errorString();
+    } else if (fileFormat == KrossWordPuzzleBinaryFile) {
+        KrossWordBinaryStream binaryReader;
+        readOk = binaryReader.read(&buffer, this, undoData);
+        if (!readOk && errorString)
+            *errorString = binaryReader.errorString();
+    }
+
+    buffer.close();
+    if (mappedData)
+        file.unmap(mappedData);
     file.close();
     blockSignals(wasBlocking);
     emit cluesAdded(clues());   // All clues are new
@@ -904,7 +1079,8 @@ QPixmap KrossWord::toPixmap(const QSize& size)
         usedSize = QSize(5, 5);   // Minimal size
 
     QGraphicsScene *sc = scene();
-    if (!sc) {
+    const bool ownScene = !sc;
+    if (ownScene) {
         sc = new QGraphicsScene();
         sc->addItem(this);
     }
@@ -920,7 +1096,8 @@ QPixmap KrossWord::toPixmap(const QSize& size)
     p.end();
     setDrawForPrinting(wasDrawingForPrinting);
 
-    if (sc) {
+    // Don't delete the scene of a view showing this crossword
+    if (ownScene) {
         sc->removeItem(this);
         delete sc;
     }
@@ -1182,66 +1359,13 @@ QList< AnswerOffset > KrossWord::legalAnswerOffsets(
         }
     }
 
-    KrossWordCell *cellAtPos;
-    Offset offset = KrosswordGrid::letterOffset(orientation);
+    // Each answer cell must be an empty cell, excludedClue or a letter cell
+    // without another clue in the given orientation
     for (int i = offsets.count() - 1; i >= 0; --i) {
         Coord letterCoord = clueCellCoord +
                             ClueCell::answerOffsetToOffset(offsets[i]);
-
-        for (int n = 0; n < answerLength; ++n) {
-            if (!inside(letterCoord)) {
-                offsets.removeAt(i);   // Doesn't fit into the grid
-                break;
-            }
-
-            cellAtPos = at(letterCoord);
-            if (!cellAtPos) {
-                letterCoord += offset;
-                continue;
-            }
-
-//       qDebug() << "    " << offsets[i] << n << cellAtPos;
-            if (cellAtPos->getCellType() != EmptyCellType
-                    && !cellAtPos->isLetterCell()) {
-                if (cellAtPos != excludedClue) {   // TEST
-                    // Only allow empty or letter cells as cells for the first answer cell
-//    qDebug() << offsets[ i ] << "isn't legal, because there isn't an empty "
-//           "or letter cell";
-                    offsets.removeAt(i);
-                    break;
-                }
-            } else if (cellAtPos->isLetterCell()) {
-                // Disallow crossed letter cells
-                LetterCell *letter = (LetterCell*)cellAtPos;
-                if (letter->isCrossed()) {
-                    if (letter->isAttachedToClue(excludedClue)) {
-                        // Letter isn't crossed when excluding excludedClue.
-                        // Remove current offset if the orientation of the new clue is the
-                        // same as the other clue of [letter] (ie. other than the orientation
-                        // of [excludedClue]).
-                        if (orientation != excludedClue->orientation()) {
-//        qDebug() << offsets[ i ] << "isn't legal, because there is a letter "
-//     "cell with a not excluded clue in the given orientation";
-                            offsets.removeAt(i);
-                            break;
-                        }
-                    } else {
-//      qDebug() << offsets[ i ] << "isn't legal, because there is a crossed "
-//   "letter cell";
-                        offsets.removeAt(i);
-                        break;
-                    }
-                } else if (orientation == letter->clue()->orientation()
-                           && letter->clue() != excludedClue) {
-//    qDebug() << offsets[ i ] << "isn't legal, because there is an uncrossed "
-//      "letter cell with a not excluded clue in the given orientation";
-                    offsets.removeAt(i);
-                    break;
-                }
-            }
-
-            letterCoord += offset;
-        } // for 0 <= n < answerLength
+        if (maxAnswerLengthAt(letterCoord, orientation, excludedClue) < answerLength)
+            offsets.removeAt(i);
     } // for i.. answer offsets
 
     return offsets;
@@ -1405,6 +1529,7 @@ ErrorType KrossWord::changeClueProperties(ClueCell* clue,
         qDebug() << "No changes";
         return ErrorNone; // Nothing to change
     }
+    const Coord previousClueNumberCoord = clueNumberCoord(clue);
 
     // Check if the given clue can be inserted if it wouldn't already be in the grid
     Offset offset = ClueCell::answerOffsetToOffset(newAnswerOffset);
@@ -1542,7 +1667,7 @@ ErrorType KrossWord::changeClueProperties(ClueCell* clue,
     clue->setCorrectAnswer(newCorrectAnswer);
 
 //   qDebug() << "AFTER CHANGE" << this;
-    insertCluePostProcessing(clue);
+    insertCluePostProcessing(clue, previousClueNumberCoord);
 
     SolutionLetterCellList solLettersAfter = solutionWordLetters(); // TODO
     foreach(SolutionLetterCell * solLetterCell, solLettersBefore) {
@@ -1721,10 +1846,11 @@ ErrorType KrossWord::insertClue(const Coord &coord,
     return ErrorNone;
 }
 
-void KrossWord::insertCluePostProcessing(ClueCell* clue)
+void KrossWord::insertCluePostProcessing(ClueCell* clue,
+        const Coord &previousClueNumberCoord)
 {
     // Assign clue numbers
-    assignClueNumbers();
+    updateClueNumbers(QList<Coord>() << clueNumberCoord(clue) << previousClueNumberCoord);
 
     // Add clue to clue list and emit cluesAdded signal
     if (!m_clueExpanderItems.contains(clue)) {
@@ -1736,6 +1862,9 @@ void KrossWord::insertCluePostProcessing(ClueCell* clue)
     }
     if (!m_clues.contains(clue)) {
         m_clues << clue;
+        m_cluesByNumber[ clue->clueNumber()] << clue;
+        if (!m_statisticsDirty)
+            countClueInStatistics(clue, 1);
         emit cluesAdded(QList<ClueCell*>() << clue);
     }
 
@@ -1750,6 +1879,7 @@ QList<Coord> KrossWord::removeClue(ClueCell* clueCell,
                                    RemoveMode letterCellsRemoveMode)
 {
     Q_ASSERT(clueCell);
+    const Coord numberCoord = clueNumberCoord(clueCell);
 
     if (clueCellRemoveMode != DontRemove) {
         if (clueCellRemoveMode == RemoveFromGridAndDelete)
@@ -1802,7 +1932,16 @@ QList<Coord> KrossWord::removeClue(ClueCell* clueCell,
             }
 
             m_clues.removeOne(clueCell);
+            if (!m_statisticsDirty)
+                countClueInStatistics(clueCell, -1);
+            ClueCellList &numberClues = m_cluesByNumber[ clueCell->clueNumber()];
+            numberClues.removeOne(clueCell);
+            if (numberClues.isEmpty())
+                m_cluesByNumber.remove(clueCell->clueNumber());
         }
+
+        // Following clues get lower clue numbers
+        updateClueNumbers(QList<Coord>() << numberCoord);
     }
 
     return removedCoords;
@@ -1862,6 +2001,10 @@ void KrossWord::replaceCell(const Coord& coord,
                         y <= bottomRight.second; ++y) {
                     EmptyCell *emptyCell = new EmptyCell(this, Coord(x, y));
                     (*m_krossWordGrid)[ Coord(x, y)] = emptyCell;
+                    if (!m_statisticsDirty && Coord(x, y) != coord)
+                        ++m_statistics.emptyCellCount;
+                    updateSymmetryAt(Coord(x, y));
+                    updateRunLengthsAt(Coord(x, y));
 
                     if (isAnimationEnabled()) {
                         animator()->animate(Animator::AnimateFadeIn, emptyCell);
@@ -1888,7 +2031,13 @@ void KrossWord::replaceCell(const Coord& coord,
 
     // Insert new cell
     bool newCellMoving = false;
+    if (!m_statisticsDirty) {
+        countCellInStatistics(oldCell, -1);
+        countCellInStatistics(newCell, 1);
+    }
     (*m_krossWordGrid)[ coord ] = newCell;
+    updateSymmetryAt(coord);
+    updateRunLengthsAt(coord);
     if (!(spannedCell = dynamic_cast<SpannedCell*>(newCell))
             || spannedCell->coordTopLeft() == coord) {  // Needed to not crash or
         // wrongly move spanned cells when adding spanned cells because they
@@ -2217,17 +2366,23 @@ void KrossWord::clearCache()
 }
 
 int KrossWord::maxAnswerLengthAt(const Coord& coord, Qt::Orientation orientation,
-                                 ClueCell *excludedClue)
+                                 ClueCell *excludedClue) const
 {
-    if (!inside(coord) || !canTakeClueLetterCell(coord, orientation, excludedClue)) {
-        return 0;
-    }
+    if (m_runLengthsDirty)
+        updateRunLengths();
 
-    int length = 1;
+    const QVector<int> &runLengths = m_answerRunLengths[ orientation == Qt::Horizontal ? 0 : 1 ];
     const Offset offset = orientation == Qt::Horizontal ? Offset(1, 0) : Offset(0, 1);
-    Coord curCoord = coord + offset;
-    while ((uint)curCoord.first < width() && (uint)curCoord.second < height()) {
-        if (!canTakeClueLetterCell(curCoord, orientation, excludedClue)) {
+    int length = 0;
+    Coord curCoord = coord;
+    while (inside(curCoord)) {
+        const int runLength = runLengths[ m_krossWordGrid->index(curCoord)];
+        length += runLength;
+        curCoord = Coord(curCoord.first + offset.first * runLength,
+                         curCoord.second + offset.second * runLength);
+
+        // Cells of excludedClue can continue the run
+        if (!excludedClue || !canTakeClueLetterCell(curCoord, orientation, excludedClue)) {
             break;
         }
         ++length;
@@ -2247,6 +2402,16 @@ bool KrossWord::correctLettersAt(const Coord& coord, Qt::Orientation orientation
         return false;
     }
 
+    // Fail early if there are other than letter or empty cells
+    if (m_runLengthsDirty)
+        updateRunLengths();
+    const int cellsToEdge = orientation == Qt::Horizontal
+                            ? (int)width() - coord.first : (int)height() - coord.second;
+    if (m_letterRunLengths[ orientation == Qt::Horizontal ? 0 : 1 ][ m_krossWordGrid->index(coord)]
+            < qMin(letterCount, cellsToEdge)) {
+        return false;
+    }
+
     correctLetters->clear();
     const Offset offset = orientation == Qt::Horizontal ? Offset(1, 0) : Offset(0, 1);
     Coord curCoord = coord;
@@ -2274,7 +2439,7 @@ bool KrossWord::correctLettersAt(const Coord& coord, Qt::Orientation orientation
 }
 
 bool KrossWord::canTakeClueLetterCell(const Coord &coord, Qt::Orientation orientation,
-                                      ClueCell *excludedClue)
+                                      ClueCell *excludedClue) const
 {
     if (!inside(coord))
         return false;
@@ -2292,6 +2457,95 @@ bool KrossWord::canTakeClueLetterCell(const Coord &coord, Qt::Orientation orient
         return false;
 }
 
+bool KrossWord::canTakeClueLetterCell(KrossWordCell* cell, Qt::Orientation orientation)
+{
+    if (!cell)
+        return false;
+    else if (cell->isLetterCell())
+        return !((LetterCell*)cell)->hasClueInDirection(orientation);
+    else
+        return cell->isType(EmptyCellType);
+}
+
+bool KrossWord::isLetterOrEmptyCell(KrossWordCell* cell)
+{
+    return cell && (cell->isLetterCell() || cell->isType(EmptyCellType));
+}
+
+void KrossWord::updateRunLengths() const
+{
+    const int size = m_krossWordGrid->size();
+    for (int i = 0; i < 2; ++i) {
+        const Qt::Orientation orientation = i == 0 ? Qt::Horizontal : Qt::Vertical;
+        const Offset offset = orientation == Qt::Horizontal ? Offset(1, 0) : Offset(0, 1);
+        m_answerRunLengths[ i ].fill(0, size);
+        m_letterRunLengths[ i ].fill(0, size);
+
+        // Walk backwards, so that the run length of the next cell is known
+        for (int y = (int)height() - 1; y >= 0; --y) {
+            for (int x = (int)width() - 1; x >= 0; --x) {
+                const Coord coord(x, y);
+                const Coord nextCoord = coord + offset;
+                const int index = m_krossWordGrid->index(coord);
+                const int nextIndex = inside(nextCoord) ? m_krossWordGrid->index(nextCoord) : -1;
+                KrossWordCell *cell = m_krossWordGrid->at(index);
+
+                if (canTakeClueLetterCell(cell, orientation)) {
+                    m_answerRunLengths[ i ][ index ] = 1 +
+                            (nextIndex == -1 ? 0 : m_answerRunLengths[ i ][ nextIndex ]);
+                }
+                if (isLetterOrEmptyCell(cell)) {
+                    m_letterRunLengths[ i ][ index ] = 1 +
+                            (nextIndex == -1 ? 0 : m_letterRunLengths[ i ][ nextIndex ]);
+                }
+            }
+        }
+    }
+
+    m_runLengthsDirty = false;
+}
+
+void KrossWord::updateRunLengthsAt(const Coord& coord)
+{
+    if (m_runLengthsDirty || !inside(coord))
+        return;
+    if (m_answerRunLengths[ 0 ].size() != (int)m_krossWordGrid->size()) {
+        m_runLengthsDirty = true;
+        return;
+    }
+
+    KrossWordCell *cell = m_krossWordGrid->at(coord);
+    for (int i = 0; i < 2; ++i) {
+        const Qt::Orientation orientation = i == 0 ? Qt::Horizontal : Qt::Vertical;
+        const Offset offset = orientation == Qt::Horizontal ? Offset(1, 0) : Offset(0, 1);
+        const Coord nextCoord = coord + offset;
+        const int nextIndex = inside(nextCoord) ? m_krossWordGrid->index(nextCoord) : -1;
+
+        for (int table = 0; table < 2; ++table) {
+            QVector<int> &runLengths = table == 0
+                                       ? m_answerRunLengths[ i ] : m_letterRunLengths[ i ];
+            const bool inRun = table == 0 ? canTakeClueLetterCell(cell, orientation)
+                               : isLetterOrEmptyCell(cell);
+            int runLength = !inRun ? 0 : 1 + (nextIndex == -1 ? 0 : runLengths[ nextIndex ]);
+
+            // Update the run lengths of the cells before coord in the same run
+            Coord curCoord = coord;
+            forever {
+                const int index = m_krossWordGrid->index(curCoord);
+                if (runLengths[ index ] == runLength)
+                    break;
+                runLengths[ index ] = runLength;
+
+                curCoord = Coord(curCoord.first - offset.first,
+                                 curCoord.second - offset.second);
+                if (!inside(curCoord) || runLengths[ m_krossWordGrid->index(curCoord)] == 0)
+                    break;
+                ++runLength;
+            }
+        }
+    }
+}
+
 void KrossWord::removeSynchronization(SyncMethods syncMethods,
                                       SyncCategories syncCategories)
 {
@@ -2348,6 +2602,9 @@ KrossWordCellList KrossWord::moveCells(int dx, int dy, bool simulate)
     // and put the cells into the new grid at the moved positions.
     KrosswordGrid *krossWordGrid = m_krossWordGrid;
     m_krossWordGrid = new KrosswordGrid(width(), height());
+    invalidateStatistics();
+    m_clueNumbersDirty = true;
+    m_runLengthsDirty = true;
 
     Offset offset(dx, dy);
     for (uint y = movingCellRect.top(); y <= (uint)movingCellRect.bottom(); ++y) {
@@ -2399,6 +2656,32 @@ KrossWordCellList KrossWord::moveCells(int dx, int dy, bool simulate)
     return uniqueRemovedCells;
 }
 
+Offset KrossWord::resizeOffset(int dw, int dh, ResizeAnchor anchor)
+{
+    switch (anchor) {
+    case AnchorTopLeft:
+        return Offset(0, 0);
+    case AnchorTop:
+        return Offset(dw / 2, 0);
+    case AnchorTopRight:
+        return Offset(dw, 0);
+    case AnchorLeft:
+        return Offset(0, dh / 2);
+    case AnchorCenter:
+        return Offset(dw / 2, dh / 2);
+    case AnchorRight:
+        return Offset(dw, dh / 2);
+    case AnchorBottomLeft:
+        return Offset(0, dh);
+    case AnchorBottom:
+        return Offset(dw / 2, dh);
+    case AnchorBottomRight:
+        return Offset(dw, dh);
+    }
+
+    return Offset(0, 0);
+}
+
 KrossWordCellList KrossWord::resizeGrid(uint width, uint height, ResizeAnchor anchor, bool simulate)
 {
     KrossWordCellList removedCells;
@@ -2413,37 +2696,7 @@ KrossWordCellList KrossWord::resizeGrid(uint width, uint height, ResizeAnchor an
 //     << "to" << QString("%1x%2").arg(width).arg(height);
 
     QRect sourceRect;
-    Offset offset;
-    int dw = width - prevWidth, dh = height - prevHeight;
-    switch (anchor) {
-    case AnchorTopLeft:
-        offset = Offset(0, 0);
-        break;
-    case AnchorTop:
-        offset = Offset(dw / 2, 0);
-        break;
-    case AnchorTopRight:
-        offset = Offset(dw, 0);
-        break;
-    case AnchorLeft:
-        offset = Offset(0, dh / 2);
-        break;
-    case AnchorCenter:
-        offset = Offset(dw / 2, dh / 2);
-        break;
-    case AnchorRight:
-        offset = Offset(dw, dh / 2);
-        break;
-    case AnchorBottomLeft:
-        offset = Offset(0, dh);
-        break;
-    case AnchorBottom:
-        offset = Offset(dw / 2, dh);
-        break;
-    case AnchorBottomRight:
-        offset = Offset(dw, dh);
-        break;
-    }
+    Offset offset = resizeOffset(width - prevWidth, height - prevHeight, anchor);
 //   qDebug() << "Moving the crossword content according to anchor" << negOffset << anchor;
 //   qDebug() << this;
 
@@ -2506,6 +2759,9 @@ KrossWordCellList KrossWord::resizeGrid(uint width, uint height, ResizeAnchor an
     if (!simulate) {
         delete m_krossWordGrid;
         m_krossWordGrid = krossWordGrid;
+        invalidateStatistics();
+        m_clueNumbersDirty = true;
+        m_runLengthsDirty = true;
 
         fillWithEmptyCells();
     } else
@@ -2586,6 +2842,10 @@ void KrossWord::removeAllCells()
     }
     m_clueExpanderItems.clear();
     m_clues.clear();
+    m_cluesByNumber.clear();
+    invalidateStatistics();
+    m_clueNumbersDirty = true;
+    m_runLengthsDirty = true;
 
     setHighlightedClue(NULL);
     KrossWordCellList cellList = cells();
@@ -2599,6 +2859,7 @@ void KrossWord::deleteAllCells()
 //   emit cluesAboutToBeRemoved( clues() );
 
     m_clues.clear();
+    m_cluesByNumber.clear();
     setHighlightedClue(NULL);
     removeSynchronization(); // Prevents crash when calling qDeleteAll
 
@@ -2616,6 +2877,10 @@ void KrossWord::deleteAllCells()
 //     }
 
     m_krossWordGrid->resize(0, 0);
+    invalidateStatistics();
+    updateSymmetry();
+    m_clueNumbersDirty = true;
+    m_runLengthsDirty = true;
     m_solutionLetters.clear();
     foreach(SolutionLetterCell * solutionLetter, m_solutionLetters)
     emit solutionWordLetterRemoved(solutionLetter);
@@ -2632,6 +2897,7 @@ void KrossWord::fillWithEmptyCells()
 {
     fillWithEmptyCells(Coord(0, 0),
                        Coord(width() - 1, height() - 1));
+    updateSymmetry(); // After creating, resizing or moving the grid
 }
 
 void KrossWord::fillWithEmptyCells(const Coord& coordTopLeft,
@@ -2784,48 +3050,151 @@ QStandardItemModel* KrossWord::createCrosswordTypeModel(
     return model;
 }
 
-KrossWord::Statistics KrossWord::statistics()
+KrossWord::Statistics KrossWord::statistics() const
 {
-    Statistics stats;
-    stats.cellCount = width() * height();
+    if (m_statisticsDirty)
+        updateStatistics();
 
-    LetterCellList letterList = stats.letters = letters();
-    stats.letterCellCount = letterList.count();
-    stats.crossedLetterCells = stats.uncrossedLetterCells = 0;
-    foreach(LetterCell * letter, letterList) {
+    // Get the answer length range and average from the histogram
+    Statistics stats = m_statistics;
+    if (!stats.clueCountByAnswerLength.isEmpty()) {
+        stats.minAnswerLength = stats.clueCountByAnswerLength.firstKey();
+        stats.maxAnswerLength = stats.clueCountByAnswerLength.lastKey();
+
+        int answerLengthSum = 0;
+        for (QMap<int, int>::const_iterator it = stats.clueCountByAnswerLength.constBegin();
+                it != stats.clueCountByAnswerLength.constEnd(); ++it) {
+            answerLengthSum += it.key() * it.value();
+        }
+        stats.avgAnswerLength = (float)answerLengthSum / (float)stats.clueCount;
+    }
+    return stats;
+}
+
+void KrossWord::updateStatistics() const
+{
+    m_statistics = Statistics();
+    m_statistics.cellCount = width() * height();
+
+    for (uint i = 0; i < m_krossWordGrid->size(); ++i)
+        countCellInStatistics(m_krossWordGrid->at(i), 1);
+    foreach(ClueCell * clue, m_clues)
+    countClueInStatistics(clue, 1);
+
+    m_statisticsDirty = false;
+}
+
+/** Adds @p count to the entry of @p histogram for @p key and removes the
+* entry when it drops to zero. */
+template <typename Histogram, typename Key>
+static void countInHistogram(Histogram *histogram, const Key &key, int count)
+{
+    const int newCount = histogram->value(key) + count;
+    if (newCount == 0)
+        histogram->remove(key);
+    else
+        histogram->insert(key, newCount);
+}
+
+void KrossWord::countCellInStatistics(KrossWordCell* cell, int count) const
+{
+    if (!cell)
+        return;
+
+    if (cell->isType(EmptyCellType)) {
+        m_statistics.emptyCellCount += count;
+    } else if (cell->isLetterCell()) {
+        LetterCell *letter = (LetterCell*)cell;
+        m_statistics.letterCellCount += count;
+        if (!letter->isEmpty())
+            m_statistics.filledLetterCells += count;
         if (letter->isCrossed())
-            ++stats.crossedLetterCells;
+            m_statistics.crossedLetterCells += count;
         else
-            ++stats.uncrossedLetterCells;
+            m_statistics.uncrossedLetterCells += count;
 
-        ++stats.letterCellCountByChar[ letter->correctLetter()];
+        countInHistogram(&m_statistics.letterCellCountByChar, letter->correctLetter(), count);
     }
+}
 
-    ClueCellList clueList = stats.clues = clues();
-    stats.clueCount = clueList.count();
-    stats.horizontalClues = stats.verticalClues = 0;
-    stats.minAnswerLength = 999999999;
-    stats.maxAnswerLength = 0;
-    int answerLengthSum = 0;
-    foreach(ClueCell * clue, clueList) {
-        if (clue->isHorizontal())
-            ++stats.horizontalClues;
-        else
-            ++stats.verticalClues;
+void KrossWord::countClueInStatistics(ClueCell* clue, int count) const
+{
+    m_statistics.clueCount += count;
+    if (clue->isHorizontal())
+        m_statistics.horizontalClues += count;
+    else
+        m_statistics.verticalClues += count;
 
-        int answerLength = clue->correctAnswer().length();
-        answerLengthSum += answerLength;
-        if (answerLength < stats.minAnswerLength)
-            stats.minAnswerLength = answerLength;
-        if (answerLength > stats.maxAnswerLength)
-            stats.maxAnswerLength = answerLength;
+    countInHistogram(&m_statistics.clueCountByAnswerLength, clue->answerLength(), count);
+}
+
+bool KrossWord::isInGrid(LetterCell* letter) const
+{
+    // Letter cells can be kept outside of the grid by undo commands
+    return inside(letter->coord()) && m_krossWordGrid->at(letter->coord()) == letter;
+}
+
+bool KrossWord::isInClueList(ClueCell* clue) const
+{
+    return m_cluesByNumber.value(clue->clueNumber()).contains(clue);
+}
+
+void KrossWord::letterCurrentLetterChanged(LetterCell* letter, const QChar& previousLetter)
+{
+    if (m_statisticsDirty || !isInGrid(letter))
+        return;
+
+    const bool wasEmpty = previousLetter == ' ';
+    if (wasEmpty && !letter->isEmpty())
+        ++m_statistics.filledLetterCells;
+    else if (!wasEmpty && letter->isEmpty())
+        --m_statistics.filledLetterCells;
+}
+
+void KrossWord::letterCorrectLetterChanged(LetterCell* letter, const QChar& previousLetter)
+{
+    if (m_statisticsDirty || !isInGrid(letter))
+        return;
+
+    countInHistogram(&m_statistics.letterCellCountByChar, previousLetter, -1);
+    countInHistogram(&m_statistics.letterCellCountByChar, letter->correctLetter(), 1);
+}
+
+void KrossWord::letterCluesChanged(LetterCell* letter, bool wasCrossed)
+{
+    if (m_statisticsDirty || letter->isCrossed() == wasCrossed || !isInGrid(letter))
+        return;
+
+    if (wasCrossed) {
+        --m_statistics.crossedLetterCells;
+        ++m_statistics.uncrossedLetterCells;
+    } else {
+        ++m_statistics.crossedLetterCells;
+        --m_statistics.uncrossedLetterCells;
+    }
+}
+
+void KrossWord::clueOrientationChanged(ClueCell* clue)
+{
+    if (m_statisticsDirty || !isInClueList(clue))
+        return;
+
+    if (clue->isHorizontal()) {
+        ++m_statistics.horizontalClues;
+        --m_statistics.verticalClues;
+    } else {
+        --m_statistics.horizontalClues;
+        ++m_statistics.verticalClues;
     }
-    stats.avgAnswerLength = (float)answerLengthSum / (float)stats.clueCount;
+}
 
-    EmptyCellList emptyList = stats.emptyCells = emptyCells();
-    stats.emptyCellCount = emptyList.count();
+void KrossWord::clueAnswerLengthChanged(ClueCell* clue, int previousLength)
+{
+    if (m_statisticsDirty || !isInClueList(clue))
+        return;
 
-    return stats;
+    countInHistogram(&m_statistics.clueCountByAnswerLength, previousLength, -1);
+    countInHistogram(&m_statistics.clueCountByAnswerLength, clue->answerLength(), 1);
 }
 
 QString KrossWord::errorMessageFromErrorType(ErrorType errorType)
@@ -21,6 +21,9 @@
 #define KROSSWORD_H
 
 #include <QSizeF>
+#include <QBitArray>
+#include <QMap>
+#include <QVector>
 
 #include <KLocalizedString>
 #include <QUrl>
@@ -128,6 +131,8 @@ class HeaderItem;
  * and remove the synchronization again with
  * @ref KrossWordCell::removeSynchronizationWith() or remove synchronization
  * with all synchronized cells using @ref KrossWordCell::removeSynchronization().
+ * Synchronized cells share a @ref SyncGroup per category, so the
+ * synchronization is transitive and a change is broadcasted once per group.
  * KrossWord also has a method @ref KrossWord::removeSynchronization(), to remove
  * the synchronization of all cells of the crossword.
  * @brief An interactive crossword to be displayed in a QGraphicsScene.
@@ -166,9 +171,24 @@ public:
         DetermineByFileName,
         KrossWordPuzzleXmlFile,
         KrossWordPuzzleCompressedXmlFile,
-        AcrossLitePuzFile
+        AcrossLitePuzFile,
+        KrossWordPuzzleBinaryFile /**< Compact binary format for big crosswords,
+                * see KrossWordBinaryStream. */
     };
 
+    /** Options for writing compressed crossword files. */
+    enum WriteOption {
+        NoWriteOptions = 0x00,
+
+        /** Embed thumbnails for the library and file managers. */
+        EmbedThumbnails = 0x01,
+        /** Store the crossword uncompressed to write faster, eg. for
+        * temporary files. KZip only offers storing or deflating at it's
+        * fixed level, so there are no other compression levels. */
+        FastWrite = 0x02
+    };
+    Q_DECLARE_FLAGS(WriteOptions, WriteOption)
+
     enum ConversionCommand {
         NoCommand = 0x00,
 
@@ -177,11 +197,13 @@ public:
     };
     Q_DECLARE_FLAGS(ConversionCommands, ConversionCommand)
 
+    /** Statistics of the crossword, see @ref statistics(). */
     struct Statistics {
         int letterCellCount;
+        int filledLetterCells; /**< Letter cells with a current letter. */
         int crossedLetterCells;
         int uncrossedLetterCells;
-        QHash< QChar, int > letterCellCountByChar;
+        QHash< QChar, int > letterCellCountByChar; /**< By correct letter. */
 
         int clueCount;
         int horizontalClues;
@@ -190,13 +212,17 @@ public:
         int minAnswerLength;
         int maxAnswerLength;
         float avgAnswerLength;
+        QMap< int, int > clueCountByAnswerLength; /**< Histogram of answer lengths. */
 
         int cellCount;
         int emptyCellCount;
 
-        LetterCellList letters;
-        ClueCellList clues;
-        EmptyCellList emptyCells;
+        Statistics() : letterCellCount(0), filledLetterCells(0),
+            crossedLetterCells(0), uncrossedLetterCells(0),
+            clueCount(0), horizontalClues(0), verticalClues(0),
+            minAnswerLength(0), maxAnswerLength(0), avgAnswerLength(0.0f),
+            cellCount(0), emptyCellCount(0) {
+        };
     }; // struct Statistics
 
     struct ConversionInfo {
@@ -236,8 +262,10 @@ public:
     static QStandardItemModel *createCrosswordTypeModel(
         const QList<CrosswordTypeInfo> &additionalTypes = QList<CrosswordTypeInfo>());
 
-    /** Gets statistics of the crossword. */
-    Statistics statistics();
+    /** Gets statistics of the crossword. The statistics are cached and
+    * updated when cells, clues or letters change. Resizing or moving the
+    * grid marks them for a recount on the next call. */
+    Statistics statistics() const;
 
     inline Animator *animator() const {
         return m_animator;
@@ -275,15 +303,39 @@ public:
     * when performing the conversion described in @p conversionInfo. */
     QString conversionInfoToString(ConversionInfo conversionInfo);
 
-    /** Wheater or not the crossword has 180 degree rotation symmetry. */
-    bool has180DegreeRotationSymmetry() const;
+    /** Wheater or not the crossword has 180 degree rotation symmetry, ie.
+    * each block cell (empty or clue cell) has a block cell at it's 180 degree
+    * rotated position. The block cells are tracked on each cell replacement,
+    * so this is cheap to call after each edit.
+    * @see symmetryChanged() */
+    bool has180DegreeRotationSymmetry() const {
+        return m_asymmetricCellCount == 0;
+    }
+    /** Gets the number of cells that are block cells while the cell at their
+    * 180 degree rotated position isn't, or the other way round. */
+    int asymmetricCellCount() const {
+        return m_asymmetricCellCount;
+    }
+    /** Gets the clue with the answer letters at the 180 degree rotated
+    * positions of the answer letters of @p clue, which can be @p clue itself.
+    * @returns NULL, if there is no such clue. */
+    ClueCell *symmetricClue(ClueCell *clue) const;
 
     /** Gets the file format for a given @p fileName. */
     static FileFormat fileFormatFromFileName(const QString &fileName);
-
-    /** Reads a crossword from a file.
+    /** Gets the file format from the magic bytes at the beginning of the
+    * crossword file @p data.
+    * @returns DetermineByFileName, if the file format is unknown. */
+    static FileFormat fileFormatFromData(const QByteArray &data);
+
+    /** Reads a crossword from a file. The file gets mapped into memory and
+    * read only once. If @p fileFormat is DetermineByFileName and the
+    * extension is unknown, the format is detected by @ref fileFormatFromData().
     * @param url The URL to the file to read.
     * @param errorString Contains a string describing the error, if false was returned.
+    * @param undoData Gets the undo data stored in the crossword XML. Undo
+    * data of compressed files is stored in an entry of it's own, use
+    * KrossWordXmlReader::readUndoData() to read it.
     * @return False, if there was an error. */
     bool read(const QUrl &url, QString *errorString = NULL,
               QWidget *mainWindow = NULL, FileFormat fileFormat = DetermineByFileName,
@@ -294,12 +346,14 @@ public:
     * @param errorString Contains a string describing the error, if false was returned.
     * @param fileFormat The format of the file to write.
     * @param undoData Undo data to be written into the crossword file, works
-    * only for XML files.
+    * only for XML and binary files.
+    * @param writeOptions Options for compressed XML files.
     * @return False, if there was an error. */
     bool write(const QString &fileName, QString *errorString = NULL,
                WriteMode writeMode = Normal,
                FileFormat fileFormat = DetermineByFileName,
-               const QByteArray &undoData = QByteArray());
+               const QByteArray &undoData = QByteArray(),
+               WriteOptions writeOptions = NoWriteOptions);
 
     /** Gets the clue cell at the coordinates @p coord with the given @p orientation.
     * If the clue cell is hidden, it gets the clue cell with @p orientation of the
@@ -307,8 +361,9 @@ public:
     ClueCell *findClueCell(const Coord &coord, Qt::Orientation orientation,
                            AnswerOffset answerOffset) const;
 
-    /** Gets the clue cell with the given zero-based clue number @p clueNumber.
-    * If no clue cell could be found, it returns NULL. */
+    /** Gets the clue cells with the given zero-based clue number @p clueNumber
+    * from a hash of all clues by clue number. If no clue cell could be found,
+    * it returns an empty list. */
     ClueCellList clueCellsFromClueNumber(int clueNumber) const;
     int maxClueNumber() const {
         return m_maxClueNumber;
@@ -342,7 +397,8 @@ public:
     /** Sets the notes of the crossword to @p notes. */
     void setNotes(const QString &notes);
 
-    /** Returns the percentage of solved letter cells. */
+    /** Returns the percentage of solved letter cells. This uses the cached
+    * @ref statistics(), so it's cheap to call after each letter edit. */
     float solutionProgress() const;
 
     /** Gets the span of empty cells from the given coordinates @p coordTopLeft. */
@@ -502,9 +558,10 @@ public:
     * calculation unless it's NULL.
     * @return The number of empty cells or letter cells which doesn't already
     * have a clue in @p orientation. These cells can be used for the answer
-    * letter cells of a clue cell. */
+    * letter cells of a clue cell. The lengths are read from run length
+    * tables, that get updated when cells are replaced. */
     int maxAnswerLengthAt(const Coord &coord, Qt::Orientation orientation,
-                          ClueCell *excludedClue = NULL);
+                          ClueCell *excludedClue = NULL) const;
 
     bool correctLettersAt(const Coord &coord, Qt::Orientation orientation,
                           int letterCount, QString *correctLetters,
@@ -568,6 +625,9 @@ public:
     * @returns A list of cells that were removed. */
     KrossWordCellList resizeGrid(uint width, uint height,
                                  ResizeAnchor anchor = AnchorCenter, bool simulate = false);
+    /** Gets the offset by which @ref resizeGrid() moves the cells, if the
+    * width changes by @p dw and the height by @p dh. */
+    static Offset resizeOffset(int dw, int dh, ResizeAnchor anchor);
     KrossWordCellList moveCells(int dx, int dy, bool simulate = false);
     /** Removes all cells, replacing them with empty cells.
     * @note To really delete all cells, you can resize the crossword to 0x0.
@@ -652,6 +712,10 @@ public:
 
     void removeSolutionSynchronizationTo(KrossWord *solutionKrossWord);
     QPixmap toPixmap(const QSize &size = QSize(64, 64));
+    /** Assigns clue numbers to all clues in row order, eg. after reading a
+    * crossword. Inserting and removing clues only updates the numbers of
+    * the clues after the changed position.
+    * @see updateClueNumbers() */
     void assignClueNumbers();
 
     /** Gets an error message from a error type value. You can use this error
@@ -743,11 +807,49 @@ protected:
         RemoveFromGridAndDelete
     };
 
-    void insertCluePostProcessing(ClueCell *clue);
+    void insertCluePostProcessing(ClueCell *clue,
+                                  const Coord &previousClueNumberCoord = Coord(-1, -1));
+    /** Gets the coordinates at which @p clue gets numbered, ie. the
+    * coordinates of it's clue cell or of it's first letter for hidden clues. */
+    Coord clueNumberCoord(ClueCell *clue) const;
+    /** Updates the clue numbers after clues at @p changedCoords were
+    * inserted or removed. Only clues after the first changed position, whose
+    * number has changed, get a new clue number. */
+    void updateClueNumbers(const QList<Coord> &changedCoords);
+    /** Updates the hash of clues by clue number, called by ClueCell when the
+    * clue number of @p clue has changed from @p previousClueNumber. */
+    void clueNumberChanged(ClueCell *clue, int previousClueNumber);
+    /** Updates the run length tables after the cell at @p coord or the
+    * clues of it's letter have changed. Only cells before @p coord in the
+    * same row and column, that are part of the same run, get updated. */
+    void updateRunLengthsAt(const Coord &coord);
     QList<Coord> removeClue(ClueCell* clue,
                             RemoveMode clueCellRemoveMode,
                             RemoveMode letterCellsRemoveMode = RemoveFromGridAndDelete);
 
+    /** Marks the cached statistics for a recount. Gets called when the whole
+    * grid changes, ie. when it gets resized or moved or when all cells get
+    * removed. */
+    void invalidateStatistics() {
+        m_statisticsDirty = true;
+    };
+    /** Updates the cached statistics, called by LetterCell when a clue of
+    * @p letter has been attached or detached. @p wasCrossed tells whether
+    * @p letter was crossed before. */
+    void letterCluesChanged(LetterCell *letter, bool wasCrossed);
+    /** Updates the cached statistics, called by ClueCell when the orientation
+    * of @p clue has changed. */
+    void clueOrientationChanged(ClueCell *clue);
+    /** Updates the cached statistics, called by ClueCell when the answer
+    * length of @p clue has changed from @p previousLength. */
+    void clueAnswerLengthChanged(ClueCell *clue, int previousLength);
+    /** Updates the cached statistics, called by LetterCell when the current
+    * letter of @p letter has changed from @p previousLetter. */
+    void letterCurrentLetterChanged(LetterCell *letter, const QChar &previousLetter);
+    /** Updates the cached statistics, called by LetterCell when the correct
+    * letter of @p letter has changed from @p previousLetter. */
+    void letterCorrectLetterChanged(LetterCell *letter, const QChar &previousLetter);
+
     /** Returns a non-const list of all solution letter cells. */
 //     SolutionLetterCellList &solutionWordLettersNonConst() { return m_solutionLetters; };
 
@@ -837,6 +939,10 @@ signals:
 
     void editModeChanged(bool editable);
 
+    /** The crossword got or lost it's 180 degree rotation symmetry.
+    * @see has180DegreeRotationSymmetry() */
+    void symmetryChanged(bool symmetric);
+
     void gridResized(KrossWord *krossWord, int columns, int rows);
 
 public slots:
@@ -867,11 +973,23 @@ private:
                                      bool simulate = false);
 
     void init(uint width = 0, uint height = 0);
+    void updateStatistics() const;
+    void countCellInStatistics(KrossWordCell *cell, int count) const;
+    void countClueInStatistics(ClueCell *clue, int count) const;
+    bool isInClueList(ClueCell *clue) const;
+    int assignClueNumbersAt(const Coord &coord, int clueNumber);
+    static bool isBlockCell(KrossWordCell *cell);
+    void updateSymmetry();
+    void updateSymmetryAt(const Coord &coord);
+    bool isInGrid(LetterCell *letter) const;
     void fillWithEmptyCells();
     void fillWithEmptyCells(const Coord &coordTopLeft,
                             const Coord &coordBottomRight);
     bool canTakeClueLetterCell(const Coord &coord, Qt::Orientation orientation,
-                               ClueCell *excludedClue = NULL);
+                               ClueCell *excludedClue = NULL) const;
+    static bool canTakeClueLetterCell(KrossWordCell *cell, Qt::Orientation orientation);
+    static bool isLetterOrEmptyCell(KrossWordCell *cell);
+    void updateRunLengths() const;
     bool isCellEmptyIfClueIsExcluded(const Coord &coord,
                                      ClueCell *excludedClue) const;
     bool isCellEmptyIfSpannedCellIsExcluded(const Coord &coord,
@@ -885,6 +1003,7 @@ private:
     KrosswordGrid *m_krossWordGrid; // Stores all cells in the crossword
     QSizeF m_cellSize; // The size of one crossword cell
     ClueCellList m_clues; // A list of all clues
+    QHash<int, ClueCellList> m_cluesByNumber; // The clues in m_clues by clue number
     SolutionLetterCellList m_solutionLetters; // A list of all solution letters
     QHash< ClueCell*, ClueExpanderItem* > m_clueExpanderItems; // A list of all clue expanders
     KrossWordCell *m_currentCell, *m_previousCell;
@@ -893,6 +1012,18 @@ private:
     KeyboardNavigation m_keyboardNavigation;
     QColor m_emptyCellColorForPrinting; // The color of empty/blank cells when printing the crossword
     int m_maxClueNumber; // The maximum assigned clue number
+    QMap<int, int> m_clueNumberEnds; // Grid indices of numbered cells mapped to the next free clue number
+    bool m_clueNumbersDirty; // Whether m_clueNumberEnds needs to be rebuilt
+    mutable Statistics m_statistics; // Cached statistics, see statistics()
+    mutable bool m_statisticsDirty; // Whether m_statistics needs a recount
+    QBitArray m_blockPlane; // Block cells in the order of m_krossWordGrid
+    // Number of cells from each cell on in horizontal/vertical direction,
+    // which can take an answer letter of a new clue of that orientation
+    mutable QVector<int> m_answerRunLengths[2];
+    // Number of letter or empty cells from each cell on in horizontal/vertical direction
+    mutable QVector<int> m_letterRunLengths[2];
+    mutable bool m_runLengthsDirty; // Whether the run length tables need to be rebuilt
+    int m_asymmetricCellCount; // Cells with a non-matching rotated counterpart
 
     QString m_title; // Title of the crossword
     QString m_authors; // Authors of the crossword
@@ -983,4 +1114,6 @@ inline QDebug &operator <<(QDebug debug, Crossword::KrossWord::ResizeAnchor anch
     }
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(Crossword::KrossWord::WriteOptions)
+
 #endif // KROSSWORD_H
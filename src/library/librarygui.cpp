@@ -322,7 +322,7 @@ void LibraryGui::libraryAddSlot()
     QUrl url = QFileDialog::getOpenFileUrl(this,
                                            QString(),
                                            QUrl(),
-                                           "Crosswords (*.kwp *.kwpz *.puz)");
+                                           "Crosswords (*.kwp *.kwpz *.kwpb *.puz)");
 
     if (!url.isEmpty())
         libraryAddCrossword(url);
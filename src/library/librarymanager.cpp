@@ -125,6 +125,8 @@ void LibraryManager::loadThumbnailsSlot(const QString &path)
     KFileItemList fileItemList;
     foreach (fileIndex, fileIndexList) {
         if (fileIndex.data(QFileSystemModel::FilePathRole).toString().startsWith(path + "/")) {
+            // The thumbnail plugin uses the thumbnail embedded into the file
+            // if any, outside of the GUI thread
             QUrl url = fileIndex.data(QFileSystemModel::FilePathRole).toUrl();
             url.setScheme("file");
             fileItemList.append(KFileItem(url));
@@ -225,7 +227,7 @@ LibraryManager::E_ERROR_TYPE LibraryManager::addCrossword(const QUrl &url, QStri
 
         const QString fileUrl = filePath + tmpFileName + ".kwpz";
 
-        if (!krossWord.write(fileUrl, &errorString, Crossword::KrossWord::Normal, Crossword::KrossWord::KrossWordPuzzleCompressedXmlFile)) {
+        if (!krossWord.write(fileUrl, &errorString, Crossword::KrossWord::Normal, Crossword::KrossWord::KrossWordPuzzleCompressedXmlFile, QByteArray(), Crossword::KrossWord::EmbedThumbnails)) {
             qDebug() << "addCrossword() writing error:" << errorString;
             outCrosswordUrl = QString();
             return E_ERROR_TYPE::WriteError;
@@ -18,6 +18,7 @@
 */
 
 #include "mainwindow.h"
+#include "batchprocessor.h"
 
 #include <QApplication>
 #include <QCommandLineParser>
@@ -30,7 +31,27 @@ static const char description[] =
 
 static const char version[] = "0.18.3 alpha 4";
 
+/** Whether krossword is started to process files without a main window. */
+static bool isBatchMode(int argc, char *argv[])
+{
+    const QStringList batchOptions = QStringList() << "--convert" << "--validate"
+                                     << "--verify-checksums" << "--check" << "--statistics";
+    for (int i = 1; i < argc; ++i) {
+        const QString arg = QString::fromLocal8Bit(argv[i]);
+        foreach(const QString & option, batchOptions) {
+            if (arg == option || arg.startsWith(option + '='))
+                return true;
+        }
+    }
+    return false;
+}
+
 int main(int argc, char *argv[]){
+    // Batch processing doesn't need a display
+    const bool batchMode = isBatchMode(argc, argv);
+    if (batchMode && qgetenv("QT_QPA_PLATFORM").isEmpty())
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
     QApplication app(argc, argv);
 
     KLocalizedString::setApplicationDomain("krossword");
@@ -47,11 +68,52 @@ int main(int argc, char *argv[]){
     QCommandLineParser parser;
     parser.addVersionOption();
     parser.addHelpOption();
-    parser.addPositionalArgument(QLatin1String("filename"), i18n("Crossword to open"));
+    parser.addPositionalArgument(QLatin1String("filename"), i18n("Crossword to open, "
+                                 "or files and directories to process with the batch options"));
+    QCommandLineOption convertOption(QStringLiteral("convert"),
+                                     i18n("Convert to <format> (kwp, kwpz, kwpb or puz), without opening a window."),
+                                     QStringLiteral("format"));
+    QCommandLineOption outputDirOption(QStringLiteral("output-dir"),
+                                       i18n("Write converted files to <directory> instead of next to the source files."),
+                                       QStringLiteral("directory"));
+    QCommandLineOption validateOption(QStringLiteral("validate"),
+                                      i18n("Validate the structure of the crosswords, without opening a window."));
+    QCommandLineOption verifyChecksumsOption(QStringLiteral("verify-checksums"),
+            i18n("Verify the checksums of .puz files, without opening a window."));
+    QCommandLineOption checkOption(QStringLiteral("check"),
+                                   i18n("Check if the crosswords are solved, without opening a window."));
+    QCommandLineOption statisticsOption(QStringLiteral("statistics"),
+                                        i18n("Print statistics of the crosswords, without opening a window."));
+    parser.addOptions(QList<QCommandLineOption>() << convertOption << outputDirOption
+                      << validateOption << verifyChecksumsOption << checkOption
+                      << statisticsOption);
     aboutData.setupCommandLine(&parser);
     parser.process(app);
     aboutData.processCommandLine(&parser);
 
+    if (batchMode) {
+        BatchProcessor::Operations operations;
+        if (parser.isSet(convertOption))
+            operations |= BatchProcessor::Convert;
+        if (parser.isSet(validateOption))
+            operations |= BatchProcessor::Validate;
+        if (parser.isSet(verifyChecksumsOption))
+            operations |= BatchProcessor::VerifyChecksums;
+        if (parser.isSet(checkOption))
+            operations |= BatchProcessor::CheckSolution;
+        if (parser.isSet(statisticsOption))
+            operations |= BatchProcessor::DumpStatistics;
+
+        BatchProcessor processor(operations);
+        if (parser.isSet(convertOption)) {
+            processor.setTargetFormat(BatchProcessor::fileFormatFromExtension(
+                                          parser.value(convertOption)));
+        }
+        processor.setOutputDirectory(parser.value(outputDirOption));
+
+        return processor.process(parser.positionalArguments()) == 0 ? 0 : 1;
+    }
+
     MainWindow *widget = new MainWindow;
 
     // see if we are starting with session management
@@ -322,6 +322,7 @@ void MainWindow::settingsChanged()
     m_mainCrossword->updateTheme();
 
     m_mainCrossword->krossWord()->setAnimationEnabled(Settings::animate());
+    m_mainCrossword->updateUndoMemoryLimit();
 }
 
 void MainWindow::showStatusbarGlobal(bool show)